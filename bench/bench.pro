@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = tsbench
+CONFIG -= qt app_bundle
+CONFIG += c++17 console
+
+include(../tscore.pri)
+
+HEADERS += ./tsgen.h \
+    ./tsbitwriter.h \
+    ./tsalloc.h
+
+SOURCES += ./tsbench.cpp \
+    ./tsgen.cpp \
+    ./tsalloc.cpp
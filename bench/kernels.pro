@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = tskernels
+CONFIG -= qt app_bundle
+CONFIG += c++17 console
+
+include(../tscore.pri)
+
+HEADERS += ./tsgen.h \
+    ./tsbitwriter.h \
+    ./tsperf.h
+
+SOURCES += ./tskernels.cpp \
+    ./tsgen.cpp \
+    ./tsperf.cpp
@@ -0,0 +1,10 @@
+#ifndef TSALLOC_H
+#define TSALLOC_H
+
+#include <cstdint>
+
+// Heap allocations (malloc, calloc, realloc, operator new) made by the
+// process since start. Counted only where the allocator can be interposed.
+uint64_t tsAllocationCount();
+
+#endif // TSALLOC_H
@@ -0,0 +1,448 @@
+// End-to-end throughput benchmark: generated transport stream -> TsDemuxer ->
+// TsEsWriter, the path TsParser runs for every file. Prints one JSON document.
+//
+//     tsbench [--size-mb N] [--iterations N] [--dir path] [--filter name]
+//             [--seed N] [--bitrate bps] [--keep] [--stats] [--trace file]
+//
+// Built with zlib, the gzip_* checks read a broken .gz of the mix stream
+// and fail the run unless exactly the intact bytes come before the error.
+
+#include "tsgen.h"
+#include "tsalloc.h"
+#include "tsdecompress.h"
+#include "tsdemuxer.h"
+#include "tseswriter.h"
+#include "tscontext.h"
+#include "tstrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined (TSSPLIT_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+struct BENCH_SCENARIO
+{
+    std::string    name;
+    TS_GEN_OPTIONS options;
+};
+
+struct BENCH_RESULT
+{
+    int32_t  result;
+    int64_t  bytes;
+    int64_t  packets;
+    int64_t  frames;
+    int64_t  esBytes;
+    uint64_t allocations;
+    int64_t  memoryPeak;
+    double   seconds;
+    TS_STATS_SNAPSHOT stages;
+};
+
+///////////////////////////////////////////////////////////
+// Counts what reaches the writer
+class BenchSink : public TsFrameSink
+{
+public:
+    BenchSink(TsEsWriter& writer) : writer_(writer), frames_(0), bytes_(0) {}
+
+    bool openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType) override
+    {
+        if (!writer_.openStream(pid, channel, streamType))
+            return false;
+        // every PMT version opens the streams again, names are copied once
+        if (std::find(pids_.begin(), pids_.end(), pid) != pids_.end())
+            return true;
+        pids_.push_back(pid);
+        auto name = writer_.fileName(pid);
+        for (auto& file : files_)
+            if (file == name)
+                return true;
+        files_.push_back(name);
+        return true;
+    }
+
+    bool writeFrame(const STREAM_PKG& pkg) override
+    {
+        frames_++;
+        bytes_ += pkg.size;
+        return writer_.writeFrame(pkg);
+    }
+
+    inline int64_t frames() const { return frames_; }
+    inline int64_t bytes() const { return bytes_; }
+    inline const std::vector<std::string>& files() const { return files_; }
+
+private:
+    TsEsWriter& writer_;
+    int64_t frames_;
+    int64_t bytes_;
+    std::vector<std::string> files_;
+    std::vector<uint16_t> pids_;
+};
+
+static std::vector<BENCH_SCENARIO> scenarios(const TS_GEN_OPTIONS& base)
+{
+    std::vector<BENCH_SCENARIO> list;
+    const int32_t packetSizes[] = { 188, 192, 204, 208 };
+
+    for (auto packetSize : packetSizes)
+    {
+        BENCH_SCENARIO s = { "mix_" + std::to_string(packetSize), base };
+        s.options.packetSize = packetSize;
+        list.push_back(s);
+    }
+
+    for (int32_t codec = 0; codec < TS_GEN_CODEC_COUNT; codec++)
+    {
+        BENCH_SCENARIO s = { std::string("codec_") + TsGenerator::codecName(static_cast<TS_GEN_CODEC>(codec)), base };
+        s.options.codecs.assign(1, static_cast<TS_GEN_CODEC>(codec));
+        s.options.pidCount = 4;
+        list.push_back(s);
+    }
+
+    BENCH_SCENARIO pids = { "many_pids", base };
+    pids.options.pidCount = 64;
+    list.push_back(pids);
+
+    BENCH_SCENARIO cc = { "cc_errors", base };
+    cc.options.ccErrorRate = 0.001;
+    list.push_back(cc);
+
+    BENCH_SCENARIO garbage = { "garbage", base };
+    garbage.options.garbageRate = 0.001;
+    list.push_back(garbage);
+
+    BENCH_SCENARIO churn = { "pmt_churn", base };
+    churn.options.pmtVersionInterval = 1;
+    list.push_back(churn);
+
+    return list;
+}
+
+static void printStages(const TS_STATS_SNAPSHOT& stages)
+{
+    printf(",\"stages\":{\"tick_unit\":\"%s\",\"counters\":{", TsStats::tickUnit());
+    for (int32_t i = 0; i < TS_STAT_COUNTER_COUNT; i++)
+        printf("%s\"%s\":%llu", i ? "," : "", TsStats::counterName(static_cast<TS_STAT_COUNTER>(i)),
+            static_cast<unsigned long long>(stages.counters[i]));
+    printf("},\"timers\":{");
+    for (int32_t i = 0; i < TS_STAT_TIMER_COUNT; i++)
+    {
+        auto calls = stages.timerCalls[i];
+        printf("%s\"%s\":{\"calls\":%llu,\"ticks\":%llu,\"ticks_per_call\":%.1f}", i ? "," : "",
+            TsStats::timerName(static_cast<TS_STAT_TIMER>(i)), static_cast<unsigned long long>(calls),
+            static_cast<unsigned long long>(stages.timerTicks[i]),
+            calls > 0 ? static_cast<double>(stages.timerTicks[i]) / calls : 0.0);
+    }
+    printf("}}");
+}
+
+static bool runOnce(const std::string& path, const std::string& dir, const std::string& name, BENCH_RESULT& r)
+{
+    TsFileInput input(path);
+    if (!input.open())
+    {
+        fprintf(stderr, "%s: %s\n", path.c_str(), input.errorString().c_str());
+        return false;
+    }
+
+    TsEsWriter writer(dir, name);
+    BenchSink sink(writer);
+    TsDemuxer demuxer(input, sink);
+
+    auto allocations = tsAllocationCount();
+    auto start = std::chrono::steady_clock::now();
+
+    r.result = demuxer.process();
+    writer.close();
+
+    auto end = std::chrono::steady_clock::now();
+    r.allocations = tsAllocationCount() - allocations;
+    r.seconds = std::chrono::duration<double>(end - start).count();
+    r.bytes = demuxer.getPosition();
+    r.packets = demuxer.getPackets();
+    r.frames = sink.frames();
+    r.esBytes = sink.bytes();
+    r.stages = demuxer.stats().snapshot();
+    r.memoryPeak = demuxer.memory().peak();
+
+    for (auto& file : sink.files())
+        remove(file.c_str());
+    return true;
+}
+
+#if defined (TSSPLIT_HAVE_ZLIB)
+static bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    uint8_t buf[65536];
+    size_t n;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(file);
+    return true;
+}
+
+static bool writeFile(const std::string& path, const uint8_t* data, size_t size)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+    bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+// Decompresses a broken copy of the stream: the bytes read before the error
+// must be the source up to expected, and an error must follow.
+static bool checkBrokenGzip(const std::string& path, const std::vector<uint8_t>& source, int64_t expected,
+    int32_t packetSize, int64_t& bytes, std::string& error)
+{
+    bytes = 0;
+    std::unique_ptr<TsInput> input(TsInput::create(path));
+    if (!input || !input->open())
+        return false;
+
+    bool eof = false;
+    bool intact = true;
+    const uint8_t* data;
+    while ((data = input->read(bytes, packetSize, eof)) != nullptr)
+    {
+        intact = intact && bytes + packetSize <= static_cast<int64_t>(source.size()) &&
+            memcmp(data, source.data() + bytes, static_cast<size_t>(packetSize)) == 0;
+        bytes += packetSize;
+    }
+    error = input->errorString();
+    return intact && bytes == expected && !error.empty();
+}
+
+// gzip_crc: the CRC32 of the trailer is broken, every byte is read first;
+// gzip_truncated: the file ends in the middle, the intact packets are read
+static int32_t runGzipChecks(const TS_GEN_OPTIONS& base, const std::string& dir, const std::string& filter,
+    bool keep, bool& first)
+{
+    const char* names[] = { "gzip_crc", "gzip_truncated" };
+    if (!filter.empty() && std::none_of(std::begin(names), std::end(names),
+        [&filter](const char* name) { return std::string(name).find(filter) != std::string::npos; }))
+        return 0;
+
+    auto path = dir + "/tsbench_gzip.ts";
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+    TsGenerator generator(base);
+    bool written = generator.write(file);
+    fclose(file);
+
+    std::vector<uint8_t> source, compressed;
+    auto gz = gzopen((path + ".gz").c_str(), "wb1");
+    written = written && readFile(path, source) && gz != nullptr &&
+        gzwrite(gz, source.data(), static_cast<unsigned>(source.size())) == static_cast<int>(source.size());
+    written = gz != nullptr && gzclose(gz) == Z_OK && written && readFile(path + ".gz", compressed);
+    if (!keep)
+    {
+        remove(path.c_str());
+        remove((path + ".gz").c_str());
+    }
+    if (!written || compressed.size() < 64)
+    {
+        fprintf(stderr, "%s.gz: write error\n", path.c_str());
+        return 1;
+    }
+
+    struct GZIP_CHECK
+    {
+        const char* name;
+        size_t      size;       // of the broken file
+        int64_t     expected;   // bytes before the error
+    };
+    auto packetSize = base.packetSize;
+    auto whole = static_cast<int64_t>(source.size()) / packetSize * packetSize;
+    const GZIP_CHECK checks[] = {
+        { names[0], compressed.size(), whole },
+        { names[1], compressed.size() / 2, -1 },
+    };
+
+    int32_t failed = 0;
+    for (const auto& check : checks)
+    {
+        if (!filter.empty() && std::string(check.name).find(filter) == std::string::npos)
+            continue;
+
+        std::vector<uint8_t> broken(compressed.begin(), compressed.begin() + check.size);
+        if (check.expected >= 0)
+            broken[broken.size() - 8] ^= 0xff;
+        auto brokenPath = dir + "/tsbench_" + check.name + ".ts.gz";
+        if (!writeFile(brokenPath, broken.data(), broken.size()))
+        {
+            fprintf(stderr, "%s: %s\n", brokenPath.c_str(), strerror(errno));
+            return 1;
+        }
+
+        // truncated: what a single inflate of the intact part gives
+        int64_t expected = check.expected;
+        if (expected < 0)
+        {
+            std::vector<uint8_t> out(source.size());
+            z_stream z;
+            memset(&z, 0, sizeof(z));
+            inflateInit2(&z, 15 + 32);
+            z.next_in = broken.data();
+            z.avail_in = static_cast<uInt>(broken.size());
+            z.next_out = out.data();
+            z.avail_out = static_cast<uInt>(out.size());
+            inflate(&z, Z_NO_FLUSH);
+            expected = static_cast<int64_t>(z.total_out) / packetSize * packetSize;
+            inflateEnd(&z);
+        }
+
+        int64_t bytes;
+        std::string error;
+        bool ok = checkBrokenGzip(brokenPath, source, expected, packetSize, bytes, error);
+        if (!keep)
+            remove(brokenPath.c_str());
+        if (!ok)
+            failed++;
+
+        printf("%s\n{\"name\":\"%s\",\"check\":\"%s\",\"bytes\":%lld,\"expected\":%lld,\"error\":\"%s\"}",
+            first ? "" : ",", check.name, ok ? "ok" : "failed", static_cast<long long>(bytes),
+            static_cast<long long>(expected), error.c_str());
+        fflush(stdout);
+        first = false;
+    }
+    return failed;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    auto base = TsGenerator::defaultOptions();
+    int32_t iterations = 3;
+    std::string dir = "/tmp";
+    std::string filter;
+    bool keep = false;
+    std::string trace;
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--size-mb" && hasValue)
+            base.totalBytes = atoll(argv[++i]) * 1024 * 1024;
+        else if (arg == "--iterations" && hasValue)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (arg == "--dir" && hasValue)
+            dir = argv[++i];
+        else if (arg == "--filter" && hasValue)
+            filter = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            base.seed = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--bitrate" && hasValue)
+            base.bitrate = atoll(argv[++i]);
+        else if (arg == "--keep")
+            keep = true;
+        else if (arg == "--stats")
+            TsStats::setEnabled(true);
+        else if (arg == "--trace" && hasValue)
+            trace = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--size-mb N] [--iterations N] [--dir path] [--filter name] "
+                "[--seed N] [--bitrate bps] [--keep] [--stats] [--trace file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!trace.empty())
+        TsTrace::start();
+
+    printf("{\"benchmark\":\"tssplit\",\"size_mb\":%lld,\"iterations\":%d,\"seed\":%llu,\"results\":[",
+        static_cast<long long>(base.totalBytes / (1024 * 1024)), iterations,
+        static_cast<unsigned long long>(base.seed));
+
+    int32_t failed = 0;
+    bool first = true;
+    for (auto& scenario : scenarios(base))
+    {
+        if (!filter.empty() && scenario.name.find(filter) == std::string::npos)
+            continue;
+
+        auto path = dir + "/tsbench_" + scenario.name + ".ts";
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+            return 1;
+        }
+        TsGenerator generator(scenario.options);
+        bool written = generator.write(file);
+        fclose(file);
+        if (!written)
+        {
+            fprintf(stderr, "%s: write error\n", path.c_str());
+            return 1;
+        }
+
+        // best of the iterations
+        BENCH_RESULT best = {};
+        best.seconds = -1;
+        for (int32_t i = 0; i < iterations; i++)
+        {
+            BENCH_RESULT r;
+            if (!runOnce(path, dir, "tsbench_" + scenario.name, r))
+                return 1;
+            if (best.seconds < 0 || r.seconds < best.seconds)
+                best = r;
+        }
+
+        if (!keep)
+            remove(path.c_str());
+
+        if (best.result != AVCONTEXT_EOF_3)
+            failed++;
+
+        double seconds = best.seconds > 0 ? best.seconds : 1e-9;
+        printf("%s\n{\"name\":\"%s\",\"packet_size\":%d,\"pids\":%d,\"result\":%d,\"bytes\":%lld,"
+            "\"packets\":%lld,\"frames\":%lld,\"es_bytes\":%lld,\"seconds\":%.6f,\"mb_s\":%.2f,"
+            "\"packets_s\":%.0f,\"allocs\":%llu,\"allocs_per_packet\":%.6f,\"mem_peak\":%lld",
+            first ? "" : ",",
+            scenario.name.c_str(), scenario.options.packetSize, scenario.options.pidCount, best.result,
+            static_cast<long long>(best.bytes), static_cast<long long>(best.packets),
+            static_cast<long long>(best.frames), static_cast<long long>(best.esBytes), best.seconds,
+            best.bytes / seconds / (1024 * 1024), best.packets / seconds,
+            static_cast<unsigned long long>(best.allocations),
+            best.packets > 0 ? static_cast<double>(best.allocations) / best.packets : 0.0,
+            static_cast<long long>(best.memoryPeak));
+        if (TsStats::enabled())
+            printStages(best.stages);
+        printf("}");
+        fflush(stdout);
+        first = false;
+    }
+#if defined (TSSPLIT_HAVE_ZLIB)
+    failed += runGzipChecks(base, dir, filter, keep, first);
+#endif
+    printf("\n]}\n");
+
+    if (!trace.empty())
+    {
+        TsTrace::stop();
+        if (!TsTrace::writeChromeJson(trace))
+            fprintf(stderr, "%s: %s\n", trace.c_str(), strerror(errno));
+    }
+    return failed;
+}
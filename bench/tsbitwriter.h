@@ -0,0 +1,56 @@
+#ifndef TSBITWRITER_H
+#define TSBITWRITER_H
+
+#include <cstdint>
+#include <vector>
+
+///////////////////////////////////////////////////////////
+// MSB first bit writer for the synthetic headers
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& out) : out_(out), acc_(0), bits_(0) {}
+
+    void putBits(uint32_t val, int32_t num)
+    {
+        while (num-- > 0)
+        {
+            acc_ = (acc_ << 1) | ((val >> num) & 1);
+            if (++bits_ == 8)
+            {
+                out_.push_back(static_cast<uint8_t>(acc_));
+                acc_ = bits_ = 0;
+            }
+        }
+    }
+
+    void putGolombUE(uint32_t val)
+    {
+        uint32_t v = val + 1;
+        int32_t len = 0;
+        for (uint32_t t = v; t > 1; t >>= 1)
+            len++;
+        putBits(0, len);
+        putBits(v, len + 1);
+    }
+
+    void putGolombSE(int32_t val)
+    {
+        putGolombUE(val > 0 ? 2 * val - 1 : -2 * val);
+    }
+
+    // rbsp_trailing_bits
+    void finish()
+    {
+        putBits(1, 1);
+        while (bits_ != 0)
+            putBits(0, 1);
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint32_t acc_;
+    int32_t  bits_;
+};
+
+#endif // TSBITWRITER_H
@@ -0,0 +1,714 @@
+#include "tsgen.h"
+#include "tsbitwriter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define TS_PACKET_SIZE          188
+#define TS_GEN_PMT_PID          0x1000
+#define TS_GEN_FIRST_PID        0x100
+#define TS_GEN_PSI_INTERVAL     (90000LL / 10)  // PAT and PMT every 100 ms
+#define TS_GEN_START_TIME       90000LL
+#define TS_GEN_GOP_SIZE         25
+#define TS_GEN_FLUSH_SIZE       (1024 * 1024)
+
+static uint32_t crc32Mpeg(const uint8_t* data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int32_t b = 0; b < 8; b++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+    return crc;
+}
+
+static void putPts(std::vector<uint8_t>& out, uint8_t prefix, int64_t pts)
+{
+    out.push_back(static_cast<uint8_t>((prefix << 4) | ((pts >> 29) & 0x0e) | 1));
+    out.push_back(static_cast<uint8_t>(pts >> 22));
+    out.push_back(static_cast<uint8_t>((pts >> 14) | 1));
+    out.push_back(static_cast<uint8_t>(pts >> 7));
+    out.push_back(static_cast<uint8_t>((pts << 1) | 1));
+}
+
+// NAL payload with emulation prevention bytes
+static void putNal(std::vector<uint8_t>& es, uint8_t header, const std::vector<uint8_t>& rbsp, bool longStartCode)
+{
+    if (longStartCode)
+        es.push_back(0);
+    es.push_back(0);
+    es.push_back(0);
+    es.push_back(1);
+    es.push_back(header);
+
+    int32_t zeros = 0;
+    for (auto b : rbsp)
+    {
+        if (zeros == 2 && b <= 3)
+        {
+            es.push_back(3);
+            zeros = 0;
+        }
+        es.push_back(b);
+        zeros = (b == 0 ? zeros + 1 : 0);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+TsGenerator::TsGenerator(const TS_GEN_OPTIONS& options)
+    : options_(options),
+    rng_(options.seed ? options.seed : 0x9e3779b97f4a7c15ULL),
+    packets_(0),
+    written_(0),
+    psiCount_(0),
+    patCc_(0),
+    pmtCc_(0),
+    pmtVersion_(0)
+{
+    if (options_.codecs.empty())
+        options_.codecs.push_back(TS_GEN_CODEC_H264);
+
+    int32_t videoCount = 0;
+    int64_t audioRate = 0;
+    for (int32_t i = 0; i < options_.pidCount; i++)
+    {
+        GEN_STREAM stream;
+        stream.codec = options_.codecs[i % options_.codecs.size()];
+        stream.pid = static_cast<uint16_t>(TS_GEN_FIRST_PID + i);
+        stream.cc = 0;
+        stream.dts = TS_GEN_START_TIME;
+        stream.frameNumber = 0;
+
+        switch (stream.codec)
+        {
+        case TS_GEN_CODEC_H264:
+        case TS_GEN_CODEC_MPEG2:
+            stream.duration = 3600;             // 25 fps
+            stream.frameSize = 0;
+            videoCount++;
+            break;
+        case TS_GEN_CODEC_AAC_ADTS:
+            stream.duration = 1024 * 90000 / 44100;
+            stream.frameSize = 372;             // 128 kbit/s
+            break;
+        case TS_GEN_CODEC_AAC_LATM:
+            stream.duration = 1024 * 90000 / 48000;
+            stream.frameSize = 384;             // 144 kbit/s
+            break;
+        case TS_GEN_CODEC_AC3:
+            stream.duration = 1536 * 90000 / 48000;
+            stream.frameSize = 768;             // 192 kbit/s
+            break;
+        case TS_GEN_CODEC_MP2:
+            stream.duration = 1152 * 90000 / 48000;
+            stream.frameSize = 576;             // 192 kbit/s
+            break;
+        case TS_GEN_CODEC_TELETEXT:
+            stream.duration = 3600;
+            stream.frameSize = 1 + 4 * 46;
+            break;
+        case TS_GEN_CODEC_DVBSUB:
+        default:
+            stream.duration = 2 * 90000;
+            stream.frameSize = 9;
+            break;
+        }
+        audioRate += stream.frameSize * 8 * 90000 / stream.duration;
+        streams_.push_back(stream);
+    }
+
+    // the video streams share what the other streams leave of the bitrate
+    if (videoCount > 0)
+    {
+        int64_t videoRate = std::max<int64_t>((options_.bitrate - audioRate) / videoCount, 200000);
+        for (auto& stream : streams_)
+            if (stream.frameSize == 0)
+                stream.frameSize = static_cast<int32_t>(videoRate / 8 / 25);
+    }
+}
+
+TS_GEN_OPTIONS TsGenerator::defaultOptions()
+{
+    TS_GEN_OPTIONS options;
+    options.packetSize = 188;
+    options.pidCount = TS_GEN_CODEC_COUNT;
+    for (int32_t i = 0; i < TS_GEN_CODEC_COUNT; i++)
+        options.codecs.push_back(static_cast<TS_GEN_CODEC>(i));
+    options.bitrate = 8000000;
+    options.totalBytes = 64 * 1024 * 1024;
+    options.ccErrorRate = 0;
+    options.garbageRate = 0;
+    options.pmtVersionInterval = 0;
+    options.seed = 1;
+    return options;
+}
+
+const char* TsGenerator::codecName(TS_GEN_CODEC codec)
+{
+    switch (codec)
+    {
+    case TS_GEN_CODEC_H264:
+        return "h264";
+    case TS_GEN_CODEC_MPEG2:
+        return "mpeg2";
+    case TS_GEN_CODEC_AAC_ADTS:
+        return "aac_adts";
+    case TS_GEN_CODEC_AAC_LATM:
+        return "aac_latm";
+    case TS_GEN_CODEC_AC3:
+        return "ac3";
+    case TS_GEN_CODEC_MP2:
+        return "mp2";
+    case TS_GEN_CODEC_TELETEXT:
+        return "teletext";
+    case TS_GEN_CODEC_DVBSUB:
+        return "dvbsub";
+    default:
+        return "unknown";
+    }
+}
+
+// xorshift64*
+uint32_t TsGenerator::random()
+{
+    rng_ ^= rng_ >> 12;
+    rng_ ^= rng_ << 25;
+    rng_ ^= rng_ >> 27;
+    return static_cast<uint32_t>((rng_ * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+// payload filler: never a start code, sync word or TS sync byte
+uint8_t TsGenerator::fillByte()
+{
+    return static_cast<uint8_t>(0x80 | (random() & 0x3f));
+}
+
+bool TsGenerator::write(FILE* file)
+{
+    std::vector<uint8_t> es;
+    int64_t nextPsi = 0;
+
+    while (written_ < options_.totalBytes)
+    {
+        auto It = std::min_element(streams_.begin(), streams_.end(),
+            [](const GEN_STREAM& a, const GEN_STREAM& b) { return a.dts < b.dts; });
+
+        int64_t now = (It == streams_.end() ? nextPsi : It->dts);
+        if (now >= nextPsi)
+        {
+            writePsi();
+            nextPsi = now + TS_GEN_PSI_INTERVAL;
+        }
+
+        if (It != streams_.end())
+        {
+            es.clear();
+            buildFrame(*It, es);
+            writePes(*It, es);
+            It->dts += It->duration;
+            It->frameNumber++;
+        }
+
+        if (out_.size() >= TS_GEN_FLUSH_SIZE || written_ + static_cast<int64_t>(out_.size()) >= options_.totalBytes)
+        {
+            if (fwrite(out_.data(), 1, out_.size(), file) != out_.size())
+                return false;
+            written_ += static_cast<int64_t>(out_.size());
+            out_.clear();
+        }
+    }
+    return true;
+}
+
+void TsGenerator::buildElementaryStream(TS_GEN_CODEC codec, int32_t frames, std::vector<uint8_t>& es)
+{
+    GEN_STREAM* stream = nullptr;
+    for (auto& s : streams_)
+        if (s.codec == codec)
+            stream = &s;
+    if (stream == nullptr)
+        return;
+
+    std::vector<uint8_t> frame;
+    for (int32_t i = 0; i < frames; i++)
+    {
+        frame.clear();
+        buildFrame(*stream, frame);
+        es.insert(es.end(), frame.begin(), frame.end());
+        stream->frameNumber++;
+    }
+}
+
+void TsGenerator::buildFrame(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    switch (stream.codec)
+    {
+    case TS_GEN_CODEC_H264:
+        buildH264(stream, es);
+        break;
+    case TS_GEN_CODEC_MPEG2:
+        buildMpeg2(stream, es);
+        break;
+    case TS_GEN_CODEC_AAC_ADTS:
+        buildAdts(stream, es);
+        break;
+    case TS_GEN_CODEC_AAC_LATM:
+        buildLatm(stream, es);
+        break;
+    case TS_GEN_CODEC_AC3:
+        buildAc3(stream, es);
+        break;
+    case TS_GEN_CODEC_MP2:
+        buildMp2(stream, es);
+        break;
+    case TS_GEN_CODEC_TELETEXT:
+        buildTeletext(stream, es);
+        break;
+    case TS_GEN_CODEC_DVBSUB:
+    default:
+        buildSubtitle(stream, es);
+        break;
+    }
+}
+
+// AUD, SPS and PPS on IDR, one slice. Baseline 1920x1080, POC type 2.
+void TsGenerator::buildH264(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    int32_t gopIndex = static_cast<int32_t>(stream.frameNumber % TS_GEN_GOP_SIZE);
+    bool idr = (gopIndex == 0);
+    std::vector<uint8_t> rbsp;
+
+    rbsp.push_back(0xf0);
+    putNal(es, 0x09, rbsp, true);
+
+    if (idr)
+    {
+        rbsp.clear();
+        BitWriter sps(rbsp);
+        sps.putBits(66, 8);             // profile_idc
+        sps.putBits(0, 8);
+        sps.putBits(40, 8);             // level_idc
+        sps.putGolombUE(0);             // seq_parameter_set_id
+        sps.putGolombUE(0);             // log2_max_frame_num_minus4
+        sps.putGolombUE(2);             // pic_order_cnt_type
+        sps.putGolombUE(1);             // max_num_ref_frames
+        sps.putBits(0, 1);
+        sps.putGolombUE(119);           // pic_width_in_mbs_minus1
+        sps.putGolombUE(67);            // pic_height_in_map_units_minus1
+        sps.putBits(1, 1);              // frame_mbs_only_flag
+        sps.putBits(1, 1);              // direct_8x8_inference_flag
+        sps.putBits(1, 1);              // frame_cropping_flag
+        sps.putGolombUE(0);
+        sps.putGolombUE(0);
+        sps.putGolombUE(0);
+        sps.putGolombUE(4);
+        sps.putBits(0, 1);              // vui_parameters_present_flag
+        sps.finish();
+        putNal(es, 0x67, rbsp, true);
+
+        rbsp.clear();
+        BitWriter pps(rbsp);
+        pps.putGolombUE(0);             // pic_parameter_set_id
+        pps.putGolombUE(0);             // seq_parameter_set_id
+        pps.putBits(0, 1);              // entropy_coding_mode_flag
+        pps.putBits(0, 1);              // bottom_field_pic_order_in_frame_present_flag
+        pps.putGolombUE(0);             // num_slice_groups_minus1
+        pps.putGolombUE(0);
+        pps.putGolombUE(0);
+        pps.putBits(0, 3);
+        pps.putGolombSE(0);
+        pps.putGolombSE(0);
+        pps.putGolombSE(0);
+        pps.putBits(4, 3);              // deblocking_filter_control_present_flag
+        pps.finish();
+        putNal(es, 0x68, rbsp, true);
+    }
+
+    rbsp.clear();
+    BitWriter slh(rbsp);
+    slh.putGolombUE(0);                 // first_mb_in_slice
+    slh.putGolombUE(idr ? 7 : 5);       // I or P, whole picture
+    slh.putGolombUE(0);                 // pic_parameter_set_id
+    slh.putBits(gopIndex % 16, 4);      // frame_num
+    if (idr)
+        slh.putGolombUE(static_cast<uint32_t>(stream.frameNumber / TS_GEN_GOP_SIZE) & 0xff);
+    slh.finish();
+    putNal(es, idr ? 0x65 : 0x41, rbsp, false);
+
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+        es.push_back(fillByte());
+}
+
+// sequence header on I pictures, picture header, one slice
+void TsGenerator::buildMpeg2(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    bool intra = (stream.frameNumber % TS_GEN_GOP_SIZE) == 0;
+
+    if (intra)
+    {
+        static const uint8_t seq[] = {
+            0x00, 0x00, 0x01, 0xb3,
+            0x78, 0x04, 0x38,           // 1920x1080
+            0x33,                       // 16:9, 25 fps
+            0xff, 0xff, 0xe0, 0x18      // VBR, marker, vbv buffer size
+        };
+        es.insert(es.end(), seq, seq + sizeof(seq));
+    }
+
+    int32_t temporalReference = static_cast<int32_t>(stream.frameNumber % TS_GEN_GOP_SIZE);
+    std::vector<uint8_t> pic = { 0x00, 0x00, 0x01, 0x00 };
+    BitWriter bw(pic);
+    bw.putBits(temporalReference, 10);
+    bw.putBits(intra ? 1 : 2, 3);       // picture_coding_type
+    bw.putBits(0xffff, 16);             // vbv_delay
+    bw.putBits(0, 3);
+    es.insert(es.end(), pic.begin(), pic.end());
+
+    static const uint8_t slice[] = { 0x00, 0x00, 0x01, 0x01 };
+    es.insert(es.end(), slice, slice + sizeof(slice));
+
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+        es.push_back(fillByte());
+}
+
+// AAC LC, 44.1 kHz stereo, no CRC
+void TsGenerator::buildAdts(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    int32_t len = stream.frameSize;
+    es.push_back(0xff);
+    es.push_back(0xf1);
+    es.push_back(0x50);
+    es.push_back(static_cast<uint8_t>(0x80 | ((len >> 11) & 0x03)));
+    es.push_back(static_cast<uint8_t>(len >> 3));
+    es.push_back(static_cast<uint8_t>(((len & 0x07) << 5) | 0x1f));
+    es.push_back(0xfc);
+
+    while (static_cast<int32_t>(es.size()) < len)
+        es.push_back(fillByte());
+}
+
+// LOAS/LATM with an in-band StreamMuxConfig: AAC LC, 48 kHz stereo
+void TsGenerator::buildLatm(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    int32_t len = stream.frameSize - 3;
+    es.push_back(0x56);
+    es.push_back(static_cast<uint8_t>(0xe0 | ((len >> 8) & 0x1f)));
+    es.push_back(static_cast<uint8_t>(len));
+
+    std::vector<uint8_t> mux;
+    BitWriter bw(mux);
+    bw.putBits(0, 1);                   // useSameStreamMux
+    bw.putBits(0, 1);                   // audioMuxVersion
+    bw.putBits(1, 1);                   // allStreamsSameTimeFraming
+    bw.putBits(0, 6);                   // numSubFrames
+    bw.putBits(0, 4);                   // numProgram
+    bw.putBits(0, 3);                   // numLayer
+    bw.putBits(2, 5);                   // audioObjectType: LC
+    bw.putBits(3, 4);                   // samplingFrequencyIndex: 48000
+    bw.putBits(2, 4);                   // channelConfiguration
+    bw.putBits(0, 3);                   // GASpecificConfig
+    bw.putBits(0, 3);                   // frameLengthType
+    bw.putBits(0xff, 8);                // latmBufferFullness
+    bw.putBits(0, 1);                   // otherDataPresent
+    bw.putBits(0, 1);                   // crcCheckPresent
+    int32_t payload = len - 8;
+    for (; payload >= 255; payload -= 255)
+        bw.putBits(0xff, 8);            // PayloadLengthInfo
+    bw.putBits(payload, 8);
+    bw.finish();
+    es.insert(es.end(), mux.begin(), mux.end());
+
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+        es.push_back(fillByte());
+}
+
+// AC-3 48 kHz, 192 kbit/s, 2/0
+void TsGenerator::buildAc3(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    static const uint8_t header[] = { 0x0b, 0x77, 0x00, 0x00, 0x14, 0x40, 0x40 };
+    es.insert(es.end(), header, header + sizeof(header));
+
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+        es.push_back(fillByte());
+}
+
+// MPEG-1 layer II 48 kHz, 192 kbit/s
+void TsGenerator::buildMp2(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    static const uint8_t header[] = { 0xff, 0xfd, 0xa4, 0x04 };
+    es.insert(es.end(), header, header + sizeof(header));
+
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+        es.push_back(fillByte());
+}
+
+// EBU data: data_identifier and four teletext data units
+void TsGenerator::buildTeletext(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    es.push_back(0x10);
+    while (static_cast<int32_t>(es.size()) < stream.frameSize)
+    {
+        es.push_back(0x02);
+        es.push_back(0x2c);
+        for (int32_t i = 0; i < 44; i++)
+            es.push_back(fillByte());
+    }
+}
+
+// end of display set segment only
+void TsGenerator::buildSubtitle(GEN_STREAM& stream, std::vector<uint8_t>& es)
+{
+    static const uint8_t pes[] = { 0x20, 0x00, 0x0f, 0x80, 0x00, 0x01, 0x00, 0x00, 0xff };
+    es.insert(es.end(), pes, pes + sizeof(pes));
+    (void)stream;
+}
+
+void TsGenerator::writePsi()
+{
+    if (options_.pmtVersionInterval > 0 && psiCount_ > 0 && psiCount_ % options_.pmtVersionInterval == 0)
+        pmtVersion_ = (pmtVersion_ + 1) & 0x1f;
+    psiCount_++;
+
+    std::vector<uint8_t> pat = {
+        0x00, 0xb0, 0x00,
+        0x00, 0x01,                     // transport_stream_id
+        0xc1, 0x00, 0x00,
+        0x00, 0x01,                     // program 1
+        static_cast<uint8_t>(0xe0 | (TS_GEN_PMT_PID >> 8)), static_cast<uint8_t>(TS_GEN_PMT_PID & 0xff)
+    };
+    writeSection(0, patCc_, pat);
+
+    uint16_t pcrPid = streams_.empty() ? 0x1fff : streams_[0].pid;
+    std::vector<uint8_t> pmt = {
+        0x02, 0xb0, 0x00,
+        0x00, 0x01,                     // program_number
+        static_cast<uint8_t>(0xc1 | (pmtVersion_ << 1)), 0x00, 0x00,
+        static_cast<uint8_t>(0xe0 | (pcrPid >> 8)), static_cast<uint8_t>(pcrPid & 0xff),
+        0xf0, 0x00
+    };
+
+    for (auto& stream : streams_)
+    {
+        uint8_t streamType;
+        std::vector<uint8_t> desc;
+        switch (stream.codec)
+        {
+        case TS_GEN_CODEC_H264:
+            streamType = 0x1b;
+            break;
+        case TS_GEN_CODEC_MPEG2:
+            streamType = 0x02;
+            break;
+        case TS_GEN_CODEC_AAC_ADTS:
+            streamType = 0x0f;
+            desc = { 0x0a, 0x04, 'e', 'n', 'g', 0x00 };
+            break;
+        case TS_GEN_CODEC_AAC_LATM:
+            streamType = 0x11;
+            desc = { 0x0a, 0x04, 'd', 'e', 'u', 0x00 };
+            break;
+        case TS_GEN_CODEC_AC3:
+            streamType = 0x06;
+            desc = { 0x6a, 0x01, 0x00, 0x0a, 0x04, 'e', 'n', 'g', 0x00 };
+            break;
+        case TS_GEN_CODEC_MP2:
+            streamType = 0x03;
+            desc = { 0x0a, 0x04, 'f', 'r', 'a', 0x00 };
+            break;
+        case TS_GEN_CODEC_TELETEXT:
+            streamType = 0x06;
+            desc = { 0x56, 0x05, 'e', 'n', 'g', 0x09, 0x00 };
+            break;
+        case TS_GEN_CODEC_DVBSUB:
+        default:
+            streamType = 0x06;
+            desc = { 0x59, 0x08, 'e', 'n', 'g', 0x10, 0x00, 0x01, 0x00, 0x01 };
+            break;
+        }
+
+        pmt.push_back(streamType);
+        pmt.push_back(static_cast<uint8_t>(0xe0 | (stream.pid >> 8)));
+        pmt.push_back(static_cast<uint8_t>(stream.pid & 0xff));
+        pmt.push_back(static_cast<uint8_t>(0xf0 | (desc.size() >> 8)));
+        pmt.push_back(static_cast<uint8_t>(desc.size() & 0xff));
+        pmt.insert(pmt.end(), desc.begin(), desc.end());
+    }
+    writeSection(TS_GEN_PMT_PID, pmtCc_, pmt);
+}
+
+// Completes section_length and CRC32, then splits the section over packets
+void TsGenerator::writeSection(uint16_t pid, uint8_t& cc, const std::vector<uint8_t>& table)
+{
+    std::vector<uint8_t> section(table);
+    size_t len = section.size() - 3 + 4;
+    section[1] = static_cast<uint8_t>(0xb0 | ((len >> 8) & 0x0f));
+    section[2] = static_cast<uint8_t>(len & 0xff);
+    uint32_t crc = crc32Mpeg(section.data(), section.size());
+    section.push_back(static_cast<uint8_t>(crc >> 24));
+    section.push_back(static_cast<uint8_t>(crc >> 16));
+    section.push_back(static_cast<uint8_t>(crc >> 8));
+    section.push_back(static_cast<uint8_t>(crc));
+    section.insert(section.begin(), 0x00);      // pointer_field
+
+    uint8_t ts[TS_PACKET_SIZE];
+    size_t pos = 0;
+    bool first = true;
+    while (pos < section.size())
+    {
+        ts[0] = 0x47;
+        ts[1] = static_cast<uint8_t>((first ? 0x40 : 0x00) | (pid >> 8));
+        ts[2] = static_cast<uint8_t>(pid & 0xff);
+        ts[3] = static_cast<uint8_t>(0x10 | cc);
+        cc = (cc + 1) & 0x0f;
+
+        size_t n = std::min<size_t>(section.size() - pos, TS_PACKET_SIZE - 4);
+        memcpy(ts + 4, section.data() + pos, n);
+        memset(ts + 4 + n, 0xff, TS_PACKET_SIZE - 4 - n);
+        pos += n;
+        first = false;
+        writePacket(ts);
+    }
+}
+
+void TsGenerator::writePes(GEN_STREAM& stream, const std::vector<uint8_t>& es)
+{
+    bool video = (stream.codec == TS_GEN_CODEC_H264 || stream.codec == TS_GEN_CODEC_MPEG2);
+    bool pcr = (!streams_.empty() && stream.pid == streams_[0].pid);
+    uint8_t streamId;
+    switch (stream.codec)
+    {
+    case TS_GEN_CODEC_H264:
+    case TS_GEN_CODEC_MPEG2:
+        streamId = 0xe0;
+        break;
+    case TS_GEN_CODEC_AAC_ADTS:
+    case TS_GEN_CODEC_AAC_LATM:
+    case TS_GEN_CODEC_MP2:
+        streamId = 0xc0;
+        break;
+    default:
+        streamId = 0xbd;
+        break;
+    }
+
+    std::vector<uint8_t> pes = { 0x00, 0x00, 0x01, streamId, 0x00, 0x00, 0x80 };
+    if (video)
+    {
+        pes.push_back(0xc0);
+        pes.push_back(10);
+        putPts(pes, 0x03, stream.dts + 3600);
+        putPts(pes, 0x01, stream.dts);
+    }
+    else
+    {
+        pes.push_back(0x80);
+        pes.push_back(5);
+        putPts(pes, 0x02, stream.dts);
+    }
+    size_t pesLen = pes.size() - 6 + es.size();
+    if (!video && pesLen <= 0xffff)
+    {
+        pes[4] = static_cast<uint8_t>(pesLen >> 8);
+        pes[5] = static_cast<uint8_t>(pesLen & 0xff);
+    }
+    pes.insert(pes.end(), es.begin(), es.end());
+
+    uint8_t ts[TS_PACKET_SIZE];
+    size_t pos = 0;
+    bool first = true;
+    while (pos < pes.size())
+    {
+        size_t remaining = pes.size() - pos;
+        uint8_t af[TS_PACKET_SIZE];
+        size_t afLen = 0;                       // adaptation field without its length byte
+        bool hasAf = false;
+
+        if (first && pcr)
+        {
+            int64_t base = stream.dts - 9000;
+            af[afLen++] = 0x10;
+            af[afLen++] = static_cast<uint8_t>(base >> 25);
+            af[afLen++] = static_cast<uint8_t>(base >> 17);
+            af[afLen++] = static_cast<uint8_t>(base >> 9);
+            af[afLen++] = static_cast<uint8_t>(base >> 1);
+            af[afLen++] = static_cast<uint8_t>(((base & 1) << 7) | 0x7e);
+            af[afLen++] = 0x00;
+            hasAf = true;
+        }
+
+        size_t space = TS_PACKET_SIZE - 4 - (hasAf ? afLen + 1 : 0);
+        if (remaining < space)
+        {
+            if (!hasAf)
+            {
+                hasAf = true;
+                space = TS_PACKET_SIZE - 5;
+                if (remaining < space)
+                {
+                    af[afLen++] = 0x00;
+                    space--;
+                }
+            }
+            while (remaining < space)
+            {
+                af[afLen++] = 0xff;
+                space--;
+            }
+        }
+
+        // lost packet: the counter skips
+        if (options_.ccErrorRate > 0 && random() < options_.ccErrorRate * 4294967296.0)
+            stream.cc = (stream.cc + 1) & 0x0f;
+
+        ts[0] = 0x47;
+        ts[1] = static_cast<uint8_t>((first ? 0x40 : 0x00) | (stream.pid >> 8));
+        ts[2] = static_cast<uint8_t>(stream.pid & 0xff);
+        ts[3] = static_cast<uint8_t>((hasAf ? 0x30 : 0x10) | stream.cc);
+        stream.cc = (stream.cc + 1) & 0x0f;
+
+        size_t n = 4;
+        if (hasAf)
+        {
+            ts[n++] = static_cast<uint8_t>(afLen);
+            memcpy(ts + n, af, afLen);
+            n += afLen;
+        }
+        memcpy(ts + n, pes.data() + pos, space);
+        pos += space;
+        first = false;
+        writePacket(ts);
+    }
+}
+
+void TsGenerator::writePacket(const uint8_t* ts)
+{
+    // M2TS: TP_extra_header with a 27 MHz arrival time stamp
+    if (options_.packetSize == 192)
+    {
+        uint32_t ats = static_cast<uint32_t>(packets_ * 2700) & 0x3fffffff;
+        out_.push_back(static_cast<uint8_t>(ats >> 24));
+        out_.push_back(static_cast<uint8_t>(ats >> 16));
+        out_.push_back(static_cast<uint8_t>(ats >> 8));
+        out_.push_back(static_cast<uint8_t>(ats));
+    }
+
+    out_.insert(out_.end(), ts, ts + TS_PACKET_SIZE);
+
+    // DVB-ASI / ATSC: parity bytes
+    if (options_.packetSize > TS_PACKET_SIZE + 4)
+    {
+        for (int32_t i = TS_PACKET_SIZE; i < options_.packetSize; i++)
+            out_.push_back(fillByte());
+    }
+
+    packets_++;
+
+    if (options_.garbageRate > 0 && random() < options_.garbageRate * 4294967296.0)
+    {
+        int32_t n = 1 + static_cast<int32_t>(random() % (options_.packetSize - 1));
+        for (int32_t i = 0; i < n; i++)
+            out_.push_back(static_cast<uint8_t>(random()));
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef TSGEN_H
+#define TSGEN_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum TS_GEN_CODEC
+{
+    TS_GEN_CODEC_H264 = 0,
+    TS_GEN_CODEC_MPEG2,
+    TS_GEN_CODEC_AAC_ADTS,
+    TS_GEN_CODEC_AAC_LATM,
+    TS_GEN_CODEC_AC3,
+    TS_GEN_CODEC_MP2,
+    TS_GEN_CODEC_TELETEXT,
+    TS_GEN_CODEC_DVBSUB,
+    TS_GEN_CODEC_COUNT
+};
+
+struct TS_GEN_OPTIONS
+{
+    int32_t  packetSize;         // 188, 192, 204 or 208
+    int32_t  pidCount;           // elementary streams, codecs assigned round-robin
+    std::vector<TS_GEN_CODEC> codecs;
+    int64_t  bitrate;            // mux bitrate in bit/s, sets the video frame size
+    int64_t  totalBytes;         // stop after this many bytes
+    double   ccErrorRate;        // share of packets with a wrong continuity counter
+    double   garbageRate;        // share of packets followed by junk bytes
+    int32_t  pmtVersionInterval; // PMT repetitions per version bump, 0: never
+    uint64_t seed;
+};
+
+///////////////////////////////////////////////////////////
+// Deterministic generator of valid transport streams: one program with a PAT,
+// a PMT and synthetic but well-formed elementary streams the parsers of the
+// core accept. The same options always produce the same bytes.
+class TsGenerator
+{
+public:
+    TsGenerator(const TS_GEN_OPTIONS& options);
+
+    static TS_GEN_OPTIONS defaultOptions();
+    static const char* codecName(TS_GEN_CODEC codec);
+
+    // false on a write error
+    bool write(FILE* file);
+    // frames of one stream of the codec, without TS/PES framing
+    void buildElementaryStream(TS_GEN_CODEC codec, int32_t frames, std::vector<uint8_t>& es);
+
+    inline int64_t getPackets() const
+    {
+        return packets_;
+    }
+
+private:
+    struct GEN_STREAM
+    {
+        TS_GEN_CODEC codec;
+        uint16_t pid;
+        uint8_t  cc;
+        int64_t  dts;            // next decode time (90kHz)
+        int64_t  duration;       // frame duration (90kHz)
+        int32_t  frameSize;
+        int64_t  frameNumber;
+    };
+
+    uint32_t random();
+    uint8_t  fillByte();
+
+    void buildFrame(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildH264(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildMpeg2(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildAdts(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildLatm(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildAc3(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildMp2(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildTeletext(GEN_STREAM& stream, std::vector<uint8_t>& es);
+    void buildSubtitle(GEN_STREAM& stream, std::vector<uint8_t>& es);
+
+    void writePsi();
+    void writePes(GEN_STREAM& stream, const std::vector<uint8_t>& es);
+    void writeSection(uint16_t pid, uint8_t& cc, const std::vector<uint8_t>& section);
+    void writePacket(const uint8_t* ts);
+
+private:
+    TS_GEN_OPTIONS options_;
+    std::vector<GEN_STREAM> streams_;
+    std::vector<uint8_t> out_;
+    uint64_t rng_;
+    int64_t  packets_;
+    int64_t  written_;
+    int64_t  psiCount_;
+    uint8_t  patCc_;
+    uint8_t  pmtCc_;
+    uint8_t  pmtVersion_;
+};
+
+#endif // TSGEN_H
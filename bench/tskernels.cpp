@@ -0,0 +1,509 @@
+// Microbenchmarks of the parsing kernels in isolation. Prints one JSON
+// document with ns/op, bytes/cycle and the hardware counters per kernel.
+//
+//     tskernels [--min-time seconds] [--filter name]
+
+#include "tsgen.h"
+#include "tsbitwriter.h"
+#include "tsperf.h"
+#include "bitstream.h"
+#include "tscontext.h"
+#include "ts_h264.h"
+#include "ts_mpegvideo.h"
+#include "ts_aac.h"
+#include "ts_ac3.h"
+#include "tscrc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define TS_PACKET_SIZE  188
+
+///////////////////////////////////////////////////////////
+// Friend of the parser classes: drives their private kernels directly
+class TsKernelBench
+{
+public:
+    TsKernelBench(double minSeconds, const std::string& filter);
+
+    void run();
+
+private:
+    template <typename Body>
+    void measure(const char* name, int64_t ops, int64_t bytes, Body body);
+
+    void benchReadBits();
+    void benchGolombUE();
+    void benchSliceHeader();
+    void benchSps();
+    void benchMpeg2Parse();
+    void benchAacHeaders(TS_GEN_CODEC codec, const char* name);
+    void benchAc3Headers();
+    void benchPsi();
+    void benchPes();
+    void benchRescale();
+    void benchCrc(const char* name, size_t len, uint32_t (*crc)(const uint8_t*, size_t, uint32_t));
+
+    static std::vector<uint8_t> elementaryStream(TS_GEN_CODEC codec, int32_t frames);
+    static std::vector<uint8_t> transportStream(const TS_GEN_OPTIONS& options);
+    static void feed(AVContext& context, const uint8_t* packet);
+
+private:
+    double      minSeconds_;
+    std::string filter_;
+    bool        first_;
+    uint64_t    sink_;
+};
+
+TsKernelBench::TsKernelBench(double minSeconds, const std::string& filter)
+    : minSeconds_(minSeconds),
+    filter_(filter),
+    first_(true),
+    sink_(0)
+{
+}
+
+void TsKernelBench::run()
+{
+    TsPerfCounters probe;
+    printf("{\"benchmark\":\"tssplit-kernels\",\"cycles\":\"%s\",\"results\":[", probe.cycleSource());
+
+    benchReadBits();
+    benchGolombUE();
+    benchSliceHeader();
+    benchSps();
+    benchMpeg2Parse();
+    benchAacHeaders(TS_GEN_CODEC_AAC_ADTS, "aac_find_headers_adts");
+    benchAacHeaders(TS_GEN_CODEC_AAC_LATM, "aac_find_headers_latm");
+    benchAc3Headers();
+    benchPsi();
+    benchPes();
+    benchRescale();
+    benchCrc("crc32_slice8_1k", 1024, tsCrc32Slice8);
+    benchCrc("crc32_1k", 1024, tsCrc32);
+    benchCrc("crc32_slice8_pmt", 180, tsCrc32Slice8);
+    benchCrc("crc32_pmt", 180, tsCrc32);
+
+    // keeps the kernel results alive
+    printf("\n],\"checksum\":%llu}\n", static_cast<unsigned long long>(sink_));
+}
+
+// Runs the body (ops operations over bytes bytes) often enough to last the
+// minimum time and reports the averages per operation
+template <typename Body>
+void TsKernelBench::measure(const char* name, int64_t ops, int64_t bytes, Body body)
+{
+    if (!filter_.empty() && std::string(name).find(filter_) == std::string::npos)
+        return;
+
+    // calibrate
+    auto start = std::chrono::steady_clock::now();
+    body();
+    double once = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int64_t runs = once > 0 ? static_cast<int64_t>(minSeconds_ / once) + 1 : 1000;
+
+    TsPerfCounters counters;
+    start = std::chrono::steady_clock::now();
+    counters.start();
+    for (int64_t i = 0; i < runs; i++)
+        body();
+    counters.stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double totalOps = static_cast<double>(ops) * runs;
+    double totalBytes = static_cast<double>(bytes) * runs;
+
+    printf("%s\n{\"name\":\"%s\",\"runs\":%lld,\"ops\":%.0f,\"bytes\":%.0f,\"ns_per_op\":%.3f",
+        first_ ? "" : ",", name, static_cast<long long>(runs), totalOps, totalBytes, seconds * 1e9 / totalOps);
+    first_ = false;
+
+    uint64_t cycles;
+    if (counters.value(TS_PERF_CYCLES, cycles) && cycles > 0)
+    {
+        printf(",\"cycles_per_op\":%.3f", cycles / totalOps);
+        if (bytes > 0)
+            printf(",\"bytes_per_cycle\":%.4f", totalBytes / cycles);
+        else
+            printf(",\"bytes_per_cycle\":null");
+    }
+    else
+        printf(",\"cycles_per_op\":null,\"bytes_per_cycle\":null");
+
+    const struct
+    {
+        TS_PERF_COUNTER counter;
+        const char*     name;
+    } others[] = {
+        { TS_PERF_INSTRUCTIONS, "instructions_per_op" },
+        { TS_PERF_BRANCH_MISSES, "branch_misses_per_op" },
+        { TS_PERF_CACHE_MISSES, "cache_misses_per_op" }
+    };
+    for (auto& other : others)
+    {
+        uint64_t value;
+        if (counters.value(other.counter, value))
+            printf(",\"%s\":%.3f", other.name, value / totalOps);
+        else
+            printf(",\"%s\":null", other.name);
+    }
+    printf("}");
+    fflush(stdout);
+}
+
+std::vector<uint8_t> TsKernelBench::elementaryStream(TS_GEN_CODEC codec, int32_t frames)
+{
+    auto options = TsGenerator::defaultOptions();
+    options.codecs.assign(1, codec);
+    options.pidCount = 1;
+    TsGenerator generator(options);
+
+    std::vector<uint8_t> es;
+    generator.buildElementaryStream(codec, frames, es);
+    return es;
+}
+
+std::vector<uint8_t> TsKernelBench::transportStream(const TS_GEN_OPTIONS& options)
+{
+    std::vector<uint8_t> ts;
+    FILE* file = tmpfile();
+    if (file == nullptr)
+        return ts;
+
+    TsGenerator generator(options);
+    if (generator.write(file))
+    {
+        ts.resize(static_cast<size_t>(ftell(file)));
+        rewind(file);
+        ts.resize(fread(ts.data(), 1, ts.size(), file));
+    }
+    fclose(file);
+    return ts;
+}
+
+void TsKernelBench::feed(AVContext& context, const uint8_t* packet)
+{
+    memcpy(context.avBuf_, packet, TS_PACKET_SIZE);
+}
+
+// widths 1..24 bits in turn
+void TsKernelBench::benchReadBits()
+{
+    std::vector<uint8_t> buf(65536);
+    for (size_t i = 0; i < buf.size(); i++)
+        buf[i] = static_cast<uint8_t>(i * 167 + (i >> 8));
+
+    int64_t ops = 0;
+    {
+        BitStream bs(buf.data(), static_cast<int32_t>(buf.size() * 8));
+        for (int32_t w = 1; bs.remainingBits() >= 32; w = w % 24 + 1, ops++)
+            bs.skipBits(w);
+    }
+
+    measure("bitstream_read_bits", ops, static_cast<int64_t>(buf.size()), [&]()
+    {
+        BitStream bs(buf.data(), static_cast<int32_t>(buf.size() * 8));
+        uint32_t acc = 0;
+        for (int32_t w = 1; bs.remainingBits() >= 32; w = w % 24 + 1)
+            acc += bs.readBits(w);
+        sink_ += acc;
+    });
+}
+
+void TsKernelBench::benchGolombUE()
+{
+    std::vector<uint8_t> buf;
+    BitWriter bw(buf);
+    int64_t ops = 16384;
+    for (int64_t i = 0; i < ops; i++)
+        bw.putGolombUE(static_cast<uint32_t>((i * 2654435761u) >> (20 + i % 12)));
+    bw.finish();
+    buf.resize(buf.size() + 8, 0xff);
+
+    measure("bitstream_read_golomb_ue", ops, static_cast<int64_t>(buf.size()), [&]()
+    {
+        BitStream bs(buf.data(), static_cast<int32_t>(buf.size() * 8));
+        uint32_t acc = 0;
+        for (int64_t i = 0; i < ops; i++)
+            acc += bs.readGolombUE();
+        sink_ += acc;
+    });
+}
+
+void TsKernelBench::benchSliceHeader()
+{
+    auto es = elementaryStream(TS_GEN_CODEC_H264, 50);
+    es.resize(es.size() + 256, 0x80);
+
+    h264 parser(0x100);
+    std::vector<int32_t> slices;
+    for (size_t i = 3; i + 256 < es.size(); i++)
+    {
+        if (es[i - 3] != 0 || es[i - 2] != 0 || es[i - 1] != 1)
+            continue;
+        switch (es[i] & 0x1f)
+        {
+        case 7:
+            parser.parse_SPS(&es[i + 1], 256);
+            break;
+        case 8:
+            parser.parse_PPS(&es[i + 1], 64);
+            break;
+        case 1:
+        case 5:
+            slices.push_back(static_cast<int32_t>(i));
+            break;
+        }
+    }
+
+    measure("h264_parse_slh", static_cast<int64_t>(slices.size()), static_cast<int64_t>(slices.size()) * 32, [&]()
+    {
+        for (auto pos : slices)
+        {
+            h264::h264_private::VCL_NAL vcl;
+            memset(&vcl, 0, sizeof(vcl));
+            vcl.nalRefIdc = es[pos] & 0x60;
+            vcl.nalUnitType = es[pos] & 0x1f;
+            sink_ += parser.parse_SLH(&es[pos + 1], 32, vcl) ? vcl.frameNum : 0;
+        }
+    });
+}
+
+void TsKernelBench::benchSps()
+{
+    auto es = elementaryStream(TS_GEN_CODEC_H264, 1);
+    es.resize(es.size() + 256, 0x80);
+
+    int32_t sps = -1, spsLen = 0;
+    for (size_t i = 3; i < es.size(); i++)
+    {
+        if (es[i - 3] == 0 && es[i - 2] == 0 && es[i - 1] == 1)
+        {
+            if (sps >= 0)
+            {
+                spsLen = static_cast<int32_t>(i - 3) - sps;
+                break;
+            }
+            if ((es[i] & 0x1f) == 7)
+                sps = static_cast<int32_t>(i + 1);
+        }
+    }
+    if (sps < 0)
+        return;
+
+    h264 parser(0x100);
+    const int64_t ops = 1024;
+    measure("h264_parse_sps", ops, ops * spsLen, [&]()
+    {
+        for (int64_t i = 0; i < ops; i++)
+            sink_ += parser.parse_SPS(&es[sps], 256) ? parser.width_ : 0;
+    });
+}
+
+// start code scan through TsStream::append() and parse(), TS sized chunks
+void TsKernelBench::benchMpeg2Parse()
+{
+    auto es = elementaryStream(TS_GEN_CODEC_MPEG2, 100);
+    MPEG2Video parser(0x100);
+
+    int64_t frames = 0;
+    auto body = [&]()
+    {
+        parser.reset();
+        STREAM_PKG pkg;
+        for (size_t pos = 0; pos < es.size(); pos += TS_PACKET_SIZE - 4)
+        {
+            auto len = std::min<size_t>(TS_PACKET_SIZE - 4, es.size() - pos);
+            parser.append(&es[pos], static_cast<int32_t>(len), false);
+            while (parser.getStreamPackage(&pkg))
+                frames++;
+        }
+    };
+    body();
+    auto ops = frames;
+
+    measure("mpeg2video_parse", ops > 0 ? ops : 1, static_cast<int64_t>(es.size()), body);
+    sink_ += frames;
+}
+
+void TsKernelBench::benchAacHeaders(TS_GEN_CODEC codec, const char* name)
+{
+    const int32_t count = 1024;
+    auto es = elementaryStream(codec, count);
+    int32_t frameSize = static_cast<int32_t>(es.size() / count);
+    AAC parser(0x100);
+    parser.streamType_ = STREAM_TYPE_AUDIO_AAC;
+
+    measure(name, count, static_cast<int64_t>(es.size()), [&]()
+    {
+        for (int32_t i = 0; i < count; i++)
+        {
+            parser.esFoundFrame_ = false;
+            parser.findHeaders(&es[i * frameSize], static_cast<int32_t>(es.size()) - i * frameSize);
+        }
+        sink_ += parser.frameSize_;
+    });
+}
+
+void TsKernelBench::benchAc3Headers()
+{
+    const int32_t count = 1024;
+    auto es = elementaryStream(TS_GEN_CODEC_AC3, count);
+    int32_t frameSize = static_cast<int32_t>(es.size() / count);
+    AC3 parser(0x100);
+
+    measure("ac3_find_headers", count, static_cast<int64_t>(es.size()), [&]()
+    {
+        for (int32_t i = 0; i < count; i++)
+        {
+            parser.esFoundFrame_ = false;
+            parser.findHeaders(&es[i * frameSize], static_cast<int32_t>(es.size()) - i * frameSize);
+        }
+        sink_ += parser.frameSize_;
+    });
+}
+
+// PMT of 128 streams spanning several packets, a new version every time
+void TsKernelBench::benchPsi()
+{
+    auto options = TsGenerator::defaultOptions();
+    options.pidCount = 128;
+    options.pmtVersionInterval = 1;
+    options.totalBytes = 4 * 1024 * 1024;
+    auto ts = transportStream(options);
+
+    const uint8_t* pat = nullptr;
+    std::vector<const uint8_t*> pmt;
+    int32_t sections = 0;
+    for (size_t pos = 0; pos + TS_PACKET_SIZE <= ts.size(); pos += TS_PACKET_SIZE)
+    {
+        const uint8_t* p = &ts[pos];
+        uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+        bool unitStart = (p[1] & 0x40) != 0;
+        if (pid == 0 && pat == nullptr)
+            pat = p;
+        else if (pid == 0x1000 && pat != nullptr)
+        {
+            // whole sections only, versions 0 to 15
+            if (unitStart && ++sections > 16)
+                break;
+            pmt.push_back(p);
+        }
+    }
+    if (pat == nullptr || sections == 0)
+        return;
+
+    TsFileInput input("");
+    AVContext context(input, 0, 0);
+    feed(context, pat);
+    context.processTSPackage();
+    context.processTSPayload();
+
+    measure("context_parse_psi_large_pmt", std::min(sections, 16), static_cast<int64_t>(pmt.size()) * TS_PACKET_SIZE, [&]()
+    {
+        for (auto p : pmt)
+        {
+            feed(context, p);
+            context.processTSPackage();
+            sink_ += context.parseTsPsi();
+        }
+    });
+}
+
+// PES header decode of unit start packets; streaming is off so no payload is
+// appended. Includes the TS header parse of processTSPackage().
+void TsKernelBench::benchPes()
+{
+    auto options = TsGenerator::defaultOptions();
+    options.totalBytes = 8 * 1024 * 1024;
+    auto ts = transportStream(options);
+
+    TsFileInput input("");
+    AVContext context(input, 0, 0);
+    std::vector<const uint8_t*> pes;
+    bool pmtDone = false;
+    for (size_t pos = 0; pos + TS_PACKET_SIZE <= ts.size() && pes.size() < 4096; pos += TS_PACKET_SIZE)
+    {
+        const uint8_t* p = &ts[pos];
+        uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+        bool unitStart = (p[1] & 0x40) != 0;
+        if (!pmtDone && (pid == 0 || pid == 0x1000))
+        {
+            feed(context, p);
+            context.processTSPackage();
+            if (context.processTSPayload() == AVCONTEXT_PROGRAM_CHANGE)
+                pmtDone = true;
+        }
+        else if (pmtDone && unitStart && pid >= 0x100 && pid < 0x1000)
+            pes.push_back(p);
+    }
+    if (pes.empty())
+        return;
+
+    measure("context_parse_pes_header", static_cast<int64_t>(pes.size()), static_cast<int64_t>(pes.size()) * TS_PACKET_SIZE, [&]()
+    {
+        for (auto p : pes)
+        {
+            feed(context, p);
+            context.processTSPackage();
+            sink_ += context.parseTsPes();
+        }
+    });
+}
+
+void TsKernelBench::benchRescale()
+{
+    TsStream stream(0x100);
+    const int64_t ops = 65536;
+    measure("stream_rescale", ops, 0, [&]()
+    {
+        int64_t acc = 0;
+        for (int64_t i = 0; i < ops; i++)
+            acc += stream.rescale(i * 3003 + 1, RESCALE_TIME_BASE, PTS_TIME_BASE);
+        sink_ += static_cast<uint64_t>(acc);
+    });
+}
+
+// PSI section sized blocks, one op per section
+void TsKernelBench::benchCrc(const char* name, size_t len, uint32_t (*crc)(const uint8_t*, size_t, uint32_t))
+{
+    std::vector<uint8_t> buf(65536);
+    for (size_t i = 0; i < buf.size(); i++)
+        buf[i] = static_cast<uint8_t>(i * 131 + (i >> 9));
+
+    int64_t ops = static_cast<int64_t>(buf.size() / len);
+    measure(name, ops, ops * static_cast<int64_t>(len), [&]()
+    {
+        uint32_t acc = 0;
+        for (int64_t i = 0; i < ops; i++)
+            acc ^= crc(buf.data() + i * len, len, TS_CRC32_INIT);
+        sink_ += acc;
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    double minSeconds = 0.2;
+    std::string filter;
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--min-time" && i + 1 < argc)
+            minSeconds = atof(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--min-time seconds] [--filter name]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    TsKernelBench bench(minSeconds, filter);
+    bench.run();
+    return 0;
+}
@@ -0,0 +1,330 @@
+// Packet-in to frame-out latency: a generated stream is fed to the demuxer at
+// its mux bitrate as if it was received live. For every frame the time from
+// the arrival of the last packet of its PES to the frame leaving the demuxer
+// is measured, once as is and once in low latency mode. Prints one JSON
+// document. Both runs must hand out the same elementary stream bytes; low
+// latency may add the last frame of a stream, which otherwise waits for a
+// PES that never comes.
+//
+//     tslatency [--seconds N] [--bitrate mbps] [--codecs h264,aac_adts,...]
+
+#include "tsgen.h"
+#include "tsdemuxer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define TS_PACKET_SIZE  188
+
+typedef std::chrono::steady_clock CLOCK;
+
+///////////////////////////////////////////////////////////
+// Memory source releasing its bytes packet by packet at the bitrate
+class TsPacedInput : public TsInput
+{
+public:
+    TsPacedInput(const std::vector<uint8_t>& ts, double bitrate)
+        : ts_(ts),
+        bitrate_(bitrate),
+        pos_(0)
+    {
+    }
+
+    bool open() override
+    {
+        pos_ = 0;
+        start_ = CLOCK::now();
+        setLookback(TS_INPUT_LOOKBACK);
+        return true;
+    }
+    void close() override
+    {
+        releaseBuffer();
+    }
+    int64_t size() const override
+    {
+        return -1;
+    }
+    std::string name() const override
+    {
+        return "paced";
+    }
+
+    // time the byte before the offset arrived
+    CLOCK::time_point arrival(int64_t offset) const
+    {
+        return start_ + std::chrono::duration_cast<CLOCK::duration>(std::chrono::duration<double>(offset * 8 / bitrate_));
+    }
+
+protected:
+    int64_t readData(uint8_t* data, int64_t len) override
+    {
+        auto size = static_cast<int64_t>(ts_.size());
+        if (pos_ >= size)
+            return 0;
+
+        // at least the next packet, then all that arrived meanwhile
+        auto next = std::min<int64_t>(pos_ + TS_PACKET_SIZE, size);
+        std::this_thread::sleep_until(arrival(next));
+        auto elapsed = std::chrono::duration<double>(CLOCK::now() - start_).count();
+        auto arrived = static_cast<int64_t>(elapsed * bitrate_ / 8) / TS_PACKET_SIZE * TS_PACKET_SIZE;
+        arrived = std::min(size, std::max(arrived, next));
+
+        auto n = std::min(len, arrived - pos_);
+        memcpy(data, ts_.data() + pos_, static_cast<size_t>(n));
+        pos_ += n;
+        return n;
+    }
+    bool seekData(const int64_t&) override
+    {
+        return false;
+    }
+
+private:
+    const std::vector<uint8_t>& ts_;
+    double  bitrate_;
+    int64_t pos_;
+    CLOCK::time_point start_;
+};
+
+struct PID_LATENCY
+{
+    std::string codec;
+    int64_t frames;
+    std::vector<double> ms;
+    std::vector<uint8_t> es;        // the frames one after the other
+};
+
+struct RUN_RESULT
+{
+    int64_t  frames;
+    int64_t  bytes;
+    int64_t  unmatched;         // frames without a PES of their PTS
+    std::map<uint16_t, PID_LATENCY> pids;
+};
+
+typedef std::map<std::pair<uint16_t, int64_t>, int64_t> PES_ENDS;
+
+static std::vector<uint8_t> transportStream(const TS_GEN_OPTIONS& options)
+{
+    std::vector<uint8_t> ts;
+    FILE* file = tmpfile();
+    if (file == nullptr)
+        return ts;
+
+    TsGenerator generator(options);
+    if (generator.write(file))
+    {
+        ts.resize(static_cast<size_t>(ftell(file)) / TS_PACKET_SIZE * TS_PACKET_SIZE);
+        rewind(file);
+        if (fread(ts.data(), 1, ts.size(), file) != ts.size())
+            ts.clear();
+    }
+    fclose(file);
+    return ts;
+}
+
+static int64_t readPts(const uint8_t* p)
+{
+    return (static_cast<int64_t>(p[0] & 0x0e) << 29) | (p[1] << 22) | ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+// End offset of the last packet of every PES with a PTS, by PID and PTS
+static PES_ENDS pesEnds(const std::vector<uint8_t>& ts)
+{
+    PES_ENDS ends;
+    std::map<uint16_t, std::pair<int64_t, int64_t>> open;     // pid: pts, end
+    for (size_t pos = 0; pos + TS_PACKET_SIZE <= ts.size(); pos += TS_PACKET_SIZE)
+    {
+        const uint8_t* p = ts.data() + pos;
+        uint16_t pid = static_cast<uint16_t>(((p[1] & 0x1f) << 8) | p[2]);
+        if ((p[3] & 0x10) == 0)
+            continue;
+        int32_t n = 4 + ((p[3] & 0x20) ? p[4] + 1 : 0);
+        const uint8_t* payload = p + n;
+
+        if ((p[1] & 0x40) && n + 14 <= TS_PACKET_SIZE && memcmp(payload, "\x00\x00\x01", 3) == 0)
+        {
+            auto It = open.find(pid);
+            if (It != open.end())
+                ends[std::make_pair(pid, It->second.first)] = It->second.second;
+            if (payload[7] & 0x80)
+                open[pid] = std::make_pair(readPts(payload + 9), 0);
+            else
+                open.erase(pid);
+        }
+
+        auto It = open.find(pid);
+        if (It != open.end())
+            It->second.second = static_cast<int64_t>(pos) + TS_PACKET_SIZE;
+    }
+    for (auto& pes : open)
+        ends[std::make_pair(pes.first, pes.second.first)] = pes.second.second;
+    return ends;
+}
+
+static RUN_RESULT run(const std::vector<uint8_t>& ts, const PES_ENDS& ends, double bitrate, bool lowLatency)
+{
+    RUN_RESULT r;
+    r.frames = r.bytes = r.unmatched = 0;
+
+    TsPacedInput input(ts, bitrate);
+    input.open();
+    TsDemuxer demuxer(input);
+    demuxer.setLowLatency(lowLatency);
+
+    for (auto& batch : demuxer.frames())
+    {
+        auto now = CLOCK::now();
+        for (auto& pkg : batch)
+        {
+            r.frames++;
+            r.bytes += pkg.size;
+            auto& pid = r.pids[pkg.pid];
+            if (pid.codec.empty())
+            {
+                auto info = demuxer.getStreamInfo(pkg.pid);
+                pid.codec = info != nullptr ? info->codecName : "data";
+            }
+            pid.frames++;
+            pid.es.insert(pid.es.end(), pkg.data, pkg.data + pkg.size);
+
+            auto It = ends.find(std::make_pair(pkg.pid, pkg.pts & PTS_MASK));
+            if (It == ends.end())
+            {
+                r.unmatched++;
+                continue;
+            }
+            pid.ms.push_back(std::chrono::duration<double, std::milli>(now - input.arrival(It->second)).count());
+        }
+    }
+    return r;
+}
+
+// The elementary streams of the first run start those of the second one
+// (frame boundaries may move by the zero byte of a 4 byte start code);
+// returns the frames the second run has in addition, -1 when they differ
+static int64_t extraFrames(const RUN_RESULT& a, const RUN_RESULT& b)
+{
+    if (a.pids.size() != b.pids.size())
+        return -1;
+
+    int64_t extra = 0;
+    for (auto& pid : a.pids)
+    {
+        auto It = b.pids.find(pid.first);
+        if (It == b.pids.end())
+            return -1;
+        auto& ea = pid.second.es;
+        auto& eb = It->second.es;
+        if (ea.size() > eb.size() || !std::equal(ea.begin(), ea.end(), eb.begin()))
+            return -1;
+        extra += It->second.frames - pid.second.frames;
+    }
+    return extra;
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+    if (v.empty())
+        return 0;
+    auto k = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static void printRun(const char* mode, RUN_RESULT& r)
+{
+    printf("{\"mode\":\"%s\",\"frames\":%lld,\"bytes\":%lld,\"unmatched\":%lld,\"streams\":[",
+        mode, static_cast<long long>(r.frames), static_cast<long long>(r.bytes), static_cast<long long>(r.unmatched));
+    bool first = true;
+    for (auto& pid : r.pids)
+    {
+        auto& ms = pid.second.ms;
+        double sum = 0;
+        for (auto v : ms)
+            sum += v;
+        auto mean = ms.empty() ? 0 : sum / ms.size();
+        auto max = ms.empty() ? 0 : *std::max_element(ms.begin(), ms.end());
+        auto p50 = percentile(ms, 0.50);
+        auto p99 = percentile(ms, 0.99);
+        printf("%s{\"pid\":%u,\"codec\":\"%s\",\"frames\":%zu,\"mean_ms\":%.3f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+            first ? "" : ",", pid.first, pid.second.codec.c_str(), ms.size(), mean, p50, p99, max);
+        first = false;
+    }
+    printf("]}");
+}
+
+int main(int argc, char* argv[])
+{
+    auto generate = TsGenerator::defaultOptions();
+    double seconds = 4;
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--seconds" && hasValue)
+            seconds = std::max(0.5, atof(argv[++i]));
+        else if (arg == "--bitrate" && hasValue)
+            generate.bitrate = static_cast<int64_t>(atof(argv[++i]) * 1e6);
+        else if (arg == "--codecs" && hasValue)
+        {
+            generate.codecs.clear();
+            std::string list = argv[++i];
+            for (size_t start = 0; start <= list.size(); )
+            {
+                auto end = list.find(',', start);
+                auto name = list.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                for (int32_t c = 0; c < TS_GEN_CODEC_COUNT; c++)
+                {
+                    if (name == TsGenerator::codecName(static_cast<TS_GEN_CODEC>(c)))
+                        generate.codecs.push_back(static_cast<TS_GEN_CODEC>(c));
+                }
+                if (end == std::string::npos)
+                    break;
+                start = end + 1;
+            }
+            generate.pidCount = static_cast<int32_t>(generate.codecs.size());
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--seconds N] [--bitrate mbps] [--codecs h264,aac_adts,...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (generate.codecs.empty())
+    {
+        fprintf(stderr, "no known codec\n");
+        return 2;
+    }
+
+    generate.totalBytes = static_cast<int64_t>(seconds * generate.bitrate / 8);
+    auto ts = transportStream(generate);
+    if (ts.empty())
+    {
+        fprintf(stderr, "cannot generate the stream\n");
+        return 1;
+    }
+    auto ends = pesEnds(ts);
+
+    auto normal = run(ts, ends, static_cast<double>(generate.bitrate), false);
+    auto low = run(ts, ends, static_cast<double>(generate.bitrate), true);
+
+    auto extra = extraFrames(normal, low);
+    printf("{\"benchmark\":\"tssplit_latency\",\"bitrate_mbps\":%.1f,\"seconds\":%.1f,\"identical\":%s,"
+        "\"extra_frames\":%lld,\"runs\":[", generate.bitrate / 1e6, seconds, extra >= 0 ? "true" : "false",
+        static_cast<long long>(extra));
+    printRun("normal", normal);
+    printf(",");
+    printRun("low_latency", low);
+    printf("]}\n");
+    return extra >= 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include "tsperf.h"
+
+#include <cstring>
+
+#if defined (__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#define TS_HAVE_TSC
+#endif
+
+#if defined (__linux__)
+static int openCounter(uint32_t type, uint64_t config, int groupFd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = (groupFd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+
+////////////////////////////////////////////////////////////////////
+TsPerfCounters::TsPerfCounters()
+    : tscStart_(0)
+{
+    for (int32_t i = 0; i < TS_PERF_COUNT; i++)
+    {
+        fd_[i] = -1;
+        values_[i] = 0;
+        valid_[i] = false;
+    }
+
+#if defined (__linux__)
+    const uint64_t configs[TS_PERF_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+
+    // the cycles counter leads the group, the others are scheduled with it
+    fd_[TS_PERF_CYCLES] = openCounter(PERF_TYPE_HARDWARE, configs[TS_PERF_CYCLES], -1);
+    if (fd_[TS_PERF_CYCLES] < 0)
+        return;
+    for (int32_t i = 1; i < TS_PERF_COUNT; i++)
+        fd_[i] = openCounter(PERF_TYPE_HARDWARE, configs[i], fd_[TS_PERF_CYCLES]);
+#endif
+}
+
+TsPerfCounters::~TsPerfCounters()
+{
+#if defined (__linux__)
+    for (int32_t i = 0; i < TS_PERF_COUNT; i++)
+        if (fd_[i] >= 0)
+            close(fd_[i]);
+#endif
+}
+
+void TsPerfCounters::start()
+{
+#if defined (__linux__)
+    if (fd_[TS_PERF_CYCLES] >= 0)
+    {
+        ioctl(fd_[TS_PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd_[TS_PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return;
+    }
+#endif
+#if defined (TS_HAVE_TSC)
+    tscStart_ = __rdtsc();
+#endif
+}
+
+void TsPerfCounters::stop()
+{
+#if defined (__linux__)
+    if (fd_[TS_PERF_CYCLES] >= 0)
+    {
+        ioctl(fd_[TS_PERF_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        for (int32_t i = 0; i < TS_PERF_COUNT; i++)
+        {
+            valid_[i] = fd_[i] >= 0 &&
+                read(fd_[i], &values_[i], sizeof(values_[i])) == static_cast<ssize_t>(sizeof(values_[i]));
+        }
+        return;
+    }
+#endif
+#if defined (TS_HAVE_TSC)
+    values_[TS_PERF_CYCLES] = __rdtsc() - tscStart_;
+    valid_[TS_PERF_CYCLES] = true;
+#endif
+}
+
+bool TsPerfCounters::value(TS_PERF_COUNTER counter, uint64_t& value) const
+{
+    value = values_[counter];
+    return valid_[counter];
+}
+
+const char* TsPerfCounters::cycleSource() const
+{
+    if (fd_[TS_PERF_CYCLES] >= 0)
+        return "perf";
+#if defined (TS_HAVE_TSC)
+    return "tsc";
+#else
+    return "none";
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef TSPERF_H
+#define TSPERF_H
+
+#include <cstdint>
+
+enum TS_PERF_COUNTER
+{
+    TS_PERF_CYCLES = 0,
+    TS_PERF_INSTRUCTIONS,
+    TS_PERF_BRANCH_MISSES,
+    TS_PERF_CACHE_MISSES,
+    TS_PERF_COUNT
+};
+
+///////////////////////////////////////////////////////////
+// Hardware counters of the calling thread through perf_event_open (Linux).
+// Without them the cycles come from the time stamp counter where there is
+// one, the other counters are reported unavailable.
+class TsPerfCounters
+{
+public:
+    TsPerfCounters();
+    ~TsPerfCounters();
+
+    void start();
+    void stop();
+
+    // false when the counter could not be read
+    bool value(TS_PERF_COUNTER counter, uint64_t& value) const;
+    // "perf", "tsc" or "none"
+    const char* cycleSource() const;
+
+private:
+    TsPerfCounters(const TsPerfCounters&);
+    TsPerfCounters& operator=(const TsPerfCounters&);
+
+    int      fd_[TS_PERF_COUNT];
+    uint64_t values_[TS_PERF_COUNT];
+    bool     valid_[TS_PERF_COUNT];
+    uint64_t tscStart_;
+};
+
+#endif // TSPERF_H
@@ -0,0 +1,260 @@
+// Live ingest benchmark over loopback: a sender thread streams a generated
+// transport stream as datagrams of 7 packets to a (multicast) address, the
+// receiver runs TsUdpInput -> TsDemuxer. With --rtp the datagrams carry RTP
+// headers and every Nth one can be swapped with its successor, duplicated
+// or dropped. Prints one JSON document.
+//
+//     tsudpbench [--size-mb N] [--address group] [--port N] [--rate mbps]
+//                [--rcvbuf bytes] [--busy-poll us] [--batch N]
+//                [--rtp] [--window N] [--reorder N] [--duplicate N] [--loss N]
+
+#include "tsgen.h"
+#include "tsudpinput.h"
+#include "tsdemuxer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TS_PACKET_SIZE          188
+#define PACKETS_PER_DATAGRAM    7
+#define RTP_HEADER_SIZE         12
+#define RTP_PAYLOAD_MP2T        33
+
+struct SEND_OPTIONS
+{
+    double  rate;               // bit/s, 0: as fast as the socket takes it
+    int32_t reorder;            // every Nth datagram swapped with the next, 0: none
+    int32_t duplicate;          // every Nth datagram sent twice
+    int32_t loss;               // every Nth datagram not sent
+};
+
+struct SEND_RESULT
+{
+    int64_t datagrams;
+    int64_t bytes;
+    int     error;
+};
+
+static std::vector<uint8_t> transportStream(const TS_GEN_OPTIONS& options)
+{
+    std::vector<uint8_t> ts;
+    FILE* file = tmpfile();
+    if (file == nullptr)
+        return ts;
+
+    TsGenerator generator(options);
+    if (generator.write(file))
+    {
+        ts.resize(static_cast<size_t>(ftell(file)));
+        rewind(file);
+        if (fread(ts.data(), 1, ts.size(), file) != ts.size())
+            ts.clear();
+    }
+    fclose(file);
+    return ts;
+}
+
+// Datagram indices in sending order after the impairments
+static std::vector<int64_t> sendOrder(int64_t count, const SEND_OPTIONS& send)
+{
+    std::vector<int64_t> order;
+    for (int64_t i = 0; i < count; i++)
+    {
+        if (send.loss > 0 && i % send.loss == send.loss - 1)
+            continue;
+        order.push_back(i);
+        if (send.duplicate > 0 && i % send.duplicate == send.duplicate - 1)
+            order.push_back(i);
+    }
+    if (send.reorder > 0)
+    {
+        for (size_t i = 0; i + 1 < order.size(); i += static_cast<size_t>(send.reorder))
+            std::swap(order[i], order[i + 1]);
+    }
+    return order;
+}
+
+static void sendStream(const std::vector<uint8_t>& ts, const TS_UDP_OPTIONS& options, const SEND_OPTIONS& send, SEND_RESULT& r)
+{
+    r.datagrams = r.bytes = 0;
+    r.error = 0;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        r.error = errno;
+        return;
+    }
+
+    // multicast stays on the loopback interface
+    in_addr loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    unsigned char on = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on));
+
+    sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.address.empty() ? "127.0.0.1" : options.address.c_str(), &to.sin_addr);
+
+    const size_t payload = TS_PACKET_SIZE * PACKETS_PER_DATAGRAM;
+    const size_t header = options.rtp ? RTP_HEADER_SIZE : 0;
+    auto order = sendOrder(static_cast<int64_t>(ts.size() / payload), send);
+    uint8_t datagram[RTP_HEADER_SIZE + TS_PACKET_SIZE * PACKETS_PER_DATAGRAM];
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (send.rate > 0)
+        {
+            auto due = start + std::chrono::duration<double>(r.bytes * 8 / send.rate);
+            std::this_thread::sleep_until(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(due));
+        }
+
+        auto index = order[i];
+        if (options.rtp)
+        {
+            // 90 kHz timestamp of the datagram at 20 Mbit/s, fixed SSRC
+            uint32_t timestamp = static_cast<uint32_t>(index * payload * 8 * 90000 / 20000000);
+            datagram[0] = 0x80;
+            datagram[1] = RTP_PAYLOAD_MP2T;
+            datagram[2] = static_cast<uint8_t>(index >> 8);
+            datagram[3] = static_cast<uint8_t>(index);
+            datagram[4] = static_cast<uint8_t>(timestamp >> 24);
+            datagram[5] = static_cast<uint8_t>(timestamp >> 16);
+            datagram[6] = static_cast<uint8_t>(timestamp >> 8);
+            datagram[7] = static_cast<uint8_t>(timestamp);
+            memcpy(datagram + 8, "TSSP", 4);
+        }
+        memcpy(datagram + header, ts.data() + static_cast<size_t>(index) * payload, payload);
+
+        if (sendto(fd, datagram, header + payload, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to)) < 0)
+        {
+            // the unpaced sender outruns the receiver on ENOBUFS
+            if (errno == ENOBUFS || errno == EAGAIN)
+            {
+                i--;
+                std::this_thread::yield();
+                continue;
+            }
+            r.error = errno;
+            break;
+        }
+        r.datagrams++;
+        r.bytes += static_cast<int64_t>(header + payload);
+    }
+    close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    auto generate = TsGenerator::defaultOptions();
+    generate.totalBytes = 64LL * 1024 * 1024;
+
+    auto options = TsUdpInput::defaultOptions();
+    options.address = "239.255.42.42";
+    options.port = 5500;
+    options.interfaceAddress = "127.0.0.1";
+    options.idleTimeoutMs = 500;
+    SEND_OPTIONS send = { 0, 0, 0, 0 };
+
+    for (int32_t i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--size-mb" && hasValue)
+            generate.totalBytes = atoll(argv[++i]) * 1024 * 1024;
+        else if (arg == "--address" && hasValue)
+            options.address = argv[++i];
+        else if (arg == "--port" && hasValue)
+            options.port = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (arg == "--rate" && hasValue)
+            send.rate = atof(argv[++i]) * 1e6;
+        else if (arg == "--rcvbuf" && hasValue)
+            options.receiveBuffer = atoi(argv[++i]);
+        else if (arg == "--busy-poll" && hasValue)
+            options.busyPollUs = atoi(argv[++i]);
+        else if (arg == "--batch" && hasValue)
+            options.batch = std::max(1, atoi(argv[++i]));
+        else if (arg == "--rtp")
+            options.rtp = true;
+        else if (arg == "--window" && hasValue)
+            options.reorderWindow = atoi(argv[++i]);
+        else if (arg == "--reorder" && hasValue)
+            send.reorder = atoi(argv[++i]);
+        else if (arg == "--duplicate" && hasValue)
+            send.duplicate = atoi(argv[++i]);
+        else if (arg == "--loss" && hasValue)
+            send.loss = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--size-mb N] [--address group] [--port N] [--rate mbps] "
+                "[--rcvbuf bytes] [--busy-poll us] [--batch N] [--rtp] [--window N] [--reorder N] [--duplicate N] "
+                "[--loss N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // not multicast: unicast to the address
+    in_addr address;
+    if (inet_pton(AF_INET, options.address.c_str(), &address) == 1 && !IN_MULTICAST(ntohl(address.s_addr)))
+        options.interfaceAddress.clear();
+
+    auto ts = transportStream(generate);
+    if (ts.empty())
+    {
+        fprintf(stderr, "cannot generate the stream\n");
+        return 1;
+    }
+
+    TsUdpInput input(options);
+    if (!input.open())
+    {
+        fprintf(stderr, "udp://%s:%u: %s\n", options.address.c_str(), options.port, input.errorString().c_str());
+        return 1;
+    }
+
+    TsDemuxer demuxer(input);
+    SEND_RESULT sent;
+    std::thread sender(sendStream, std::cref(ts), std::cref(options), std::cref(send), std::ref(sent));
+
+    int64_t frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto& batch : demuxer.frames())
+        frames += static_cast<int64_t>(batch.size());
+    // the idle timeout ended the stream
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() -
+        options.idleTimeoutMs / 1000.0;
+    sender.join();
+
+    if (sent.error != 0)
+        fprintf(stderr, "send: %s\n", strerror(sent.error));
+
+    seconds = std::max(seconds, 1e-9);
+    printf("{\"benchmark\":\"tssplit_udp\",\"address\":\"%s\",\"port\":%u,\"batch\":%d,\"rcvbuf\":%d,"
+        "\"busy_poll_us\":%d,\"rate_mbps\":%.1f,\"rtp\":%s,\"sent\":%lld,\"received\":%llu,\"drops\":%llu,"
+        "\"lost\":%llu,\"duplicates\":%llu,\"late\":%llu,\"rejected\":%llu,"
+        "\"bytes\":%lld,\"frames\":%lld,\"seconds\":%.6f,\"mb_s\":%.2f,\"datagrams_s\":%.0f}\n",
+        options.address.c_str(), options.port, options.batch, input.receiveBufferSize(), options.busyPollUs,
+        send.rate / 1e6, options.rtp ? "true" : "false", static_cast<long long>(sent.datagrams),
+        static_cast<unsigned long long>(input.datagrams()), static_cast<unsigned long long>(input.drops()),
+        static_cast<unsigned long long>(input.lost()), static_cast<unsigned long long>(input.duplicates()),
+        static_cast<unsigned long long>(input.late()), static_cast<unsigned long long>(input.rejected()),
+        static_cast<long long>(demuxer.getPosition()),
+        static_cast<long long>(frames), seconds, demuxer.getPosition() / seconds / (1024 * 1024),
+        input.datagrams() / seconds);
+    return sent.error != 0 || input.datagrams() == 0 ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = tsudpbench
+CONFIG -= qt app_bundle
+CONFIG += c++17 console
+
+include(../tscore.pri)
+
+HEADERS += ./tsgen.h \
+    ./tsbitwriter.h
+
+SOURCES += ./tsudpbench.cpp \
+    ./tsgen.cpp
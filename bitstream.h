@@ -2,7 +2,7 @@
 #ifndef BITSTREAM_H
 #define BITSTREAM_H
 
-#include <QString>
+#include <cstdint>
 
 class BitStream
 {
@@ -0,0 +1,184 @@
+#include "tsbatch.h"
+#include "tstrace.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+
+#include <cstdio>
+
+static bool parsePids(const QString& list, QSet<uint16_t>& pids)
+{
+    for (const auto& item : list.split(','))
+    {
+        if (item.trimmed().isEmpty())
+            continue;
+
+        bool ok = false;
+        auto pid = item.trimmed().toUInt(&ok, 0);
+        if (!ok || pid > 0x1fff)
+            return false;
+        pids.insert(static_cast<uint16_t>(pid));
+    }
+    return true;
+}
+
+// "19" for all streams or codec=level pairs, e.g. "teletext=19,dvbsub=19,lpcm=5"
+static bool parseLevels(const QString& list, std::map<STREAM_TYPE, int32_t>& levels)
+{
+    for (const auto& item : list.split(','))
+    {
+        if (item.trimmed().isEmpty())
+            continue;
+
+        bool ok = false;
+        auto codec = item.section('=', 0, 0).trimmed();
+        auto level = item.section('=', -1).trimmed().toInt(&ok);
+        if (!ok)
+            return false;
+        if (!item.contains('='))
+        {
+            levels[STREAM_TYPE_UNKNOWN] = level;
+            continue;
+        }
+
+        auto found = false;
+        for (int32_t type = STREAM_TYPE_UNKNOWN + 1; type <= STREAM_TYPE_PRIVATE_DATA; type++)
+        {
+            auto streamType = static_cast<STREAM_TYPE>(type);
+            if (codec == QLatin1String(TsStream::getStreamCodecName(streamType)))
+            {
+                levels[streamType] = level;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCoreApplication::setOrganizationDomain("");
+    QCoreApplication::setOrganizationName("mpegts");
+    QCoreApplication::setApplicationName("tssplitter-cli");
+    QCoreApplication::setApplicationVersion("2.0.0");
+
+    QCommandLineParser cmd;
+    cmd.setApplicationDescription("Split MPEG transport streams into elementary streams.\n"
+        "Prints one line of JSON statistics per input file.");
+    cmd.addHelpOption();
+    cmd.addVersionOption();
+    cmd.addPositionalArgument("files", "Transport stream files (also .gz, .zst), named pipes or - for stdin.", "files...");
+
+    QCommandLineOption outputOption(QStringList() << "o" << "output-dir",
+        "Write elementary streams to <dir> instead of next to the source.", "dir");
+    QCommandLineOption programOption(QStringList() << "p" << "program",
+        "Demux program <number> only.", "number");
+    QCommandLineOption pidOption("pid",
+        "Write only the PIDs of the comma separated <list>.", "list");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+        "Number of parallel jobs (default: number of cores).", "n");
+    QCommandLineOption deviceJobsOption("device-jobs",
+        "Parallel jobs per storage device (default: 1 for disks).", "n");
+    QCommandLineOption verboseOption("verbose",
+        "Print parser messages to stderr.");
+    QCommandLineOption statsOption("stats",
+        "Collect per stage counters and timers.");
+    QCommandLineOption memoryOption("memory-budget",
+        "Memory in MB all parallel jobs may use before new jobs wait and readers\n"
+        "are throttled (default: 1024, 0: unlimited).", "mb", "1024");
+    QCommandLineOption followOption("follow",
+        "Follow files that are still being recorded: wait at their end until the\n"
+        "writer closes them or no data arrived for <seconds> (0: wait for the close).", "seconds");
+    QCommandLineOption lowLatencyOption("low-latency",
+        "Write frames as soon as their PES is complete instead of on the next PES.");
+    QCommandLineOption concatOption("concat",
+        "Split the files as one stream, in the given order. A single file is joined\n"
+        "with its numbered parts (name.001.ts, name.002.ts, ...).");
+    QCommandLineOption zstdOption("zstd",
+        "Write zstd compressed outputs (.zst) at the level for all streams or per\n"
+        "codec, e.g. 19 or teletext=19,dvbsub=19,lpcm=5 (0: raw).", "levels");
+    QCommandLineOption remuxOption("spts",
+        "Also write every program as a single program transport stream\n"
+        "(<name>_program_<number>.ts) without null packets.");
+    QCommandLineOption mp4Option("mp4",
+        "Write the H.264 and AAC streams of every program as fragmented MP4\n"
+        "(<name>_program_<number>.mp4) instead of elementary streams.");
+    QCommandLineOption traceOption("trace",
+        "Write a Chrome trace (Perfetto) timeline of the run to <file>.", "file");
+
+    cmd.addOption(outputOption);
+    cmd.addOption(programOption);
+    cmd.addOption(pidOption);
+    cmd.addOption(jobsOption);
+    cmd.addOption(deviceJobsOption);
+    cmd.addOption(verboseOption);
+    cmd.addOption(statsOption);
+    cmd.addOption(memoryOption);
+    cmd.addOption(followOption);
+    cmd.addOption(lowLatencyOption);
+    cmd.addOption(concatOption);
+    cmd.addOption(zstdOption);
+    cmd.addOption(remuxOption);
+    cmd.addOption(mp4Option);
+    cmd.addOption(traceOption);
+    cmd.process(app);
+
+    const auto files = cmd.positionalArguments();
+    if (files.isEmpty())
+        cmd.showHelp(1);
+
+    TS_BATCH_OPTIONS options;
+    options.outputDir = cmd.value(outputOption);
+    options.program = static_cast<uint16_t>(cmd.value(programOption).toUInt(nullptr, 0));
+    options.jobs = cmd.value(jobsOption).toInt();
+    options.deviceJobs = cmd.value(deviceJobsOption).toInt();
+    options.verbose = cmd.isSet(verboseOption);
+    options.stats = cmd.isSet(statsOption);
+    options.memoryBudget = cmd.value(memoryOption).toLongLong() * 1024 * 1024;
+    options.followTimeoutMs = cmd.isSet(followOption) ? qMax(0, cmd.value(followOption).toInt()) * 1000 : -1;
+    options.lowLatency = cmd.isSet(lowLatencyOption);
+    options.concat = cmd.isSet(concatOption);
+    options.remux = cmd.isSet(remuxOption);
+    options.mp4 = cmd.isSet(mp4Option);
+    TsStats::setEnabled(options.stats);
+
+    if (cmd.isSet(pidOption) && !parsePids(cmd.value(pidOption), options.pids))
+    {
+        fprintf(stderr, "Invalid PID list: %s\n", cmd.value(pidOption).toLocal8Bit().constData());
+        return 2;
+    }
+    if (cmd.isSet(zstdOption) && !parseLevels(cmd.value(zstdOption), options.compression))
+    {
+        fprintf(stderr, "Invalid zstd levels: %s\n", cmd.value(zstdOption).toLocal8Bit().constData());
+        return 2;
+    }
+
+    if (!options.outputDir.isEmpty() && !QDir().mkpath(options.outputDir))
+    {
+        fprintf(stderr, "Cannot create output directory: %s\n", options.outputDir.toLocal8Bit().constData());
+        return 2;
+    }
+
+    if (cmd.isSet(traceOption))
+    {
+        TsTrace::start();
+        TsTrace::setThreadName("main");
+    }
+
+    TsBatch batch(options);
+    auto failed = batch.run(files);
+
+    if (cmd.isSet(traceOption))
+    {
+        TsTrace::stop();
+        if (!TsTrace::writeChromeJson(QFile::encodeName(cmd.value(traceOption)).toStdString()))
+            fprintf(stderr, "Cannot write trace: %s\n", cmd.value(traceOption).toLocal8Bit().constData());
+    }
+    return failed == 0 ? 0 : 1;
+}
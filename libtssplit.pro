@@ -0,0 +1,14 @@
+TEMPLATE = lib
+TARGET = tssplit
+CONFIG -= qt
+CONFIG += c++17
+
+# qmake CONFIG+=tssplit_shared for a shared library
+tssplit_shared {
+    CONFIG += shared
+    DEFINES += TSSPLIT_SHARED TSSPLIT_BUILD
+} else {
+    CONFIG += staticlib
+}
+
+include(./tscore.pri)
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "tstrace.h"
 
 #include <QApplication>
 #include <QMessageBox>
@@ -14,11 +15,28 @@ int main(int argc, char *argv[])
     QCoreApplication::setApplicationName("mpegts");
     QCoreApplication::setApplicationVersion("2.0.0");
 
+    // TSSPLIT_TRACE=file.json records a timeline written on exit
+    const auto tracePath = qgetenv("TSSPLIT_TRACE");
+    if (!tracePath.isEmpty())
+    {
+        TsTrace::start();
+        TsTrace::setThreadName("main");
+    }
+
     try
     {
-        MainWindow m;
-        m.show();
-        return app.exec();
+        int ret;
+        {
+            MainWindow m;
+            m.show();
+            ret = app.exec();
+        }
+        if (!tracePath.isEmpty())
+        {
+            TsTrace::stop();
+            TsTrace::writeChromeJson(tracePath.toStdString());
+        }
+        return ret;
     }
     catch (const std::exception& ex)
     {
@@ -4,13 +4,19 @@
 #include <QStandardPaths>
 #include <QtWidgets>
 
+// progress poll interval (ms)
+#define PROGRESS_POLL_INTERVAL  (200)
+// memory of all running parsers unless set otherwise (MB)
+#define DEFAULT_MEMORY_BUDGET   (1024)
+
 MainWindow::MainWindow(QWidget *parent)
     : QWidget(parent)
     , m_error(new QTextEdit(this))
     , m_treeView( new QTreeView(this))
     , m_progress(new QProgressBar(this))
     , m_buttonOpenFile(new QPushButton(tr("Select file(s)"), this))
-    , m_lock(new QMutex())
+    , m_progressTimer(new QTimer(this))
+    , m_scheduler(new TsScheduler(0, this))
 {
     setWindowTitle(tr("TS Streams Extractor"));
     setWindowIcon(QPixmap(":/tssplitter_logo.svg"));
@@ -21,6 +27,9 @@ MainWindow::MainWindow(QWidget *parent)
 
     qRegisterMetaType<STREAM_INFO>("STREAM_INFO");
 
+    QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
+    TsMemoryBudget::global().setLimit(settings.value(QLatin1String("MEMORY_BUDGET_MB"), DEFAULT_MEMORY_BUDGET).toLongLong() * 1024 * 1024);
+
     // tree
     //m_treeView->setModel(new QStandardItemModel(0, 0));
     m_treeView->setRootIsDecorated(true);
@@ -39,6 +48,7 @@ MainWindow::MainWindow(QWidget *parent)
     m_progress->setFixedHeight(26);
     m_progress->setTextVisible(true);
     m_progress->setVisible(false);
+    m_progressTimer->setInterval(PROGRESS_POLL_INTERVAL);
 
     // open
     m_buttonOpenFile->setDefault(true);
@@ -65,6 +75,8 @@ MainWindow::MainWindow(QWidget *parent)
 
     // connect
     QObject::connect(m_buttonOpenFile, &QPushButton::clicked, this, &MainWindow::onOpenFiles);
+    QObject::connect(m_scheduler, &TsScheduler::jobFinished, this, &MainWindow::onJobFinished, Qt::QueuedConnection);
+    QObject::connect(m_progressTimer, &QTimer::timeout, this, &MainWindow::onProgressTimer);
 
 #if defined (Q_OS_ANDROID)
     resize(QApplication::desktop()->availableGeometry(this).size());
@@ -75,18 +87,22 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
-    QMutexLocker g(m_lock.data());
-    for (auto & item : m_parsersMap)
-        delete item.second;
-    m_parsersMap.clear();
+    // cancels running parsers and waits for the workers
+    m_scheduler->shutdown();
+    delete m_scheduler;
+    m_scheduler = nullptr;
+
+    for (auto parser : m_parsers)
+        delete parser;
+    m_parsers.clear();
 }
 
 void MainWindow::OpenFiles(const QStringList & tsFiles)
 {
-    m_treeView->setModel(new QStandardItemModel(0, 1));
+    m_treeView->setModel(new QStandardItemModel(0, 2));
 
     auto model = reinterpret_cast<QStandardItemModel*>(m_treeView->model());
-    model->setHorizontalHeaderLabels(QStringList() << QObject::tr("info"));
+    model->setHorizontalHeaderLabels(QStringList() << QObject::tr("info") << QObject::tr("progress"));
 
     auto root = model->invisibleRootItem();
 
@@ -96,16 +112,21 @@ void MainWindow::OpenFiles(const QStringList & tsFiles)
         if (path.isEmpty())
             continue;
 
-        TsParser* parser = new TsParser(path, this);
+        TsParser* parser = new TsParser(path);
         QObject::connect(parser, &TsParser::streamFound, this, &MainWindow::onStreamFound, Qt::DirectConnection);
-        QObject::connect(parser, &TsParser::notifyStart, this, &MainWindow::onNotifyStart, Qt::DirectConnection);
-        QObject::connect(parser, &TsParser::notifyDone, this, &MainWindow::onNotifyDone, Qt::QueuedConnection);
         QObject::connect(parser, &TsParser::notifyError, this, &MainWindow::onNotifyError, Qt::QueuedConnection);
 
-        root->appendRow(new QStandardItem(path));
+        root->appendRow(QList<QStandardItem*>() << new QStandardItem(path) << new QStandardItem(tr("queued")));
+
+        m_parsers.insert(parser);
+        m_scheduler->submit(parser);
+    }
 
-        if (!parser->start())
-            delete parser;
+    if (!m_parsers.isEmpty())
+    {
+        m_progress->reset();
+        m_progress->setVisible(true);
+        m_progressTimer->start();
     }
 }
 
@@ -190,43 +211,88 @@ void MainWindow::onNotifyError(const QString& info)
     m_error->append(info + "\n");
 }
 
-void MainWindow::onNotifyStart(Qt::HANDLE threadId, TsParser *parser)
+void MainWindow::onJobFinished(TsJob *job)
 {
-    QMutexLocker g(m_lock.data());
-    m_parsersMap[threadId] = parser;
+    auto parser = static_cast<TsParser*>(job);
+    if (!m_parsers.remove(parser))
+        return;
+
+    showJobProgress(parser, parser->progressInfo());
+    delete parser;
+
+    if (m_parsers.isEmpty())
+    {
+        m_progressTimer->stop();
+        m_progress->reset();
+        m_progress->setVisible(false);
+    }
 }
 
-void MainWindow::onNotifyDone(int32_t percent, Qt::HANDLE threadId)
+// Polls the running jobs: the bar shows the whole batch, the tree every job
+void MainWindow::onProgressTimer()
 {
-    // on first destroy parser when 101%
-    static int32_t lastP = percent;
+    int64_t done = 0;
+    int64_t total = 0;
+    double  rate = 0;
 
-    if (percent == 101)
+    for (auto parser : m_parsers)
     {
-        QMutexLocker g(m_lock.data());
-        auto It = m_parsersMap.find(threadId);
-        if (It != m_parsersMap.end())
+        auto info = parser->progressInfo();
+        showJobProgress(parser, info);
+
+        if (info.bytesTotal > 0)
         {
-            delete It->second;
-            m_parsersMap.erase(It);
+            done += info.bytesDone;
+            total += info.bytesTotal;
         }
+        if (info.state == TS_JOB_STATE_RUNNING)
+            rate += info.bytesPerSecond;
     }
 
-    // value when few threads is working
-    lastP = abs(m_progress->value() - percent) > 1 ? qRound(double(percent + lastP + 2) / 2) : percent;
-    if (lastP > 100)
-    {
-        m_progress->reset();
-        m_progress->setVisible(false);
-    }
-    else if (percent != 101 && !m_progress->isVisible())
-    {
-        m_progress->setVisible(true);
-    }
-    else if (lastP > m_progress->value())
+    // sizes of queued jobs are not known before they are opened
+    auto eta = rate > 0 ? static_cast<int64_t>((total - done) * 1000 / rate) : 0;
+
+    m_progress->setValue(total > 0 ? static_cast<int32_t>(done * 100 / total) : 0);
+    m_progress->setFormat(rate > 0
+        ? tr("%p% - %1 MB/s - %2 s left").arg(rate / 1e6, 0, 'f', 1).arg((eta + 999) / 1000)
+        : QString("%p%"));
+}
+
+void MainWindow::showJobProgress(TsParser* parser, const TS_JOB_PROGRESS& info)
+{
+    auto model = reinterpret_cast<QStandardItemModel*>(m_treeView->model());
+    auto items = model->findItems(parser->getSourceName(), Qt::MatchFixedString, 0);
+    if (items.size() != 1)
+        return;
+
+    QString text;
+    switch (info.state)
     {
-        m_progress->setValue(lastP);
+    case TS_JOB_STATE_QUEUED:
+        text = tr("queued");
+        break;
+    case TS_JOB_STATE_RUNNING:
+        text = info.bytesTotal > 0
+            ? tr("%1% %2 MB/s ETA %3 s").arg(info.bytesDone * 100 / info.bytesTotal)
+                .arg(info.bytesPerSecond / 1e6, 0, 'f', 1).arg((info.etaMs + 999) / 1000)
+            : tr("%1 MB %2 MB/s").arg(info.bytesDone / 1e6, 0, 'f', 1).arg(info.bytesPerSecond / 1e6, 0, 'f', 1);
+        text += tr(" mem %1 MB").arg(info.memoryBytes / 1e6, 0, 'f', 1);
+        break;
+    case TS_JOB_STATE_FINISHED:
+        text = tr("done %1 MB/s peak mem %2 MB").arg(info.bytesPerSecond / 1e6, 0, 'f', 1).arg(info.memoryPeak / 1e6, 0, 'f', 1);
+        break;
+    case TS_JOB_STATE_FAILED:
+        text = tr("failed");
+        break;
+    case TS_JOB_STATE_CANCELLED:
+        text = tr("cancelled");
+        break;
     }
+
+    auto row = items.front()->row();
+    auto item = model->item(row, 1);
+    if (item != nullptr && item->text() != text)
+        item->setText(text);
 }
 
 void MainWindow::dropEvent(QDropEvent *event)
@@ -4,13 +4,15 @@
 
 #include "tsparser.h"
 #include <QWidget>
+#include <QSet>
 
 class QPushButton;
 class QProgressBar;
 class QTreeView;
-class QMutex;
 class InfoTreeModel;
 class QTextEdit;
+class QTimer;
+class TsScheduler;
 
 class MainWindow : public QWidget
 {
@@ -24,19 +26,21 @@ private slots:
     void onOpenFiles();
     void onStreamFound(const STREAM_INFO& streamInfo, TsParser *self);
     void onNotifyError(const QString& info);
-    void onNotifyStart(Qt::HANDLE threadId, TsParser *parser);
-    void onNotifyDone(int32_t percent, Qt::HANDLE threadId);
+    void onJobFinished(TsJob *job);
+    void onProgressTimer();
 
 private:
     void OpenFiles(const QStringList & tsFiles);
+    void showJobProgress(TsParser* parser, const TS_JOB_PROGRESS& info);
 
     QTextEdit* m_error = nullptr;
     QTreeView*    m_treeView = nullptr;
     QProgressBar* m_progress = nullptr;
     QPushButton*  m_buttonOpenFile = nullptr;
+    QTimer*       m_progressTimer = nullptr;
 
-    std::map<Qt::HANDLE, TsParser*> m_parsersMap;
-    QSharedPointer<QMutex> m_lock;
+    TsScheduler* m_scheduler = nullptr;
+    QSet<TsParser*> m_parsers;
 
 
 protected:
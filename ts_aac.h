@@ -6,6 +6,8 @@
 
 class AAC : public TsStream
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 private:
     int32_t sampleRate_;
     int32_t channels_;
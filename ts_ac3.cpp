@@ -4,7 +4,7 @@
 #include <algorithm>      // for max
 
 #define AC3_HEADER_SIZE 7
-#include <QDebug>
+
 // Channel mode (audio coding mode)
 enum AC3ChannelMode
 {
@@ -5,6 +5,8 @@
 
 class AC3 : public TsStream
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 private:
     int32_t sampleRate_;
     int32_t channels_;
@@ -59,6 +59,13 @@ void h264::parse(STREAM_PKG* pkg)
     esParsed_ = p;
     startCode_ = startcode;
 
+    // low latency: the access unit ends with the buffer
+    if (!frameComplete && esUnitEnd_ && esFoundFrame_ && esLen_ - p <= 3)
+    {
+        frameComplete = true;
+        esConsumed_ = esLen_;
+    }
+
     if (frameComplete)
     {
         if (!needSPS_ && !needIFrame_)
@@ -86,6 +93,32 @@ void h264::parse(STREAM_PKG* pkg)
     }
 }
 
+// AUD, SEI, SPS, PPS or the first slice of a picture
+bool h264::isUnitStart(const uint8_t* data, int32_t len) const
+{
+    if (len > 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)
+    {
+        data++;
+        len--;
+    }
+    if (len < 5 || data[0] != 0 || data[1] != 0 || data[2] != 1)
+        return false;
+
+    switch (data[3] & 0x1f)
+    {
+    case NAL_AUD:
+    case NAL_SEI:
+    case NAL_SPS:
+    case NAL_PPS:
+        return true;
+    case 1:
+    case 5:
+        // first_mb_in_slice is ue(v) 0: a single 1 bit
+        return (data[4] & 0x80) != 0;
+    }
+    return false;
+}
+
 void h264::reset()
 {
     TsStream::reset();
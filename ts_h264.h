@@ -5,6 +5,8 @@
 
 class h264 : public TsStream
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 private:
     struct h264_private
     {
@@ -86,6 +88,7 @@ public:
 
     virtual void parse(STREAM_PKG* pkg);
     virtual void reset();
+    virtual bool isUnitStart(const uint8_t* data, int32_t len) const;
 };
 
 
@@ -65,6 +65,13 @@ void MPEG2Video::parse(STREAM_PKG* pkg)
     esParsed_ = p;
     startCode_ = startcode;
 
+    // low latency: the picture ends with the buffer
+    if (!frameComplete && esUnitEnd_ && esFoundFrame_ && esLen_ - p <= 3)
+    {
+        frameComplete = true;
+        esConsumed_ = esLen_;
+    }
+
     if (frameComplete)
     {
         if (!needSPS_ && !needIFrame_)
@@ -85,6 +92,14 @@ void MPEG2Video::parse(STREAM_PKG* pkg)
     }
 }
 
+// picture or sequence header
+bool MPEG2Video::isUnitStart(const uint8_t* data, int32_t len) const
+{
+    if (len < 4 || data[0] != 0 || data[1] != 0 || data[2] != 1)
+        return false;
+    return data[3] == 0x00 || data[3] == 0xb3;
+}
+
 void MPEG2Video::reset()
 {
     TsStream::reset();
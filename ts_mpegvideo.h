@@ -6,6 +6,8 @@
 //////////////////////////////////////////////////////
 class MPEG2Video : public TsStream
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 private:
     uint32_t startCode_;
     bool    needIFrame_;
@@ -32,6 +34,7 @@ public:
 
     virtual void parse(STREAM_PKG* pkg);
     virtual void reset();
+    virtual bool isUnitStart(const uint8_t* data, int32_t len) const;
 };
 
 #endif // TS_MPEGVIDEO_H
@@ -0,0 +1,146 @@
+#include "tsarena.h"
+#include "tsbudget.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+
+///////////////////////////////////////////////////////////
+// Chunks and large blocks released on this thread, by size
+struct ARENA_CACHE
+{
+    std::multimap<size_t, void*> blocks;
+    size_t bytes = 0;
+
+    ~ARENA_CACHE()
+    {
+        for (auto& item : blocks)
+            free(item.second);
+    }
+
+    void* take(size_t size)
+    {
+        auto It = blocks.find(size);
+        if (It == blocks.end())
+            return nullptr;
+        auto p = It->second;
+        blocks.erase(It);
+        bytes -= size;
+        return p;
+    }
+
+    void give(void* p, size_t size)
+    {
+        if (bytes + size > TS_ARENA_CACHE_LIMIT)
+        {
+            free(p);
+            return;
+        }
+        blocks.emplace(size, p);
+        bytes += size;
+    }
+};
+
+static thread_local ARENA_CACHE arenaCache;
+
+////////////////////////////////////////////////////////////////////
+TsArena::TsArena()
+    : cur_(nullptr),
+    end_(nullptr),
+    capacity_(0),
+    account_(nullptr)
+{
+    memset(free_, 0, sizeof(free_));
+}
+
+TsArena::~TsArena()
+{
+    release();
+}
+
+// log2 of the rounded size, 16 bytes at least
+int32_t TsArena::sizeClass(size_t size)
+{
+    int32_t c = 4;
+    while ((static_cast<size_t>(1) << c) < size)
+        c++;
+    return c;
+}
+
+void TsArena::setAccount(TsMemoryAccount* account)
+{
+    if (account_ != nullptr)
+        account_->credit(static_cast<int64_t>(capacity_));
+    account_ = account;
+    if (account_ != nullptr)
+        account_->charge(static_cast<int64_t>(capacity_));
+}
+
+void* TsArena::takeBlock(size_t size)
+{
+    auto p = arenaCache.take(size);
+    if (p == nullptr && (p = malloc(size)) == nullptr)
+        throw std::bad_alloc();
+
+    capacity_ += size;
+    if (account_ != nullptr)
+        account_->charge(static_cast<int64_t>(size));
+    return p;
+}
+
+void* TsArena::allocate(size_t size)
+{
+    auto c = sizeClass(size);
+    if (free_[c] != nullptr)
+    {
+        auto block = free_[c];
+        free_[c] = block->next;
+        return block;
+    }
+
+    size_t rounded = static_cast<size_t>(1) << c;
+    if (rounded >= TS_ARENA_LARGE_SIZE)
+    {
+        BLOCK block = { takeBlock(rounded), rounded };
+        blocks_.push_back(block);
+        return block.data;
+    }
+
+    if (static_cast<size_t>(end_ - cur_) < rounded)
+    {
+        // the rest of the old chunk is left unused
+        BLOCK block = { takeBlock(TS_ARENA_CHUNK_SIZE), TS_ARENA_CHUNK_SIZE };
+        blocks_.push_back(block);
+        cur_ = static_cast<uint8_t*>(block.data);
+        end_ = cur_ + TS_ARENA_CHUNK_SIZE;
+    }
+
+    auto p = cur_;
+    cur_ += rounded;
+    return p;
+}
+
+void TsArena::deallocate(void* p, size_t size)
+{
+    if (p == nullptr)
+        return;
+
+    auto c = sizeClass(size);
+    auto block = static_cast<FREE_BLOCK*>(p);
+    block->next = free_[c];
+    free_[c] = block;
+}
+
+void TsArena::release()
+{
+    for (auto& block : blocks_)
+        arenaCache.give(block.data, block.size);
+    blocks_.clear();
+    if (account_ != nullptr)
+        account_->credit(static_cast<int64_t>(capacity_));
+
+    memset(free_, 0, sizeof(free_));
+    cur_ = end_ = nullptr;
+    capacity_ = 0;
+}
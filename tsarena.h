@@ -0,0 +1,115 @@
+#ifndef TSARENA_H
+#define TSARENA_H
+
+#include "tssplit_global.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TsMemoryAccount;
+
+// bump allocated chunk
+#define TS_ARENA_CHUNK_SIZE     (64 * 1024)
+// larger requests get a block of their own
+#define TS_ARENA_LARGE_SIZE     (TS_ARENA_CHUNK_SIZE / 4)
+// blocks a thread keeps for the next arena
+#define TS_ARENA_CACHE_LIMIT    (64 * 1024 * 1024)
+
+///////////////////////////////////////////////////////////
+// Owner of the parse state of one file: allocations are rounded up to a
+// power of two, bumped from chunks and recycled through free lists by size.
+// release() hands every chunk back in one step to a cache of the calling
+// thread, where the next arena created on that (worker) thread picks them up.
+// Not thread safe; alignment is at most 16 bytes.
+class TSSPLIT_EXPORT TsArena
+{
+public:
+    TsArena();
+    ~TsArena();
+
+    void* allocate(size_t size);
+    // size as passed to allocate()
+    void deallocate(void* p, size_t size);
+    // everything allocated becomes invalid
+    void release();
+    // chunks and large blocks are charged to the account, null: none
+    void setAccount(TsMemoryAccount* account);
+
+    // bytes held in chunks and large blocks
+    inline size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    TsArena(const TsArena&);
+    TsArena& operator=(const TsArena&);
+
+    struct FREE_BLOCK
+    {
+        FREE_BLOCK* next;
+    };
+
+    struct BLOCK
+    {
+        void*  data;
+        size_t size;
+    };
+
+    static int32_t sizeClass(size_t size);
+    void* takeBlock(size_t size);
+
+    std::vector<BLOCK> blocks_;
+    FREE_BLOCK* free_[64];
+    uint8_t* cur_;
+    uint8_t* end_;
+    size_t   capacity_;
+    TsMemoryAccount* account_;
+};
+
+///////////////////////////////////////////////////////////
+// STL allocator on an arena, plain new/delete without one
+template <typename T>
+class TsArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    TsArenaAllocator(TsArena* arena = nullptr) : arena_(arena) {}
+    template <typename U>
+    TsArenaAllocator(const TsArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena_ != nullptr ? arena_->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n)
+    {
+        if (arena_ != nullptr)
+            arena_->deallocate(p, n * sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    inline TsArena* arena() const
+    {
+        return arena_;
+    }
+
+    template <typename U>
+    bool operator==(const TsArenaAllocator<U>& other) const
+    {
+        return arena_ == other.arena();
+    }
+    template <typename U>
+    bool operator!=(const TsArenaAllocator<U>& other) const
+    {
+        return arena_ != other.arena();
+    }
+
+private:
+    TsArena* arena_;
+};
+
+#endif // TSARENA_H
@@ -0,0 +1,164 @@
+#include "tsbatch.h"
+#include "tscontext.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+
+#include <cstdio>
+
+TsBatch::TsBatch(const TS_BATCH_OPTIONS& options, QObject* parent)
+    : QObject(parent),
+    options_(options),
+    failed_(0)
+{
+}
+
+TsBatch::~TsBatch()
+{
+}
+
+int32_t TsBatch::run(const QStringList& files)
+{
+    TsMemoryBudget::global().setLimit(options_.memoryBudget);
+    TsScheduler scheduler(options_.jobs);
+    if (options_.deviceJobs > 0)
+        scheduler.setDeviceLimit(options_.deviceJobs);
+
+    // handlers run on the worker thread: no event loop is needed
+    QObject::connect(&scheduler, &TsScheduler::jobFinished, this, &TsBatch::onJobFinished, Qt::DirectConnection);
+
+    // joined: the files, or the numbered parts of a single one, are one stream
+    QVector<QStringList> sources;
+    if (options_.concat && files.size() == 1)
+    {
+        QStringList parts;
+        for (const auto& part : TsConcatInput::findParts(QFile::encodeName(files.front()).toStdString()))
+            parts << QFile::decodeName(part.c_str());
+        sources.push_back(parts);
+    }
+    else if (options_.concat)
+        sources.push_back(files);
+    else
+    {
+        for (const auto& file : files)
+            sources.push_back(QStringList(file));
+    }
+
+    QVector<TsParser*> parsers;
+    for (const auto& source : sources)
+    {
+        auto parser = new TsParser(source);
+        parser->setOutputDir(options_.outputDir);
+        parser->setPidFilter(options_.pids);
+        parser->setFollow(options_.followTimeoutMs);
+        parser->setLowLatency(options_.lowLatency);
+        parser->setCompression(options_.compression);
+        parser->setRemux(options_.remux);
+        parser->setMp4(options_.mp4);
+        if (options_.program != 0)
+            parser->setProgram(options_.program);
+        if (options_.verbose)
+            QObject::connect(parser, &TsParser::notifyError, this, &TsBatch::onNotifyError, Qt::DirectConnection);
+
+        parsers.push_back(parser);
+        scheduler.submit(parser);
+    }
+
+    scheduler.waitForDone();
+    qDeleteAll(parsers);
+    return failed_;
+}
+
+void TsBatch::onJobFinished(TsJob* job)
+{
+    auto parser = static_cast<TsParser*>(job);
+    auto json = toJson(parser->sourcePath(), parser->stats(), options_.stats);
+
+    QMutexLocker g(&outLock_);
+    if (parser->stats().result != AVCONTEXT_EOF_3)
+        failed_++;
+    fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+void TsBatch::onNotifyError(const QString& info)
+{
+    QMutexLocker g(&outLock_);
+    fprintf(stderr, "%s\n", info.toLocal8Bit().constData());
+}
+
+QByteArray TsBatch::toJson(const QString& file, const TS_PARSER_STATS& stats, bool stages)
+{
+    auto wallTime = stats.wallTimeNs / 1e9;
+
+    QJsonArray pids;
+    for (const auto& item : stats.pids)
+    {
+        QJsonObject pid;
+        pid["pid"] = item.first;
+        pid["codec"] = TsStream::getStreamCodecName(item.second.streamType);
+        pid["frames"] = static_cast<qint64>(item.second.frames);
+        pid["bytes"] = static_cast<qint64>(item.second.bytes);
+        if (item.second.dropped > 0)
+            pid["dropped"] = static_cast<qint64>(item.second.dropped);
+        pids.append(pid);
+    }
+
+    QJsonObject root;
+    root["file"] = file;
+    root["result"] = resultName(stats.result);
+    root["bytes"] = static_cast<qint64>(stats.bytes);
+    root["packets"] = static_cast<qint64>(stats.packets);
+    root["wall_s"] = wallTime;
+    root["cpu_s"] = stats.cpuTimeNs / 1e9;
+    root["mb_s"] = wallTime > 0 ? stats.bytes / 1e6 / wallTime : 0.0;
+    root["memory_peak"] = static_cast<qint64>(stats.memoryPeak);
+    root["pids"] = pids;
+
+    if (stages)
+    {
+        QJsonObject counters;
+        for (int32_t i = 0; i < TS_STAT_COUNTER_COUNT; i++)
+            counters[TsStats::counterName(static_cast<TS_STAT_COUNTER>(i))] = static_cast<qint64>(stats.stages.counters[i]);
+
+        QJsonObject timers;
+        for (int32_t i = 0; i < TS_STAT_TIMER_COUNT; i++)
+        {
+            QJsonObject timer;
+            timer["calls"] = static_cast<qint64>(stats.stages.timerCalls[i]);
+            timer["ticks"] = static_cast<qint64>(stats.stages.timerTicks[i]);
+            timers[TsStats::timerName(static_cast<TS_STAT_TIMER>(i))] = timer;
+        }
+
+        QJsonObject stage;
+        stage["counters"] = counters;
+        stage["timers"] = timers;
+        stage["tick_unit"] = TsStats::tickUnit();
+        root["stages"] = stage;
+    }
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+const char* TsBatch::resultName(int32_t code)
+{
+    switch (code)
+    {
+    case AVCONTEXT_TS_ERROR:
+        return "ts_error";
+    case AVCONTEXT_IO_ERROR_1:
+    case AVCONTEXT_IO_ERROR_2:
+    case AVCONTEXT_IO_ERROR_3:
+        return "io_error";
+    case AVCONTEXT_TS_NOSYNC:
+        return "no_sync";
+    case AVCONTEXT_EOF_1:
+    case AVCONTEXT_EOF_2:
+        return "truncated";
+    case AVCONTEXT_EOF_3:
+        return "success";
+    }
+    return "cancelled";
+}
@@ -0,0 +1,54 @@
+#ifndef TSBATCH_H
+#define TSBATCH_H
+
+#include "tsparser.h"
+
+#include <QMutex>
+#include <QSet>
+
+struct TS_BATCH_OPTIONS
+{
+    QString  outputDir;      // empty: next to the source file
+    uint16_t program;        // 0: all programs
+    QSet<uint16_t> pids;     // empty: all PIDs
+    int32_t  jobs;           // 0: number of cores
+    int32_t  deviceJobs;     // 0: from the kind of storage
+    bool     verbose;
+    bool     stats;          // per stage counters in the JSON output
+    int64_t  memoryBudget;   // bytes for all jobs, 0: unlimited
+    int32_t  followTimeoutMs; // growing files: idle ms, -1: off, 0: until closed
+    bool     lowLatency;     // frames out as soon as their PES is complete
+    bool     concat;         // the files are parts of one stream
+    std::map<STREAM_TYPE, int32_t> compression; // zstd level by stream type, empty: raw
+    bool     remux;          // a transport stream per program as well
+    bool     mp4;            // H.264/AAC of a program as fragmented MP4
+};
+
+///////////////////////////////////////////////////////////
+// Headless batch: runs the files on the scheduler and prints one line of
+// JSON statistics per finished file to stdout.
+class TsBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    TsBatch(const TS_BATCH_OPTIONS& options, QObject* parent = nullptr);
+    ~TsBatch();
+
+    // returns the number of files that did not finish successfully
+    int32_t run(const QStringList& files);
+
+private:
+    void onJobFinished(TsJob* job);
+    void onNotifyError(const QString& info);
+
+    static QByteArray toJson(const QString& file, const TS_PARSER_STATS& stats, bool stages);
+    static const char* resultName(int32_t code);
+
+private:
+    TS_BATCH_OPTIONS options_;
+    QMutex  outLock_;
+    int32_t failed_;
+};
+
+#endif // TSBATCH_H
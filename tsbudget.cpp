@@ -0,0 +1,117 @@
+#include "tsbudget.h"
+#include "tstrace.h"
+
+#include <chrono>
+
+static void raisePeak(std::atomic<int64_t>& peak, int64_t value)
+{
+    auto cur = peak.load(std::memory_order_relaxed);
+    while (value > cur && !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+TsMemoryBudget::TsMemoryBudget(int64_t limit)
+    : limit_(limit),
+    used_(0),
+    peak_(0),
+    readers_(0),
+    waiting_(0)
+{
+}
+
+TsMemoryBudget& TsMemoryBudget::global()
+{
+    static TsMemoryBudget budget;
+    return budget;
+}
+
+// 0: unlimited
+void TsMemoryBudget::setLimit(int64_t bytes)
+{
+    limit_.store(bytes > 0 ? bytes : 0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> g(lock_);
+    returned_.notify_all();
+}
+
+void TsMemoryBudget::charge(int64_t bytes)
+{
+    raisePeak(peak_, used_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void TsMemoryBudget::credit(int64_t bytes)
+{
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> g(lock_);
+    if (waiting_ > 0)
+        returned_.notify_all();
+}
+
+void TsMemoryBudget::addReader(int32_t delta)
+{
+    std::lock_guard<std::mutex> g(lock_);
+    readers_ += delta;
+    // a waiter may now be the last reader able to run
+    if (waiting_ > 0)
+        returned_.notify_all();
+}
+
+// Waits while other readers run: they either return memory when their job
+// ends or are throttled themselves, the last one keeps going.
+void TsMemoryBudget::throttle(const std::atomic<bool>& cancel)
+{
+    TS_TRACE_SPAN("memory", "throttle");
+    std::unique_lock<std::mutex> g(lock_);
+    while (exhausted() && readers_ - waiting_ > 1 && !cancel.load(std::memory_order_relaxed))
+    {
+        waiting_++;
+        returned_.wait_for(g, std::chrono::milliseconds(TS_BUDGET_THROTTLE_WAIT));
+        waiting_--;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+TsMemoryAccount::TsMemoryAccount(TsMemoryBudget& budget)
+    : budget_(budget),
+    current_(0),
+    peak_(0),
+    reading_(false)
+{
+}
+
+TsMemoryAccount::~TsMemoryAccount()
+{
+    setReading(false);
+    credit(current());
+}
+
+void TsMemoryAccount::charge(int64_t bytes)
+{
+    if (bytes <= 0)
+        return;
+
+    auto value = current_.load(std::memory_order_relaxed) + bytes;
+    current_.store(value, std::memory_order_relaxed);
+    if (value > peak_.load(std::memory_order_relaxed))
+        peak_.store(value, std::memory_order_relaxed);
+    budget_.charge(bytes);
+}
+
+void TsMemoryAccount::credit(int64_t bytes)
+{
+    if (bytes <= 0)
+        return;
+
+    current_.store(current_.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+    budget_.credit(bytes);
+}
+
+void TsMemoryAccount::setReading(bool reading)
+{
+    if (reading == reading_)
+        return;
+    reading_ = reading;
+    budget_.addReader(reading ? 1 : -1);
+}
@@ -0,0 +1,127 @@
+#ifndef TSBUDGET_H
+#define TSBUDGET_H
+
+#include "tssplit_global.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// expected footprint of a starting job: read buffer, first chunks, video ES
+#define TS_BUDGET_JOB_RESERVE       (4 * 1024 * 1024)
+// a throttled reader rechecks its cancel flag at this interval (ms)
+#define TS_BUDGET_THROTTLE_WAIT     (100)
+
+///////////////////////////////////////////////////////////
+// Process wide memory budget the parse state of all running jobs (read
+// buffers, arenas with the ES buffers, writer queues) is charged to through
+// per job accounts. Charges never fail; when the budget is exhausted the
+// scheduler admits no new jobs and readers are held at their next check
+// point until memory is returned. One reader always keeps running so the
+// jobs holding the memory can finish. 0: unlimited (default).
+class TSSPLIT_EXPORT TsMemoryBudget
+{
+public:
+    TsMemoryBudget(int64_t limit = 0);
+
+    static TsMemoryBudget& global();
+
+    void setLimit(int64_t bytes);
+    inline int64_t limit() const
+    {
+        return limit_.load(std::memory_order_relaxed);
+    }
+    inline int64_t used() const
+    {
+        return used_.load(std::memory_order_relaxed);
+    }
+    inline int64_t peak() const
+    {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+    inline bool exhausted() const
+    {
+        auto l = limit();
+        return l > 0 && used() >= l;
+    }
+    // true when the bytes can be charged without exceeding the limit
+    inline bool fits(int64_t bytes) const
+    {
+        auto l = limit();
+        return l <= 0 || used() + bytes <= l;
+    }
+
+private:
+    friend class TsMemoryAccount;
+
+    TsMemoryBudget(const TsMemoryBudget&);
+    TsMemoryBudget& operator=(const TsMemoryBudget&);
+
+    void charge(int64_t bytes);
+    void credit(int64_t bytes);
+    void addReader(int32_t delta);
+    void throttle(const std::atomic<bool>& cancel);
+
+    std::atomic<int64_t> limit_;
+    std::atomic<int64_t> used_;
+    std::atomic<int64_t> peak_;
+
+    // guards the reader counts
+    std::mutex lock_;
+    std::condition_variable returned_;
+    int32_t readers_;
+    int32_t waiting_;
+};
+
+///////////////////////////////////////////////////////////
+// Share of one job in the budget. Charged and credited by the thread running
+// the job; current() and peak() may be polled from any thread.
+class TSSPLIT_EXPORT TsMemoryAccount
+{
+public:
+    TsMemoryAccount(TsMemoryBudget& budget = TsMemoryBudget::global());
+    ~TsMemoryAccount();
+
+    void charge(int64_t bytes);
+    void credit(int64_t bytes);
+
+    // the job reads from its input: it may be throttled
+    void setReading(bool reading);
+    inline bool reading() const
+    {
+        return reading_;
+    }
+    // holds the calling reader while the budget is exhausted, returns early
+    // when cancel is set
+    inline void throttle(const std::atomic<bool>& cancel)
+    {
+        if (reading_ && budget_.exhausted())
+            budget_.throttle(cancel);
+    }
+
+    inline int64_t current() const
+    {
+        return current_.load(std::memory_order_relaxed);
+    }
+    inline int64_t peak() const
+    {
+        return peak_.load(std::memory_order_relaxed);
+    }
+    inline TsMemoryBudget& budget() const
+    {
+        return budget_;
+    }
+
+private:
+    TsMemoryAccount(const TsMemoryAccount&);
+    TsMemoryAccount& operator=(const TsMemoryAccount&);
+
+    TsMemoryBudget& budget_;
+    std::atomic<int64_t> current_;
+    std::atomic<int64_t> peak_;
+    bool reading_;
+};
+
+#endif // TSBUDGET_H
@@ -6,18 +6,31 @@
 #include "ts_h264.h"
 #include "ts_subtitle.h"
 #include "ts_teletext.h"
+#include "tsstats.h"
+#include "tstrace.h"
+#include "tsprobes.h"
+#include "tscrc.h"
 
 #define MAX_RESYNC_SIZE 65536
 
+// table buffers per slab
+#define PSI_POOL_SLAB   4
+#define PES_POOL_SLAB   32
+
 ////////////////////////////////////////////////////////////////////////////////
-AVContext::AVContext(TsParser& parser, const int64_t& pos, uint16_t channel)
-    : csMutex_(new QMutex()),
-    parser_(parser),
+AVContext::AVContext(TsInput& input, const int64_t& pos, uint16_t channel, TsArena* arena)
+    : input_(input),
     avPos_(pos),
     avDataLen_(FLUTS_NORMAL_TS_PACKAGESIZE),
     avPkgSize_(0),
     isConfigured_(false),
+    lowLatency_(false),
+    patVersions_(0),
     channel_(channel),
+    arena_(arena),
+    psiPool_(TABLE_BUFFER_SIZE, PSI_POOL_SLAB, arena),
+    pesPool_(PES_HEADER_BUFFER_SIZE, PES_POOL_SLAB, arena),
+    packages_(PACKAGE_MAP::key_compare(), PACKAGE_MAP::allocator_type(arena)),
     pid_(0xffff),
     transportError_(false),
     hasPayload_(false),
@@ -33,12 +46,11 @@ AVContext::AVContext(TsParser& parser, const int64_t& pos, uint16_t channel)
 AVContext::~AVContext()
 {
     reset();
-    delete csMutex_;
 }
 
 void AVContext::reset()
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
 
     pid_ = 0xffff;
     transportError_ = false;
@@ -50,32 +62,54 @@ void AVContext::reset()
     package_ = nullptr;
 }
 
-QVector<TsStream*> AVContext::getStreams() const
+void AVContext::getStreams(std::vector<TsStream*>& streams) const
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
 
-    QVector<TsStream*> v;
-    QMap<uint16_t, TsPackage>::const_iterator It = packages_.begin();
+    streams.clear();
+    auto It = packages_.begin();
     for (; It != packages_.end(); ++It)
-        if (It->packageType == PACKAGE_TYPE_PES && It->pStream != nullptr)
-            v.push_back(It->pStream);
-    return v;
+        if (It->second.packageType == PACKAGE_TYPE_PES && It->second.pStream != nullptr)
+            streams.push_back(It->second.pStream);
+}
+
+// Programs of the PAT, the PIDs are known once their PMT was parsed
+std::vector<TS_PROGRAM> AVContext::getPrograms() const
+{
+    std::lock_guard<std::mutex> lock(csMutex_);
+    std::vector<TS_PROGRAM> programs;
+    auto pat = packages_.find(0);
+    for (auto It = packages_.begin(); It != packages_.end(); ++It)
+    {
+        // program 0 is the network PID
+        if (It->first == 0 || It->second.packageType != PACKAGE_TYPE_PSI || It->second.channel == 0)
+            continue;
+
+        TS_PROGRAM program;
+        program.channel = It->second.channel;
+        program.pmtPid = It->first;
+        program.pcrPid = It->second.pcrPid;
+        program.transportStreamId = pat != packages_.end() ? pat->second.packageTable.id : 0;
+        program.pids = It->second.esPids;
+        programs.push_back(program);
+    }
+    return programs;
 }
 
 void AVContext::startStreaming(uint16_t pid)
 {
-    QMutexLocker lock(csMutex_);
-    QMap<uint16_t, TsPackage>::iterator It = packages_.find(pid);
+    std::lock_guard<std::mutex> lock(csMutex_);
+    auto It = packages_.find(pid);
     if (It != packages_.end())
-        It->streaming = true;
+        It->second.streaming = true;
 }
 
 void AVContext::stopStreaming(uint16_t pid)
 {
-    QMutexLocker lock(csMutex_);
-    QMap<uint16_t, TsPackage>::iterator It = packages_.find(pid);
+    std::lock_guard<std::mutex> lock(csMutex_);
+    auto It = packages_.find(pid);
     if (It != packages_.end())
-        It->streaming = false;
+        It->second.streaming = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -120,6 +154,7 @@ STREAM_TYPE AVContext::getStreamType(uint8_t pesType)
 
 int32_t AVContext::configureTs()
 {
+    TS_TRACE_SPAN("demux", "sync");
     const uint8_t* data;
     int32_t dataSize = AV_CONTEXT_PACKAGESIZE;
     int64_t pos = avPos_;
@@ -136,7 +171,7 @@ int32_t AVContext::configureTs()
     {
 
         bool isEof = false;
-        if (nullptr == (data = parser_.read(pos, dataSize, isEof)))
+        if (nullptr == (data = input_.read(pos, dataSize, isEof)))
         {
             if(isEof)
                 return AVCONTEXT_EOF_1;
@@ -157,7 +192,7 @@ int32_t AVContext::configureTs()
                     npos += fluts[t][0];
 
                     isEof = false;
-                    if (nullptr == (ndata = parser_.read(npos, dataSize, isEof)))
+                    if (nullptr == (ndata = input_.read(npos, dataSize, isEof)))
                     {
                         if(isEof)
                             return AVCONTEXT_EOF_2;
@@ -183,6 +218,9 @@ int32_t AVContext::configureTs()
             // One and only one is eligible
             if (count == 1)
             {
+                TS_STAT_ADD(TS_STAT_RESYNC_BYTES, static_cast<uint64_t>(pos - avPos_));
+                if (pos != avPos_)
+                    TS_PROBE2(sync_loss, avPos_, static_cast<int32_t>(pos - avPos_));
                 avPkgSize_ = fluts[found][0];
                 avPos_ = pos;
                 return AVCONTEXT_CONTINUE;
@@ -204,6 +242,7 @@ int32_t AVContext::configureTs()
 int32_t AVContext::TSResync()
 {
     const uint8_t* data;
+    auto traceStart = TS_TRACE_NOW();
     if (!isConfigured_)
     {
         int32_t ret = configureTs();
@@ -216,7 +255,7 @@ int32_t AVContext::TSResync()
     {
 
         bool isEof = false;
-        if (nullptr == (data = parser_.read(avPos_, avPkgSize_, isEof)))
+        if (nullptr == (data = input_.read(avPos_, avPkgSize_, isEof)))
         {
             if(isEof)
                 return AVCONTEXT_EOF_3;
@@ -225,6 +264,12 @@ int32_t AVContext::TSResync()
 
         if (data[0] == 0x47)
         {
+            if (i > 0)
+            {
+                TS_STAT_ADD(TS_STAT_RESYNC_BYTES, i);
+                TS_PROBE2(sync_loss, avPos_ - i, i);
+                TS_TRACE_RECORD("demux", "resync", traceStart, -1);
+            }
             memcpy(avBuf_, data, avPkgSize_);
             reset();
             return AVCONTEXT_CONTINUE;
@@ -252,13 +297,15 @@ int32_t AVContext::TSResync()
 // Parsing error
 int32_t AVContext::processTSPackage()
 {
-    QMutexLocker lock(csMutex_);
+    TS_STAT_TIMER(TS_STAT_TIMER_PACKAGE);
+    std::lock_guard<std::mutex> lock(csMutex_);
 
     int32_t ret = AVCONTEXT_CONTINUE;
-    QMap<uint16_t, TsPackage>::iterator It;
+    PACKAGE_MAP::iterator It;
 
     if (avRb8(avBuf_) != 0x47) // ts sync byte
         return AVCONTEXT_TS_NOSYNC;
+    TS_STAT_ADD(TS_STAT_PACKETS, 1);
 
     uint16_t header = avRb16(avBuf_ + 1);
     pid_ = header & 0x1fff;
@@ -307,11 +354,11 @@ int32_t AVContext::processTSPackage()
         if (pid_ == 0 && payloadUnitStart_)
         {
             // Registering PID 0
-            TsPackage pid0;
-            pid0.pid = pid_;
-            pid0.packageType = PACKAGE_TYPE_PSI;
-            pid0.continuity = continuityCounter;
-            It = packages_.insert(It, pid_, pid0);
+            It = packages_.try_emplace(It, pid_);
+            It->second.pid = pid_;
+            It->second.packageType = PACKAGE_TYPE_PSI;
+            It->second.packageTable.attach(psiPool_);
+            It->second.continuity = continuityCounter;
         }
         else
             return AVCONTEXT_CONTINUE;
@@ -320,35 +367,37 @@ int32_t AVContext::processTSPackage()
     {
         // PID is registred
         // Checking unit start is required
-        if (It->waitUnitStart && !payloadUnitStart_)
+        if (It->second.waitUnitStart && !payloadUnitStart_)
         {
             // Not unit start. Save package flow continuity...
-            It->continuity = continuityCounter;
+            It->second.continuity = continuityCounter;
             discontinuity_ = true;
             return AVCONTEXT_DISCONTINUITY;
         }
 
         // Checking continuity where possible
-        if (It->continuity != 0xff)
+        if (It->second.continuity != 0xff)
         {
-            uint8_t expected_cc = hasPayload ? (It->continuity + 1) & 0x0f : It->continuity;
+            uint8_t expected_cc = hasPayload ? (It->second.continuity + 1) & 0x0f : It->second.continuity;
             if (!isDiscontinuity && expected_cc != continuityCounter)
             {
+                TS_STAT_ADD(TS_STAT_CC_ERRORS, 1);
+                TS_PROBE3(cc_error, pid_, expected_cc, continuityCounter);
                 discontinuity_ = true;
                 // If unit is not start then reset PID and wait the next unit start
                 if (!payloadUnitStart_)
                 {
-                    It->reset();
+                    It->second.reset();
                     return AVCONTEXT_DISCONTINUITY;
                 }
             }
         }
-        It->continuity = continuityCounter;
+        It->second.continuity = continuityCounter;
     }
 
     discontinuity_ |= isDiscontinuity;
     hasPayload_ = hasPayload;
-    package_ = &(It.value());
+    package_ = &(It->second);
 
     // It is time to stream data for PES
     if (payloadUnitStart_ &&
@@ -358,16 +407,35 @@ int32_t AVContext::processTSPackage()
     {
         package_->hasStreamData = true;
         ret = AVCONTEXT_STREAM_PID_DATA;
+        // the previous access unit ends where the new PES starts another one
+        if (lowLatency_ && pesStartsUnit())
+            package_->pStream->setUnitEnd();
     }
     return ret;
 }
 
+// The PES starting in the current packet carries a PTS and its data begins
+// with the start of an access unit
+bool AVContext::pesStartsUnit() const
+{
+    if (package_->pStream == nullptr || payload_ == nullptr || payloadLen_ < 9)
+        return false;
+    if (memcmp(payload_, "\x00\x00\x01", 3) != 0 || (avRb8(payload_ + 7) & 0x80) == 0)
+        return false;
+
+    int32_t header = 9 + avRb8(payload_ + 8);
+    if (header >= payloadLen_)
+        return false;
+    return package_->pStream->isUnitStart(payload_ + header, payloadLen_ - header);
+}
+
 // Process payload of package depending of its type
 // PACKAGE_TYPE_PSI -> parseTsPsi()
 // PACKAGE_TYPE_PES -> parseTsPes()
 int32_t AVContext::processTSPayload()
 {
-    QMutexLocker lock(csMutex_);
+    TS_STAT_TIMER(TS_STAT_TIMER_PAYLOAD);
+    std::lock_guard<std::mutex> lock(csMutex_);
 
     if (!package_)
         return AVCONTEXT_CONTINUE;
@@ -389,37 +457,131 @@ int32_t AVContext::processTSPayload()
 
 void AVContext::clearPmt()
 {
-    QVector<uint16_t> pidList;
-    QMap<uint16_t, TsPackage>::iterator It = packages_.begin();
+    std::vector<uint16_t> pidList;
+    auto It = packages_.begin();
     for (; It != packages_.end(); ++It)
-        if (It->packageType == PACKAGE_TYPE_PSI &&
-            It->packageTable.tableId == 0x02)
+        if (It->second.packageType == PACKAGE_TYPE_PSI &&
+            It->second.packageTable.tableId == 0x02)
         {
-            pidList.push_back(It.key());
-            clearPes(It->channel);
+            pidList.push_back(It->first);
+            clearPes(It->second.channel);
         }
 
-    for (QVector<uint16_t>::iterator vIt = pidList.begin(); vIt != pidList.end(); ++vIt)
+    for (auto vIt = pidList.begin(); vIt != pidList.end(); ++vIt)
         if (packages_.end() != (It = packages_.find(*vIt)))
             packages_.erase(It);
 }
 
 void AVContext::clearPes(uint16_t channel)
 {
-    QVector<uint16_t> pidList;
-    QMap<uint16_t, TsPackage>::iterator It = packages_.begin();
+    std::vector<uint16_t> pidList;
+    auto It = packages_.begin();
     for (; It != packages_.end(); ++It)
-        if (It->packageType == PACKAGE_TYPE_PES &&
-            It->channel == channel)
+        if (It->second.packageType == PACKAGE_TYPE_PES &&
+            It->second.channel == channel)
         {
-            pidList.push_back(It.key());
+            pidList.push_back(It->first);
         }
 
-    for (QVector<uint16_t>::iterator vIt = pidList.begin(); vIt != pidList.end(); ++vIt)
+    for (auto vIt = pidList.begin(); vIt != pidList.end(); ++vIt)
         if (packages_.end() != (It = packages_.find(*vIt)))
             packages_.erase(It);
 }
 
+TsStream* AVContext::createStream(uint16_t pid, STREAM_TYPE streamType)
+{
+    TsStream* es;
+    switch (streamType)
+    {
+    case STREAM_TYPE_VIDEO_MPEG1:
+    case STREAM_TYPE_VIDEO_MPEG2:
+        es = new (arena_) MPEG2Video(pid);
+        break;
+    case STREAM_TYPE_AUDIO_MPEG1:
+    case STREAM_TYPE_AUDIO_MPEG2:
+        es = new (arena_) MPEG2Audio(pid);
+        break;
+    case STREAM_TYPE_AUDIO_AAC:
+    case STREAM_TYPE_AUDIO_AAC_ADTS:
+    case STREAM_TYPE_AUDIO_AAC_LATM:
+        es = new (arena_) AAC(pid);
+        break;
+    case STREAM_TYPE_VIDEO_H264:
+        es = new (arena_) h264(pid);
+        break;
+    case STREAM_TYPE_AUDIO_AC3:
+    case STREAM_TYPE_AUDIO_EAC3:
+        es = new (arena_) AC3(pid);
+        break;
+    case STREAM_TYPE_DVB_SUBTITLE:
+        es = new (arena_) Subtitle(pid);
+        break;
+    case STREAM_TYPE_DVB_TELETEXT:
+        es = new (arena_) Teletext(pid);
+        break;
+    default:
+        // No parser: pass-through
+        es = new (arena_) TsStream(pid);
+        es->hasStreamInfo_ = true;
+        break;
+    }
+    es->streamType_ = streamType;
+    es->setArena(arena_);
+    return es;
+}
+
+// Applies a new PMT version: streams with the same PID and stream type keep
+// their buffers and parser state (partial frame, SPS/PPS), the others are
+// dropped or created. Streaming of the new ones is disabled by default.
+void AVContext::updatePes(uint16_t channel, const PMT_STREAM* streams, int32_t count)
+{
+    auto isKept = [&](const TsPackage& pes) {
+        for (int32_t i = 0; i < count; i++)
+            if (streams[i].pid == pes.pid)
+                return pes.pmtStreamType == streams[i].streamType;
+        return false;
+    };
+
+    for (auto It = packages_.begin(); It != packages_.end();)
+    {
+        if (It->second.packageType == PACKAGE_TYPE_PES &&
+            It->second.channel == channel &&
+            !isKept(It->second))
+            It = packages_.erase(It);
+        else
+            ++It;
+    }
+
+    for (int32_t i = 0; i < count; i++)
+    {
+        const auto& stream = streams[i];
+        TsPackage& pes = packages_[stream.pid];
+        if (pes.packageType == PACKAGE_TYPE_PES &&
+            pes.channel == channel &&
+            pes.pStream != nullptr)
+        {
+            // unchanged: descriptors only
+            auto& info = pes.pStream->streamInfo_;
+            memcpy(info.language, stream.streamInfo.language, sizeof(info.language));
+            info.compositionId = stream.streamInfo.compositionId;
+            info.ancillaryId = stream.streamInfo.ancillaryId;
+            continue;
+        }
+
+        pes.reset();
+        delete pes.pStream;
+        pes.pid = stream.pid;
+        pes.packageType = PACKAGE_TYPE_PES;
+        pes.packageTable.attach(pesPool_);
+        pes.channel = channel;
+        pes.pmtStreamType = stream.streamType;
+        // disable streaming by default
+        pes.streaming = false;
+        pes.pStream = createStream(stream.pid, stream.streamType);
+        pes.pStream->streamInfo_ = stream.streamInfo;
+    }
+}
+
 // Parse PSI payload
 // returns:
 // AVCONTEXT_CONTINUE
@@ -451,8 +613,11 @@ int32_t AVContext::parseTsPsi()
         if ((len & 0x3000) != 0x3000)
             return AVCONTEXT_TS_ERROR;
 
-        len &= 0x0fff;
         package_->packageTable.reset();
+        package_->packageTable.hasCrc = (len & 0x8000) != 0;
+        if (package_->packageTable.hasCrc)
+            package_->packageTable.crc = tsCrc32(payload_ + 1, 3);
+        len &= 0x0fff;
 
         int32_t n = payloadLen_ - 4;
         memcpy(package_->packageTable.buf, payload_ + 4, n);
@@ -469,7 +634,7 @@ int32_t AVContext::parseTsPsi()
         if (package_->packageTable.offset == 0)
             return AVCONTEXT_TS_ERROR;
 
-        if ((payloadLen_ + package_->packageTable.offset) > TABLE_BUFFER_SIZE)
+        if ((payloadLen_ + package_->packageTable.offset) > package_->packageTable.size())
             return AVCONTEXT_TS_ERROR;
 
         memcpy(package_->packageTable.buf + package_->packageTable.offset, payload_, payloadLen_);
@@ -480,6 +645,19 @@ int32_t AVContext::parseTsPsi()
     }
 
     // now entire table is filled
+    TS_STAT_ADD(TS_STAT_PSI_SECTIONS, 1);
+
+    // reject corrupted sections before anything is torn down
+    if (package_->packageTable.hasCrc &&
+        (package_->packageTable.len < 4 ||
+        tsCrc32(package_->packageTable.buf, package_->packageTable.len, package_->packageTable.crc) != 0))
+    {
+        TS_STAT_ADD(TS_STAT_CRC_ERRORS, 1);
+        TS_PROBE2(crc_error, pid_, package_->packageTable.tableId);
+        package_->packageTable.reset();
+        return AVCONTEXT_CONTINUE;
+    }
+
     const uint8_t* psi = package_->packageTable.buf;
     const uint8_t* endPsi = psi + package_->packageTable.len;
 
@@ -500,6 +678,7 @@ int32_t AVContext::parseTsPsi()
             return AVCONTEXT_CONTINUE;
         }
 
+        TS_PROBE2(pat_version, id, version);
         // clear old associated pmt
         clearPmt();
         // parse new version of PAT
@@ -528,6 +707,7 @@ int32_t AVContext::parseTsPsi()
                 TsPackage& pmt = packages_[pmtPid];
                 pmt.pid = pmtPid;
                 pmt.packageType = PACKAGE_TYPE_PSI;
+                pmt.packageTable.attach(psiPool_);
                 pmt.channel = channel;
             }
         }
@@ -535,6 +715,7 @@ int32_t AVContext::parseTsPsi()
         // PAT is processed. New version is available
         package_->packageTable.id = id;
         package_->packageTable.version = version;
+        patVersions_++;
         break;
     }
     case 0x02: // parse PMT table
@@ -551,21 +732,23 @@ int32_t AVContext::parseTsPsi()
             return AVCONTEXT_CONTINUE;
         }
 
-        // clear old pes
-        clearPes(package_->channel);
+        TS_PROBE2(pmt_version, id, version);
 
-        // parse new version of PMT
-        psi += 7;
+        // parse new version of PMT; nothing changes before it is complete
+        psi += 5;
         endPsi -= 4; // CRC32
-        if (psi >= endPsi)
+        if (psi + 2 >= endPsi)
             return AVCONTEXT_TS_ERROR;
+        uint16_t pcrPid = avRb16(psi) & 0x1fff;
+        psi += 2;
 
         len = (int32_t)(avRb16(psi) & 0x0fff);
         psi += 2 + len;
 
+        int32_t streams = 0, esPids = 0;
         while (psi < endPsi)
         {
-            if (endPsi - psi < 5)
+            if (endPsi - psi < 5 || esPids == TS_PMT_MAX_STREAMS)
                 return AVCONTEXT_TS_ERROR;
 
             uint8_t  pesType = avRb8(psi);
@@ -580,59 +763,17 @@ int32_t AVContext::parseTsPsi()
             // len of descriptor section
             len = (int32_t)(avRb16(psi + 3) & 0x0fff);
             psi += 5;
+            pmtPids_[esPids++] = pesPid;
 
             // ignore unknown streams
             STREAM_TYPE streamType = getStreamType(pesType);
             if (streamType != STREAM_TYPE_UNKNOWN)
             {
-                TsPackage& pes = packages_[pesPid];
-                pes.pid = pesPid;
-                pes.packageType = PACKAGE_TYPE_PES;
-                pes.channel = package_->channel;
-                // disable streaming by default
-                pes.streaming = false;
-
+                auto& stream = pmtStreams_[streams++];
+                stream.pid = pesPid;
                 // get basic stream infos from PMT table
-                STREAM_INFO streamInfo = parsePesDescriptor(psi, len, &streamType);
-                TsStream* es;
-                switch (streamType)
-                {
-                case STREAM_TYPE_VIDEO_MPEG1:
-                case STREAM_TYPE_VIDEO_MPEG2:
-                    es = new MPEG2Video(pesPid);
-                    break;
-                case STREAM_TYPE_AUDIO_MPEG1:
-                case STREAM_TYPE_AUDIO_MPEG2:
-                    es = new MPEG2Audio(pesPid);
-                    break;
-                case STREAM_TYPE_AUDIO_AAC:
-                case STREAM_TYPE_AUDIO_AAC_ADTS:
-                case STREAM_TYPE_AUDIO_AAC_LATM:
-                    es = new AAC(pesPid);
-                    break;
-                case STREAM_TYPE_VIDEO_H264:
-                    es = new h264(pesPid);
-                    break;
-                case STREAM_TYPE_AUDIO_AC3:
-                case STREAM_TYPE_AUDIO_EAC3:
-                    es = new AC3(pesPid);
-                    break;
-                case STREAM_TYPE_DVB_SUBTITLE:
-                    es = new Subtitle(pesPid);
-                    break;
-                case STREAM_TYPE_DVB_TELETEXT:
-                    es = new Teletext(pesPid);
-                    break;
-                default:
-                    // No parser: pass-through
-                    es = new TsStream(pesPid);
-                    es->hasStreamInfo_ = true;
-                    break;
-                }
-
-                es->streamType_ = streamType;
-                es->streamInfo_ = streamInfo;
-                pes.pStream = es;
+                stream.streamInfo = parsePesDescriptor(psi, len, &streamType);
+                stream.streamType = streamType;
             }
             psi += len;
         }
@@ -640,6 +781,11 @@ int32_t AVContext::parseTsPsi()
         if (psi != endPsi)
             return AVCONTEXT_TS_ERROR;
 
+        updatePes(package_->channel, pmtStreams_, streams);
+        package_->pcrPid = pcrPid;
+        // keeps its capacity from the previous version
+        package_->esPids.assign(pmtPids_, pmtPids_ + esPids);
+
         // PMT is processed. New version is available
         package_->packageTable.id = id;
         package_->packageTable.version = version;
@@ -738,8 +884,13 @@ int32_t AVContext::parseTsPes()
     if (package_->pStream == nullptr)
         return AVCONTEXT_CONTINUE;
 
+    if (payloadUnitStart_)
+        package_->pesLength = package_->pesBytes = 0;
+    package_->pesBytes += payloadLen_;
+
     if (payloadUnitStart_)
     {
+        TS_STAT_ADD(TS_STAT_PES_UNITS, 1);
         // wait for unit start: Reset frame buffer to clear old data
         if (this->package_->waitUnitStart)
         {
@@ -778,6 +929,7 @@ int32_t AVContext::parseTsPes()
                 uint8_t streamId = avRb8(package_->packageTable.buf + 3);
                 if (streamId == 0xbd || (streamId >= 0xc0 && streamId <= 0xef))
                     package_->packageTable.len = 9;
+                package_->pesLength = avRb16(package_->packageTable.buf + 4);
             }
         }
         else if (package_->packageTable.offset == 9)
@@ -840,6 +992,13 @@ int32_t AVContext::parseTsPes()
         const uint8_t* data = payload_ + pos;
         int32_t len = payloadLen_ - pos;
         package_->pStream->append(data, len, hasPts);
+
+        // low latency: the declared length arrived, the PES is complete
+        if (lowLatency_ && package_->pesLength > 0 && package_->pesBytes >= package_->pesLength + 6)
+        {
+            package_->pesLength = 0;
+            return AVCONTEXT_STREAM_PID_DATA;
+        }
     }
     return AVCONTEXT_CONTINUE;
 }
@@ -2,11 +2,11 @@
 #define TSCONTEXT_H
 
 #include "tspackage.h"
-#include "tsparser.h"
+#include "tsinput.h"
 
-#include <QMutex>
-#include <QMap>
-#include <QVector>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #define FLUTS_NORMAL_TS_PACKAGESIZE     188
 #define FLUTS_M2TS_TS_PACKAGESIZE       192
@@ -16,6 +16,8 @@
 #define AV_CONTEXT_PACKAGESIZE          208
 #define TS_CHECK_MIN_SCORE              2
 #define TS_CHECK_MAX_SCORE              10
+// PMT entries take at least 5 bytes of a section of at most 1021
+#define TS_PMT_MAX_STREAMS              (1021 / 5)
 
 ///////////////////////////////////////////////////////////
 enum
@@ -39,21 +41,43 @@ enum
 ///////////////////////////////////////////////////////////
 class AVContext
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 public:
-    AVContext(TsParser& parser, const int64_t& pos, uint16_t channel);
+    // the parse state is allocated from the arena when there is one
+    AVContext(TsInput& input, const int64_t& pos, uint16_t channel, TsArena* arena = nullptr);
     ~AVContext();
     void reset();
 
-    QVector<TsStream*> getStreams() const;
+    // refills streams, its capacity is reused
+    void getStreams(std::vector<TsStream*>& streams) const;
+    std::vector<TS_PROGRAM> getPrograms() const;
+    // counts the PAT versions parsed, they change the programs without a PMT
+    inline uint32_t getPatVersions() const
+    {
+        return patVersions_;
+    }
     void startStreaming(uint16_t pid);
     void stopStreaming(uint16_t pid);
 
+    // Low latency: a PES is complete once its PES_packet_length arrived and
+    // a video access unit once the next PES starts with a new one
+    inline void setLowLatency(bool enabled)
+    {
+        lowLatency_ = enabled;
+    }
+
     // TS parser
     int32_t TSResync();
     int32_t processTSPackage();
     int32_t processTSPayload();
 
     inline uint16_t getPID() const;
+    // the current TS packet, 188 bytes from the sync byte
+    inline const uint8_t* getPacket() const
+    {
+        return avBuf_;
+    }
     inline PACKAGE_TYPE getPIDType() const;
     inline uint16_t getPIDChannel() const;
     inline bool hasPIDStreamData() const;
@@ -80,18 +104,28 @@ private:
     int32_t configureTs();
     static STREAM_TYPE getStreamType(uint8_t pesType);
 
+    struct PMT_STREAM
+    {
+        uint16_t    pid;
+        STREAM_TYPE streamType;
+        STREAM_INFO streamInfo;
+    };
+
     STREAM_INFO parsePesDescriptor(const uint8_t* p, int32_t len, STREAM_TYPE* st);
+    TsStream* createStream(uint16_t pid, STREAM_TYPE streamType);
     void    clearPmt();
     void    clearPes(uint16_t channel);
+    void    updatePes(uint16_t channel, const PMT_STREAM* streams, int32_t count);
     int32_t  parseTsPsi();
     int32_t  parseTsPes();
+    bool     pesStartsUnit() const;
 
 private:
     // critical section
-    QMutex* csMutex_;
+    mutable std::mutex csMutex_;
 
-    // AV stream owner
-    TsParser& parser_;
+    // AV stream source
+    TsInput& input_;
 
     // Raw package buffer
     int64_t avPos_;
@@ -99,10 +133,22 @@ private:
     int32_t avPkgSize_;
     uint8_t avBuf_[AV_CONTEXT_PACKAGESIZE];
 
+    // streams of the PMT being parsed, a new version allocates nothing
+    PMT_STREAM pmtStreams_[TS_PMT_MAX_STREAMS];
+    uint16_t   pmtPids_[TS_PMT_MAX_STREAMS];
+
     // TS Streams context
+    typedef std::map<uint16_t, TsPackage, std::less<uint16_t>,
+        TsArenaAllocator<std::pair<const uint16_t, TsPackage>>> PACKAGE_MAP;
+
     bool isConfigured_;
+    bool lowLatency_;
+    uint32_t patVersions_;
     uint16_t channel_;
-    QMap<uint16_t, TsPackage> packages_;
+    TsArena* arena_;
+    TsBufferPool psiPool_;      // section buffers
+    TsBufferPool pesPool_;      // PES header scratch
+    PACKAGE_MAP packages_;
 
     // Package context
     uint16_t         pid_;
@@ -122,13 +168,13 @@ inline uint16_t AVContext::getPID() const
 
 inline PACKAGE_TYPE AVContext::getPIDType() const
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
     return (package_ == nullptr ? PACKAGE_TYPE_UNKNOWN : package_->packageType);
 }
 
 inline uint16_t AVContext::getPIDChannel() const
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
     return (package_ == nullptr ? 0xffff : package_->channel);
 }
 
@@ -136,7 +182,7 @@ inline uint16_t AVContext::getPIDChannel() const
 // On new unit start, flag is held
 inline bool AVContext::hasPIDStreamData() const
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
     return (package_ != nullptr && package_->hasStreamData);
 }
 
@@ -147,29 +193,29 @@ inline bool AVContext::hasPIDPayload() const
 
 inline TsStream* AVContext::getPIDStream() const
 {
-    QMutexLocker lock(csMutex_);
+    std::lock_guard<std::mutex> lock(csMutex_);
     return (package_ != nullptr && package_->packageType == PACKAGE_TYPE_PES ? package_->pStream : nullptr);
 }
 
 inline TsStream* AVContext::getStream(uint16_t pid) const
 {
-    QMutexLocker lock(csMutex_);
-    QMap<uint16_t, TsPackage>::const_iterator It = packages_.find(pid);
-    return (It == packages_.end() ? nullptr : It->pStream);
+    std::lock_guard<std::mutex> lock(csMutex_);
+    auto It = packages_.find(pid);
+    return (It == packages_.end() ? nullptr : It->second.pStream);
 }
 
 inline uint16_t AVContext::getChannel(uint16_t pid) const
 {
-    QMutexLocker lock(csMutex_);
-    QMap<uint16_t, TsPackage>::const_iterator It = packages_.find(pid);
-    return (It == packages_.end() ? 0xffff : It->channel);
+    std::lock_guard<std::mutex> lock(csMutex_);
+    auto It = packages_.find(pid);
+    return (It == packages_.end() ? 0xffff : It->second.channel);
 }
 
 inline void AVContext::resetPackages()
 {
-    QMutexLocker lock(csMutex_);
-    QMap<uint16_t, TsPackage>::iterator It = packages_.begin();
-    for (; It != packages_.end(); ++It) It->reset();
+    std::lock_guard<std::mutex> lock(csMutex_);
+    auto It = packages_.begin();
+    for (; It != packages_.end(); ++It) It->second.reset();
 }
 
 inline uint8_t AVContext::avRb8(const uint8_t* p) const
@@ -191,7 +237,7 @@ inline uint32_t AVContext::avRb32(const uint8_t* p) const
 
 inline int64_t AVContext::decodePts(const uint8_t* p) const
 {
-    int64_t pts = (quint64)(avRb8(p) & 0x0e) << 29 | (avRb16(p + 1) >> 1) << 15 | avRb16(p + 3) >> 1;
+    int64_t pts = (uint64_t)(avRb8(p) & 0x0e) << 29 | (avRb16(p + 1) >> 1) << 15 | avRb16(p + 3) >> 1;
     return pts;
 }
 
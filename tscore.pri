@@ -0,0 +1,70 @@
+# Demuxer core (libtssplit) shared by the GUI, the command line and the
+# library targets. Plain C++17, no Qt.
+
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/tssplit_global.h \
+    $$PWD/bitstream.h \
+    $$PWD/ts_aac.h \
+    $$PWD/ts_ac3.h \
+    $$PWD/ts_h264.h \
+    $$PWD/ts_mpegaudio.h \
+    $$PWD/ts_mpegvideo.h \
+    $$PWD/ts_subtitle.h \
+    $$PWD/ts_teletext.h \
+    $$PWD/tsstream.h \
+    $$PWD/tspackage.h \
+    $$PWD/tscontext.h \
+    $$PWD/tstable.h \
+    $$PWD/tsinput.h \
+    $$PWD/tsudpinput.h \
+    $$PWD/tsdecompress.h \
+    $$PWD/tsfileio.h \
+    $$PWD/tsdemuxer.h \
+    $$PWD/tseswriter.h \
+    $$PWD/tsremux.h \
+    $$PWD/tsmp4.h \
+    $$PWD/tsstats.h \
+    $$PWD/tstrace.h \
+    $$PWD/tsprobes.h \
+    $$PWD/tscrc.h \
+    $$PWD/tspool.h \
+    $$PWD/tsarena.h \
+    $$PWD/tsbudget.h \
+    $$PWD/tsworkers.h
+
+SOURCES += $$PWD/bitstream.cpp \
+    $$PWD/ts_aac.cpp \
+    $$PWD/ts_ac3.cpp \
+    $$PWD/ts_h264.cpp \
+    $$PWD/ts_mpegaudio.cpp \
+    $$PWD/ts_mpegvideo.cpp \
+    $$PWD/ts_subtitle.cpp \
+    $$PWD/ts_teletext.cpp \
+    $$PWD/tsstream.cpp \
+    $$PWD/tscontext.cpp \
+    $$PWD/tsinput.cpp \
+    $$PWD/tsudpinput.cpp \
+    $$PWD/tsdecompress.cpp \
+    $$PWD/tsdemuxer.cpp \
+    $$PWD/tseswriter.cpp \
+    $$PWD/tsremux.cpp \
+    $$PWD/tsmp4.cpp \
+    $$PWD/tsstats.cpp \
+    $$PWD/tstrace.cpp \
+    $$PWD/tscrc.cpp \
+    $$PWD/tspool.cpp \
+    $$PWD/tsarena.cpp \
+    $$PWD/tsbudget.cpp \
+    $$PWD/tsworkers.cpp
+
+# .gz inputs with zlib (qmake CONFIG+=tssplit_no_zlib to leave it out),
+# .zst inputs and outputs with CONFIG+=tssplit_zstd (libzstd)
+unix:!tssplit_no_zlib {
+    DEFINES += TSSPLIT_HAVE_ZLIB
+    LIBS += -lz
+}
+tssplit_zstd {
+    DEFINES += TSSPLIT_HAVE_ZSTD
+    LIBS += -lzstd
+}
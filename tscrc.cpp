@@ -0,0 +1,145 @@
+#include "tscrc.h"
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#include <immintrin.h>
+#define TS_HAVE_PCLMUL
+#endif
+
+#define TS_CRC32_POLY   (0x04c11db7U)
+
+// below this size the folding setup does not pay off
+#define TS_CRC32_FOLD_MIN   (64)
+
+struct CRC32_TABLES
+{
+    uint32_t slice[8][256];
+    uint64_t fold128[2];         // x^(128+64), x^128 mod P
+    uint64_t fold512[2];         // x^(512+64), x^512 mod P
+    uint32_t (*kernel)(const uint8_t*, size_t, uint32_t);
+
+    CRC32_TABLES();
+};
+
+static uint32_t crc32Pclmul(const uint8_t* data, size_t len, uint32_t crc);
+
+// x^n mod P
+static uint32_t xPowMod(int32_t n)
+{
+    uint32_t r = 1;
+    while (n-- > 0)
+        r = (r & 0x80000000) ? (r << 1) ^ TS_CRC32_POLY : r << 1;
+    return r;
+}
+
+CRC32_TABLES::CRC32_TABLES()
+{
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b << 24;
+        for (int32_t i = 0; i < 8; i++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ TS_CRC32_POLY : crc << 1;
+        slice[0][b] = crc;
+    }
+    for (int32_t k = 1; k < 8; k++)
+        for (uint32_t b = 0; b < 256; b++)
+            slice[k][b] = (slice[k - 1][b] << 8) ^ slice[0][slice[k - 1][b] >> 24];
+
+    fold128[0] = xPowMod(128);
+    fold128[1] = xPowMod(128 + 64);
+    fold512[0] = xPowMod(512);
+    fold512[1] = xPowMod(512 + 64);
+
+    kernel = tsCrc32Slice8;
+#if defined (TS_HAVE_PCLMUL)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+        kernel = crc32Pclmul;
+#endif
+}
+
+static const CRC32_TABLES& tables()
+{
+    static const CRC32_TABLES t;
+    return t;
+}
+
+////////////////////////////////////////////////////////////////////
+uint32_t tsCrc32Slice8(const uint8_t* data, size_t len, uint32_t crc)
+{
+    const auto& t = tables().slice;
+
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        crc ^= (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+            (static_cast<uint32_t>(data[2]) << 8) | data[3];
+        crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff] ^ t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff] ^
+            t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+
+    while (len--)
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    return crc;
+}
+
+#if defined (TS_HAVE_PCLMUL)
+// The CRC of the message equals the CRC (from zero) of any 128-bit value
+// congruent to it modulo P, so 16 byte blocks are folded with carry-less
+// multiplications and only the last 16 bytes and the tail go through the
+// table. Blocks are byte-reversed so that bit i holds x^i.
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i load(const uint8_t* p, __m128i swap)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), swap);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i fold(__m128i x, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)), next);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32Pclmul(const uint8_t* data, size_t len, uint32_t crc)
+{
+    if (len < TS_CRC32_FOLD_MIN)
+        return tsCrc32Slice8(data, len, crc);
+
+    const auto& t = tables();
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k128 = _mm_set_epi64x(static_cast<int64_t>(t.fold128[1]), static_cast<int64_t>(t.fold128[0]));
+    const __m128i k512 = _mm_set_epi64x(static_cast<int64_t>(t.fold512[1]), static_cast<int64_t>(t.fold512[0]));
+
+    // the running CRC is xored into the first 32 message bits
+    __m128i x0 = _mm_xor_si128(load(data, swap), _mm_set_epi32(static_cast<int32_t>(crc), 0, 0, 0));
+    __m128i x1 = load(data + 16, swap);
+    __m128i x2 = load(data + 32, swap);
+    __m128i x3 = load(data + 48, swap);
+    data += 64;
+    len -= 64;
+
+    for (; len >= 64; len -= 64, data += 64)
+    {
+        x0 = fold(x0, k512, load(data, swap));
+        x1 = fold(x1, k512, load(data + 16, swap));
+        x2 = fold(x2, k512, load(data + 32, swap));
+        x3 = fold(x3, k512, load(data + 48, swap));
+    }
+
+    x0 = fold(x0, k128, x1);
+    x0 = fold(x0, k128, x2);
+    x0 = fold(x0, k128, x3);
+
+    for (; len >= 16; len -= 16, data += 16)
+        x0 = fold(x0, k128, load(data, swap));
+
+    alignas(16) uint8_t rest[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(rest), _mm_shuffle_epi8(x0, swap));
+    crc = tsCrc32Slice8(rest, sizeof(rest), 0);
+    return tsCrc32Slice8(data, len, crc);
+}
+#endif
+
+uint32_t tsCrc32(const uint8_t* data, size_t len, uint32_t crc)
+{
+    return tables().kernel(data, len, crc);
+}
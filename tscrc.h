@@ -0,0 +1,21 @@
+#ifndef TSCRC_H
+#define TSCRC_H
+
+#include "tssplit_global.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#define TS_CRC32_INIT   (0xffffffffU)
+
+// MPEG-2 CRC32 (polynomial 0x04c11db7, MSB first, no final xor) as used by
+// the PSI/SI sections. Continue a CRC by passing the previous result; over a
+// complete section including its CRC32 field the result is 0.
+// Carry-less multiply folding where the CPU has PCLMULQDQ, slice-by-8
+// otherwise.
+TSSPLIT_EXPORT uint32_t tsCrc32(const uint8_t* data, size_t len, uint32_t crc = TS_CRC32_INIT);
+
+// table driven implementation, exposed for the benchmarks
+TSSPLIT_EXPORT uint32_t tsCrc32Slice8(const uint8_t* data, size_t len, uint32_t crc = TS_CRC32_INIT);
+
+#endif // TSCRC_H
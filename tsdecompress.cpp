@@ -0,0 +1,580 @@
+#include "tsdecompress.h"
+#include "tsbudget.h"
+#include "tsfileio.h"
+#include "tstrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined (TSSPLIT_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined (TSSPLIT_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#define GZIP_MAGIC              (0x8b1f)
+#define ZSTD_MAGIC              (0xfd2fb528)
+// seekable format: skippable frame holding the seek table, footer magic
+#define ZSTD_SEEKTABLE_MAGIC    (0x184d2a5e)
+#define ZSTD_SEEKABLE_MAGIC     (0x8f92eab1)
+#define ZSTD_SEEKTABLE_FOOTER   (9)
+
+static uint32_t readLE32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static bool endsWith(const std::string& s, const char* suffix)
+{
+    auto n = strlen(suffix);
+    return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+////////////////////////////////////////////////////////////////////
+TsDecompressInput::TsDecompressInput(const std::string& path, int32_t threads)
+    : path_(path),
+    compression_(compression(path)),
+    threads_(threads > 0 ? threads : TS_DECOMPRESS_THREADS),
+    fd_(-1),
+    size_(-1),
+    queued_(0),
+    ahead_(TS_DECOMPRESS_AHEAD),
+    next_(0),
+    claimed_(0),
+    count_(-1),
+    errorIndex_(-1),
+    error_(0),
+    stop_(false),
+    offset_(0),
+    memory_(nullptr),
+    charged_(0)
+{
+}
+
+TsDecompressInput::~TsDecompressInput()
+{
+    close();
+}
+
+TS_COMPRESSION TsDecompressInput::compression(const std::string& path)
+{
+    if (endsWith(path, ".gz"))
+        return TS_COMPRESSION_GZIP;
+    if (endsWith(path, ".zst"))
+        return TS_COMPRESSION_ZSTD;
+    return TS_COMPRESSION_NONE;
+}
+
+bool TsDecompressInput::open()
+{
+    close();
+
+    if ((fd_ = TS_OPEN(path_.c_str())) < 0)
+    {
+        error_ = errno;
+        return false;
+    }
+
+    // the content decides, the name only selected this input
+    uint8_t magic[4];
+    TS_STAT st;
+    bool regular = TS_FSTAT(fd_, &st) == 0 && TS_IS_SEEKABLE(st.st_mode);
+    if (TS_READ(fd_, magic, sizeof(magic)) != static_cast<int>(sizeof(magic)) || (regular && TS_SEEK(fd_, 0) < 0))
+        error_ = EINVAL;
+    else if (compression_ == TS_COMPRESSION_GZIP && (magic[0] | (magic[1] << 8)) != GZIP_MAGIC)
+        error_ = EINVAL;
+    else if (compression_ == TS_COMPRESSION_ZSTD && readLE32(magic) != ZSTD_MAGIC)
+        error_ = EINVAL;
+#if !defined (TSSPLIT_HAVE_ZLIB)
+    else if (compression_ == TS_COMPRESSION_GZIP)
+        error_ = ENOSYS;
+#endif
+#if !defined (TSSPLIT_HAVE_ZSTD)
+    else if (compression_ == TS_COMPRESSION_ZSTD)
+        error_ = ENOSYS;
+#endif
+    if (error_ != 0 || !regular)
+    {
+        // a pipe is already past the magic
+        if (error_ == 0)
+            error_ = ESPIPE;
+        TS_CLOSE(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    setLookback(TS_INPUT_LOOKBACK);
+    stop_ = false;
+    if (compression_ == TS_COMPRESSION_GZIP)
+    {
+        workers_.emplace_back(&TsDecompressInput::runGzip, this);
+    }
+    else if (readSeekTable(static_cast<int64_t>(st.st_size)))
+    {
+        // a decoded frame and one being decoded per thread
+        ahead_ = 2 * threads_;
+        count_ = static_cast<int64_t>(frames_.size());
+        for (int32_t i = 0; i < threads_; i++)
+            workers_.emplace_back(&TsDecompressInput::runZstdFrames, this);
+    }
+    else
+    {
+        // back from looking for the seek table
+        TS_SEEK(fd_, 0);
+        workers_.emplace_back(&TsDecompressInput::runZstdStream, this);
+    }
+    return true;
+}
+
+void TsDecompressInput::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stop_ = true;
+    }
+    ready_.notify_all();
+    room_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+    workers_.clear();
+
+    if (fd_ >= 0)
+    {
+        TS_CLOSE(fd_);
+        fd_ = -1;
+    }
+    frames_.clear();
+    chunks_.clear();
+    queued_ = 0;
+    std::vector<uint8_t>().swap(current_);
+    offset_ = 0;
+    account(0);
+    size_ = -1;
+    ahead_ = TS_DECOMPRESS_AHEAD;
+    next_ = claimed_ = 0;
+    count_ = errorIndex_ = -1;
+    error_ = 0;
+    errorText_.clear();
+    releaseBuffer();
+}
+
+int64_t TsDecompressInput::size() const
+{
+    return size_;
+}
+
+std::string TsDecompressInput::name() const
+{
+    return path_;
+}
+
+std::string TsDecompressInput::errorString() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!errorText_.empty())
+        return errorText_;
+    return error_ ? std::string(strerror(error_)) : std::string();
+}
+
+void TsDecompressInput::setMemoryAccount(TsMemoryAccount* account)
+{
+    this->account(0);
+    memory_ = account;
+}
+
+// the account follows the decoded bytes held, charged on the reading thread only
+void TsDecompressInput::account(int64_t held)
+{
+    if (memory_ != nullptr && held != charged_)
+    {
+        if (held > charged_)
+            memory_->charge(held - charged_);
+        else
+            memory_->credit(charged_ - held);
+    }
+    charged_ = held;
+}
+
+void TsDecompressInput::interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stop_ = true;
+    }
+    ready_.notify_all();
+    room_.notify_all();
+}
+
+// takes the decoded chunks in order
+int64_t TsDecompressInput::readData(uint8_t* data, int64_t len)
+{
+    while (offset_ >= current_.size())
+    {
+        std::unique_lock<std::mutex> lock(lock_);
+        if (chunks_.find(next_) == chunks_.end())
+        {
+            TS_TRACE_SPAN("io", "decompress wait");
+            ready_.wait(lock, [this] {
+                return stop_ || chunks_.find(next_) != chunks_.end() ||
+                    (count_ >= 0 && next_ >= count_) || (errorIndex_ >= 0 && next_ >= errorIndex_);
+            });
+        }
+
+        // interrupted is not the end of the stream
+        if (stop_)
+        {
+            error_ = ECANCELED;
+            return -1;
+        }
+        auto It = chunks_.find(next_);
+        if (It == chunks_.end())
+        {
+            if (count_ >= 0 && next_ >= count_)
+                return 0;
+            return -1;
+        }
+        queued_ -= static_cast<int64_t>(It->second.capacity());
+        current_.swap(It->second);
+        chunks_.erase(It);
+        offset_ = 0;
+        next_++;
+        auto held = queued_ + static_cast<int64_t>(current_.capacity());
+        lock.unlock();
+        room_.notify_all();
+        account(held);
+    }
+
+    auto n = std::min<int64_t>(len, static_cast<int64_t>(current_.size() - offset_));
+    memcpy(data, current_.data() + offset_, static_cast<size_t>(n));
+    offset_ += static_cast<size_t>(n);
+    return n;
+}
+
+bool TsDecompressInput::seekData(const int64_t&)
+{
+    return false;
+}
+
+// queues a decoded chunk, waits while the reader is too far behind
+bool TsDecompressInput::publish(int64_t index, std::vector<uint8_t>& chunk)
+{
+    {
+        std::unique_lock<std::mutex> lock(lock_);
+        room_.wait(lock, [this, index] { return stop_ || index < next_ + ahead_; });
+        if (stop_)
+            return false;
+        auto& queued = chunks_[index];
+        queued.swap(chunk);
+        queued_ += static_cast<int64_t>(queued.capacity());
+    }
+    ready_.notify_all();
+    return true;
+}
+
+void TsDecompressInput::finish(int64_t count)
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        count_ = count;
+    }
+    ready_.notify_all();
+}
+
+// the reader gets the chunks before the failed one, then the error
+void TsDecompressInput::fail(int64_t index, int error, const std::string& text)
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (errorIndex_ >= 0 && errorIndex_ <= index)
+            return;
+        errorIndex_ = index;
+        error_ = error;
+        errorText_ = text;
+    }
+    ready_.notify_all();
+}
+
+// reads at the file offset, shared by the parallel decoders
+int64_t TsDecompressInput::readAt(int64_t offset, uint8_t* data, int64_t len)
+{
+    std::lock_guard<std::mutex> lock(ioLock_);
+    if (TS_SEEK(fd_, offset) < 0)
+        return -1;
+
+    int64_t done = 0;
+    while (done < len)
+    {
+        auto ret = static_cast<int64_t>(TS_READ(fd_, data + done, len - done));
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        done += ret;
+    }
+    return done;
+}
+
+// Seek table of the zstd seekable format: a skippable frame at the end with
+// compressed and decompressed size of every frame. False without one.
+bool TsDecompressInput::readSeekTable(int64_t fileSize)
+{
+    uint8_t footer[ZSTD_SEEKTABLE_FOOTER];
+    if (fileSize < 8 + ZSTD_SEEKTABLE_FOOTER ||
+        readAt(fileSize - ZSTD_SEEKTABLE_FOOTER, footer, ZSTD_SEEKTABLE_FOOTER) != ZSTD_SEEKTABLE_FOOTER ||
+        readLE32(footer + 5) != ZSTD_SEEKABLE_MAGIC || (footer[4] & 0x7c) != 0)
+        return false;
+
+    int64_t count = readLE32(footer);
+    int64_t entrySize = (footer[4] & 0x80) ? 12 : 8;
+    int64_t tableSize = count * entrySize + ZSTD_SEEKTABLE_FOOTER;
+    if (count == 0 || tableSize + 8 > fileSize)
+        return false;
+
+    std::vector<uint8_t> table(static_cast<size_t>(tableSize + 8));
+    if (readAt(fileSize - tableSize - 8, table.data(), tableSize + 8) != tableSize + 8 ||
+        readLE32(table.data()) != ZSTD_SEEKTABLE_MAGIC || readLE32(table.data() + 4) != tableSize)
+        return false;
+
+    int64_t offset = 0;
+    int64_t size = 0;
+    std::vector<ZSTD_FRAME> frames(static_cast<size_t>(count));
+    for (int64_t i = 0; i < count; i++)
+    {
+        const uint8_t* entry = table.data() + 8 + i * entrySize;
+        frames[i].offset = offset;
+        frames[i].compressedSize = readLE32(entry);
+        frames[i].size = readLE32(entry + 4);
+        offset += frames[i].compressedSize;
+        size += frames[i].size;
+    }
+    // the frames cover the file up to the table
+    if (offset != fileSize - tableSize - 8)
+        return false;
+
+    frames_.swap(frames);
+    size_ = size;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+void TsDecompressInput::runGzip()
+{
+#if defined (TSSPLIT_HAVE_ZLIB)
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // 32: gzip header detection
+    if (inflateInit2(&z, 15 + 32) != Z_OK)
+    {
+        fail(0, ENOMEM);
+        return;
+    }
+
+    std::vector<uint8_t> in(TS_DECOMPRESS_READ);
+    std::vector<uint8_t> out(TS_DECOMPRESS_CHUNK);
+    size_t outLen = 0;
+    int64_t index = 0;
+    bool member = true;          // inside a gzip member
+    bool failed = false;
+    bool full = false;           // the last inflate filled the chunk
+
+    while (!stop_)
+    {
+        // a full chunk may leave inflated bytes in the stream: drain them first
+        if (z.avail_in == 0 && !full)
+        {
+            auto ret = static_cast<int64_t>(TS_READ(fd_, in.data(), in.size()));
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+            {
+                fail(index, errno);
+                failed = true;
+            }
+            if (ret <= 0)
+                break;
+            z.next_in = in.data();
+            z.avail_in = static_cast<uInt>(ret);
+        }
+
+        // members are concatenated, anything else after one is ignored like gzip does
+        if (!member)
+        {
+            if (z.next_in[0] != (GZIP_MAGIC & 0xff))
+                break;
+            inflateReset(&z);
+            member = true;
+        }
+
+        z.next_out = out.data() + outLen;
+        z.avail_out = static_cast<uInt>(out.size() - outLen);
+        TS_TRACE_SPAN("io", "inflate");
+        auto ret = inflate(&z, Z_NO_FLUSH);
+        outLen = out.size() - z.avail_out;
+        full = ret != Z_STREAM_END && z.avail_out == 0;
+        if (ret == Z_STREAM_END)
+            member = false;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            out.resize(outLen);
+            if (outLen > 0 && publish(index, out))
+                index++;
+            fail(index, EIO, std::string("gzip: ") + (z.msg != nullptr ? z.msg : "corrupt data"));
+            failed = true;
+            break;
+        }
+
+        if (outLen == out.size())
+        {
+            if (!publish(index++, out))
+                break;
+            out.resize(TS_DECOMPRESS_CHUNK);
+            outLen = 0;
+        }
+    }
+    inflateEnd(&z);
+
+    if (stop_ || failed)
+        return;
+    out.resize(outLen);
+    if (outLen > 0 && publish(index, out))
+        index++;
+    if (member)
+        fail(index, EIO, "gzip: unexpected end of file");
+    else
+        finish(index);
+#endif
+}
+
+// zstd without a seek table: one frame after the other on this thread
+void TsDecompressInput::runZstdStream()
+{
+#if defined (TSSPLIT_HAVE_ZSTD)
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if (stream == nullptr || ZSTD_isError(ZSTD_initDStream(stream)))
+    {
+        ZSTD_freeDStream(stream);
+        fail(0, ENOMEM);
+        return;
+    }
+
+    std::vector<uint8_t> in(ZSTD_DStreamInSize());
+    std::vector<uint8_t> out(TS_DECOMPRESS_CHUNK);
+    ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+    int64_t index = 0;
+    size_t hint = 0;             // 0: at a frame boundary
+    bool failed = false;
+
+    while (!stop_ && !failed)
+    {
+        auto ret = static_cast<int64_t>(TS_READ(fd_, in.data(), in.size()));
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0)
+        {
+            fail(index, errno);
+            failed = true;
+        }
+        if (ret <= 0)
+            break;
+
+        ZSTD_inBuffer input = { in.data(), static_cast<size_t>(ret), 0 };
+        bool full = false;
+        while (input.pos < input.size || full)
+        {
+            TS_TRACE_SPAN("io", "zstd");
+            hint = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(hint))
+            {
+                out.resize(output.pos);
+                if (output.pos > 0 && publish(index, out))
+                    index++;
+                fail(index, EIO, std::string("zstd: ") + ZSTD_getErrorName(hint));
+                failed = true;
+                break;
+            }
+            // a full buffer may leave decoded bytes in the stream
+            full = output.pos == output.size;
+            if (full)
+            {
+                if (!publish(index++, out))
+                {
+                    failed = true;
+                    break;
+                }
+                out.resize(TS_DECOMPRESS_CHUNK);
+                output.dst = out.data();
+                output.pos = 0;
+            }
+        }
+    }
+    ZSTD_freeDStream(stream);
+
+    if (stop_ || failed)
+        return;
+    out.resize(output.pos);
+    if (output.pos > 0 && publish(index, out))
+        index++;
+    if (hint != 0)
+        fail(index, EIO, "zstd: unexpected end of file");
+    else
+        finish(index);
+#endif
+}
+
+// seekable zstd: the threads take the frames in order, the reader gets them in order
+void TsDecompressInput::runZstdFrames()
+{
+#if defined (TSSPLIT_HAVE_ZSTD)
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    if (context == nullptr)
+    {
+        int64_t index;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            index = claimed_;
+        }
+        fail(index, ENOMEM);
+        return;
+    }
+
+    std::vector<uint8_t> in;
+    for (;;)
+    {
+        int64_t index;
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            room_.wait(lock, [this] { return stop_ || claimed_ < next_ + ahead_; });
+            if (stop_ || claimed_ >= count_ || (errorIndex_ >= 0 && claimed_ >= errorIndex_))
+                break;
+            index = claimed_++;
+        }
+
+        const auto& frame = frames_[static_cast<size_t>(index)];
+        in.resize(frame.compressedSize);
+        auto read = readAt(frame.offset, in.data(), frame.compressedSize);
+        if (read != frame.compressedSize)
+        {
+            fail(index, read < 0 ? errno : EIO, read < 0 ? std::string() : "zstd: unexpected end of file");
+            break;
+        }
+
+        std::vector<uint8_t> out(frame.size);
+        size_t ret;
+        {
+            TS_TRACE_SPAN("io", "zstd");
+            ret = ZSTD_decompressDCtx(context, out.data(), out.size(), in.data(), in.size());
+        }
+        if (ZSTD_isError(ret) || ret != frame.size)
+        {
+            fail(index, EIO, std::string("zstd: ") + (ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "frame size differs from the seek table"));
+            break;
+        }
+        if (!publish(index, out))
+            break;
+    }
+    ZSTD_freeDCtx(context);
+#endif
+}
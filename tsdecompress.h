@@ -0,0 +1,129 @@
+#ifndef TSDECOMPRESS_H
+#define TSDECOMPRESS_H
+
+#include "tsinput.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// decoded bytes handed to the reader at once (streaming decoders)
+#define TS_DECOMPRESS_CHUNK     (1024 * 1024)
+// compressed bytes read per call
+#define TS_DECOMPRESS_READ      (256 * 1024)
+// decoder threads of a zstd file with a seek table
+#define TS_DECOMPRESS_THREADS   (4)
+// decoded chunks a streaming decoder runs ahead of the reader
+#define TS_DECOMPRESS_AHEAD     (4)
+
+class TsMemoryAccount;
+
+enum TS_COMPRESSION
+{
+    TS_COMPRESSION_NONE = 0,
+    TS_COMPRESSION_GZIP,
+    TS_COMPRESSION_ZSTD
+};
+
+///////////////////////////////////////////////////////////
+// Compressed transport stream file (.ts.gz, .ts.zst) decoded on its own
+// threads while the demuxer parses: decoded chunks are queued in order and
+// served through the read buffer of TsInput, forward only.
+// gzip (zlib, also multi member files) and zstd without a seek table are
+// decoded by one streaming thread. A zstd file in the seekable format (seek
+// table in a skippable frame at the end, e.g. written by pzstd/t2sz) has its
+// frames decoded in parallel.
+// Built without zlib (TSSPLIT_HAVE_ZLIB) or libzstd (TSSPLIT_HAVE_ZSTD) the
+// respective files fail to open with ENOSYS.
+class TSSPLIT_EXPORT TsDecompressInput : public TsInput
+{
+public:
+    // threads: decoders of a seekable zstd file, 0: default
+    TsDecompressInput(const std::string& path, int32_t threads = 0);
+    ~TsDecompressInput() override;
+
+    // by the file name extension
+    static TS_COMPRESSION compression(const std::string& path);
+    static inline bool isCompressed(const std::string& path)
+    {
+        return compression(path) != TS_COMPRESSION_NONE;
+    }
+
+    bool open() override;
+    void close() override;
+    // decoded size when the zstd seek table tells, -1 otherwise
+    int64_t size() const override;
+    std::string name() const override;
+    std::string errorString() const override;
+    void interrupt() override;
+
+    // decoded chunks queued for the reader and the one being read are charged
+    // to the account of the job, by the reading thread
+    void setMemoryAccount(TsMemoryAccount* account);
+
+    // frames are decoded in parallel
+    inline bool isParallel() const
+    {
+        return !frames_.empty();
+    }
+
+protected:
+    int64_t readData(uint8_t* data, int64_t len) override;
+    bool seekData(const int64_t& position) override;
+
+private:
+    // decoder threads
+    void runGzip();
+    void runZstdStream();
+    void runZstdFrames();
+
+    bool readSeekTable(int64_t fileSize);
+    int64_t readAt(int64_t offset, uint8_t* data, int64_t len);
+    bool publish(int64_t index, std::vector<uint8_t>& chunk);
+    void finish(int64_t count);
+    void fail(int64_t index, int error, const std::string& text = std::string());
+    void account(int64_t held);
+
+    struct ZSTD_FRAME
+    {
+        int64_t  offset;         // in the file
+        uint32_t compressedSize;
+        uint32_t size;
+    };
+
+    std::string path_;
+    TS_COMPRESSION compression_;
+    int32_t threads_;
+    int     fd_;
+    std::mutex ioLock_;          // fd_ position of the parallel decoders
+    std::vector<ZSTD_FRAME> frames_;
+    int64_t size_;
+    std::vector<std::thread> workers_;
+
+    // guards the queue and the state below
+    mutable std::mutex lock_;
+    std::condition_variable ready_;     // a chunk for the reader
+    std::condition_variable room_;      // the reader took one
+    std::map<int64_t, std::vector<uint8_t>> chunks_;
+    int64_t queued_;             // capacity of the chunks
+    int64_t ahead_;              // chunks decoded ahead of the reader at most
+    int64_t next_;               // chunk the reader takes next
+    int64_t claimed_;            // parallel: next frame to decode
+    int64_t count_;              // chunks in total, -1 while decoding
+    int64_t errorIndex_;         // the chunk that failed, -1: none
+    int     error_;
+    std::string errorText_;
+    std::atomic<bool> stop_;
+
+    // chunk being read
+    std::vector<uint8_t> current_;
+    size_t  offset_;
+    TsMemoryAccount* memory_;
+    int64_t charged_;            // queued and current chunks at the last read
+};
+
+#endif // TSDECOMPRESS_H
@@ -0,0 +1,316 @@
+#include "tsdemuxer.h"
+#include "tscontext.h"
+#include "tstrace.h"
+#include "tsprobes.h"
+
+////////////////////////////////////////////////////////////////////
+TsDemuxer::TsDemuxer(TsInput& input, uint16_t channel)
+    : TsDemuxer(input, nullptr, channel)
+{
+}
+
+TsDemuxer::TsDemuxer(TsInput& input, TsFrameSink& sink, uint16_t channel)
+    : TsDemuxer(input, &sink, channel)
+{
+}
+
+TsDemuxer::TsDemuxer(TsInput& input, TsFrameSink* sink, uint16_t channel)
+    : sink_(sink),
+    packetSink_(nullptr),
+    AVContext_(new AVContext(input, 0, channel, &arena_)),
+    mainStreamPID_(0xffff),
+    absDTS_(PTS_UNSET),
+    absPTS_(PTS_UNSET),
+    pinTime_(0),
+    curTime_(0),
+    endTime_(0),
+    packets_(0),
+    position_(0),
+    result_(AVCONTEXT_CONTINUE),
+    patVersions_(0),
+    inputBuffer_(input.bufferSize()),
+    pendingPayload_(false),
+    done_(false),
+    positionMap_(std::less<int64_t>(), &arena_),
+    cancel_(false)
+{
+    arena_.setAccount(&memory_);
+}
+
+TsDemuxer::~TsDemuxer()
+{
+    release();
+}
+
+void TsDemuxer::release()
+{
+    if (!AVContext_)
+        return;
+
+    position_ = AVContext_->getPosition();
+    batch_.clear();
+    pendingPayload_ = false;
+    done_ = true;
+    AVContext_.reset();
+    positionMap_.clear();
+    arena_.release();
+
+    memory_.setReading(false);
+    memory_.credit(inputBuffer_);
+    inputBuffer_ = 0;
+}
+
+void TsDemuxer::cancel()
+{
+    cancel_ = true;
+}
+
+int64_t TsDemuxer::getPosition() const
+{
+    return AVContext_ ? AVContext_->getPosition() : position_;
+}
+
+void TsDemuxer::setLowLatency(bool enabled)
+{
+    if (AVContext_)
+        AVContext_->setLowLatency(enabled);
+}
+
+void TsDemuxer::setPacketSink(TsPacketSink* sink)
+{
+    packetSink_ = sink;
+}
+
+void TsDemuxer::stopStream(uint16_t pid)
+{
+    if (AVContext_)
+        AVContext_->stopStreaming(pid);
+}
+
+const STREAM_INFO* TsDemuxer::getStreamInfo(uint16_t pid) const
+{
+    if (!AVContext_)
+        return nullptr;
+    auto es = AVContext_->getStream(pid);
+    return (es == nullptr || !es->hasStreamInfo_ ? nullptr : &es->streamInfo_);
+}
+
+int32_t TsDemuxer::process()
+{
+    TsStatsScope statsScope(stats_);
+    TS_TRACE_SPAN("demux", "process");
+    TsFrameBatch batch;
+    while (next(batch))
+    {
+        if (sink_ == nullptr)
+            continue;
+
+        for (auto& pkg : batch)
+        {
+            TS_STAT_TIMER(TS_STAT_TIMER_WRITE);
+            TS_TRACE_SPAN_PID("sink", "write", pkg.pid);
+            // a batch holds frames of a single PID
+            if (!sink_->writeFrame(pkg))
+            {
+                AVContext_->stopStreaming(pkg.pid);
+                break;
+            }
+        }
+    }
+    return result_;
+}
+
+// The frames point into the buffer of the elementary stream, which the payload
+// of the current packet is appended to. The payload is therefore processed on
+// the following call only. Frames of a PES completed by the payload (low
+// latency) are returned right after it.
+bool TsDemuxer::next(TsFrameBatch& batch)
+{
+    TsStatsScope statsScope(stats_);
+    TS_TRACE_SPAN("demux", "demux");
+    batch_.clear();
+    if (pendingPayload_)
+    {
+        pendingPayload_ = false;
+        processPayload();
+    }
+
+    // the read buffer is allocated on the first read
+    if (!done_ && !memory_.reading())
+    {
+        memory_.setReading(true);
+        memory_.charge(inputBuffer_);
+    }
+
+    while (!done_ && batch_.empty())
+    {
+        if (cancel_.load(std::memory_order_relaxed))
+        {
+            done_ = true;
+            break;
+        }
+
+        result_ = AVContext_->TSResync();
+        if (result_ != AVCONTEXT_CONTINUE)
+        {
+            done_ = true;
+            break;
+        }
+
+        result_ = AVContext_->processTSPackage();
+        if (packetSink_ != nullptr)
+            packetSink_->writePacket(AVContext_->getPacket(), AVContext_->getPID());
+        if ((++packets_ & TS_PROGRESS_INTERVAL_MASK) == 0)
+        {
+            if (sink_ != nullptr)
+                sink_->progress(AVContext_->getPosition());
+            // backpressure: hold the reader while the memory budget is exhausted
+            memory_.throttle(cancel_);
+        }
+
+        if (AVContext_->hasPIDStreamData())
+            collectFrames();
+
+        if (!batch_.empty())
+        {
+            pendingPayload_ = true;
+            break;
+        }
+        processPayload();
+    }
+
+    if (done_)
+        memory_.setReading(false);
+
+    batch = TsFrameBatch(batch_.data(), batch_.size());
+    return !batch_.empty();
+}
+
+void TsDemuxer::collectFrames()
+{
+    STREAM_PKG pkg;
+    while (getStreamData(&pkg))
+    {
+        if (pkg.streamChange)
+            showStreamInfo(pkg.pid);
+        if (pkg.size > 0 && pkg.data)
+        {
+            TS_STAT_FRAME(pkg.pid, static_cast<uint64_t>(pkg.size));
+            batch_.push_back(pkg);
+        }
+    }
+}
+
+void TsDemuxer::processPayload()
+{
+    if (AVContext_->hasPIDPayload())
+    {
+        result_ = AVContext_->processTSPayload();
+        // a new PAT announces the PMT PIDs before their tables arrive
+        if (packetSink_ != nullptr &&
+            (result_ == AVCONTEXT_PROGRAM_CHANGE || AVContext_->getPatVersions() != patVersions_))
+        {
+            patVersions_ = AVContext_->getPatVersions();
+            packetSink_->programs(AVContext_->getPrograms());
+        }
+
+        if (result_ == AVCONTEXT_STREAM_PID_DATA)
+            collectFrames();
+        else if (result_ == AVCONTEXT_PROGRAM_CHANGE)
+        {
+            registerPmt();
+            for (auto stream : streams_)
+            {
+                if (stream->hasStreamInfo_)
+                    showStreamInfo(stream->pid_);
+            }
+        }
+    }
+
+    if (result_ == AVCONTEXT_TS_ERROR)
+        AVContext_->shift();
+    else
+        AVContext_->goNext();
+}
+
+bool TsDemuxer::getStreamData(STREAM_PKG* pkg)
+{
+    TS_STAT_TIMER(TS_STAT_TIMER_STREAM_DATA);
+    auto traceStart = TS_TRACE_NOW();
+    TsStream* es = AVContext_->getPIDStream();
+    if (es == nullptr)
+        return false;
+
+    if (!es->getStreamPackage(pkg))
+        return false;
+    TS_TRACE_RECORD("parse", es->getStreamCodec(), traceStart, pkg->pid);
+    TS_PROBE4(frame, pkg->pid, pkg->size, pkg->pts, pkg->duration);
+
+    if (pkg->duration > 180000)
+    {
+        pkg->duration = 0;
+    }
+    else if (pkg->pid == mainStreamPID_)
+    {
+        // Fill duration map for main stream
+        curTime_ += pkg->duration;
+        if (curTime_ >= pinTime_)
+        {
+            pinTime_ += POSMAP_PTS_INTERVAL;
+            if (curTime_ > endTime_)
+            {
+                AV_POSMAP_ITEM item;
+                item.avPts = pkg->pts;
+                item.avPos = AVContext_->getPosition();
+                positionMap_.emplace(curTime_, item);
+                endTime_ = curTime_;
+            }
+        }
+
+        // Sync main DTS & PTS
+        absDTS_ = pkg->dts;
+        absPTS_ = pkg->pts;
+    }
+    return true;
+}
+
+void TsDemuxer::resetPosmap()
+{
+    if (!positionMap_.empty())
+    {
+        positionMap_.clear();
+        pinTime_ = curTime_ = endTime_ = 0;
+    }
+}
+
+// The sink decides which streams of the new program map are streamed, all of
+// them when pulled
+void TsDemuxer::registerPmt()
+{
+    AVContext_->getStreams(streams_);
+
+    if (streams_.empty())
+        return;
+
+    mainStreamPID_ = streams_[0]->pid_;
+
+    for (auto stream : streams_)
+    {
+        auto channel = AVContext_->getChannel(stream->pid_);
+        if (sink_ == nullptr || sink_->openStream(stream->pid_, channel, stream->streamType_))
+            AVContext_->startStreaming(stream->pid_);
+    }
+}
+
+void TsDemuxer::showStreamInfo(uint16_t pid)
+{
+    auto es = AVContext_->getStream(pid);
+    if (es == nullptr)
+        return;
+
+    es->streamInfo_.pid = pid;
+    es->streamInfo_.channel = AVContext_->getChannel(pid);
+    strncpy(es->streamInfo_.codecName, es->getStreamCodec(), sizeof(es->streamInfo_.codecName) - 1);
+    if (sink_ != nullptr)
+        sink_->streamInfo(es->streamInfo_);
+}
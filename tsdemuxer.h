@@ -0,0 +1,238 @@
+#ifndef TSDEMUXER_H
+#define TSDEMUXER_H
+
+#include "tsstream.h"
+#include "tsinput.h"
+#include "tsstats.h"
+#include "tsbudget.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+#define POSMAP_PTS_INTERVAL  (270000LL)
+
+// sink progress is reported every 1024 packets
+#define TS_PROGRESS_INTERVAL_MASK   (1023)
+
+///////////////////////////////////////////////////////////
+// Receiver of the demuxed elementary streams. Called on the thread running
+// TsDemuxer::process().
+class TSSPLIT_EXPORT TsFrameSink
+{
+public:
+    virtual ~TsFrameSink() {}
+
+    // The program map announces the stream. Return true to receive its frames.
+    virtual bool openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType) = 0;
+    // Stream information is known or has changed
+    virtual void streamInfo(const STREAM_INFO&) {}
+    // Return false to stop streaming the PID
+    virtual bool writeFrame(const STREAM_PKG& pkg) = 0;
+    // Absolute position in the input
+    virtual void progress(int64_t) {}
+};
+
+///////////////////////////////////////////////////////////
+// Receiver of whole TS packets next to the frames, e.g. a remuxer. Called on
+// the thread running the demuxer.
+class TSSPLIT_EXPORT TsPacketSink
+{
+public:
+    virtual ~TsPacketSink() {}
+
+    // The PAT or a PMT changed: programs of the demuxed channel(s)
+    virtual void programs(const std::vector<TS_PROGRAM>& programs) = 0;
+    // Every synced packet (188 bytes) before its payload is parsed, null
+    // packets included
+    virtual void writePacket(const uint8_t* packet, uint16_t pid) = 0;
+};
+
+///////////////////////////////////////////////////////////
+// Frames completed by one TS packet. The views (and the frame data) stay
+// valid until the demuxer is resumed.
+class TsFrameBatch
+{
+public:
+    TsFrameBatch() : frames_(nullptr), count_(0) {}
+    TsFrameBatch(const STREAM_PKG* frames, size_t count) : frames_(frames), count_(count) {}
+
+    inline const STREAM_PKG* begin() const { return frames_; }
+    inline const STREAM_PKG* end() const { return frames_ + count_; }
+    inline size_t size() const { return count_; }
+    inline bool empty() const { return count_ == 0; }
+    inline const STREAM_PKG& operator[](size_t i) const { return frames_[i]; }
+
+private:
+    const STREAM_PKG* frames_;
+    size_t count_;
+};
+
+///////////////////////////////////////////////////////////
+class AVContext;
+class TsFrameRange;
+
+class TSSPLIT_EXPORT TsDemuxer
+{
+public:
+    // Without a sink every stream of the program map is demuxed
+    TsDemuxer(TsInput& input, uint16_t channel = 0);
+    TsDemuxer(TsInput& input, TsFrameSink& sink, uint16_t channel = 0);
+    ~TsDemuxer();
+
+    // Push: demux until the end of the input, an error or cancel(), handing
+    // the frames to the sink. Returns the AVCONTEXT_* code that ended the run.
+    int32_t process();
+    void cancel();
+
+    // Pull: demux until the next batch of frames, false at the end of the
+    // input. The previous batch is invalidated.
+    //     for (auto& batch : demuxer.frames())
+    //         for (auto& pkg : batch) ...
+    bool next(TsFrameBatch& batch);
+    inline TsFrameRange frames();
+    // AVCONTEXT_* code that ended the run
+    inline int32_t result() const
+    {
+        return result_;
+    }
+
+    // Hands out a frame as soon as its PES is complete by PES_packet_length
+    // and a video access unit once the next PES of the PID starts a new one,
+    // instead of on the next unit start of the PID. Set before the run.
+    void setLowLatency(bool enabled);
+    // Whole packets are handed to the sink as well. Set before the run.
+    void setPacketSink(TsPacketSink* sink);
+
+    // Stop delivering frames of the PID
+    void stopStream(uint16_t pid);
+    // Last known information of the stream, see STREAM_PKG::streamChange
+    const STREAM_INFO* getStreamInfo(uint16_t pid) const;
+
+    // Per stage counters, collected while TsStats::enabled()
+    inline const TsStats& stats() const
+    {
+        return stats_;
+    }
+
+    // Share of the job in TsMemoryBudget::global(): read buffer and parse
+    // state. Sinks may charge their own buffers to it.
+    inline TsMemoryAccount& memory()
+    {
+        return memory_;
+    }
+    inline const TsMemoryAccount& memory() const
+    {
+        return memory_;
+    }
+
+    // Drops the whole parse state (streams, buffers, tables) in one step and
+    // recycles its memory for the next demuxer of the calling thread. The run
+    // can not be resumed; position, packets and stats stay available.
+    void release();
+
+    int64_t getPosition() const;
+    inline int64_t getPackets() const
+    {
+        return packets_;
+    }
+
+private:
+    TsDemuxer(TsInput& input, TsFrameSink* sink, uint16_t channel);
+    TsDemuxer(const TsDemuxer&);
+    TsDemuxer& operator=(const TsDemuxer&);
+
+    bool getStreamData(STREAM_PKG* pkg);
+    void collectFrames();
+    void processPayload();
+    void resetPosmap();
+    void registerPmt();
+    void showStreamInfo(uint16_t pid);
+
+private:
+    TsFrameSink* sink_;         // null when pulled
+    TsPacketSink* packetSink_;
+
+    // charged by the arena, declared before it
+    TsMemoryAccount memory_;
+    // owner of the parse state, declared first to go last
+    TsArena arena_;
+    // playback context, null once released
+    std::unique_ptr<AVContext> AVContext_;
+
+    uint16_t mainStreamPID_;     // PID of main stream
+    std::vector<TsStream*> streams_;    // of the program map, see registerPmt()
+    int64_t  absDTS_;            // absolute decode time of main stream
+    int64_t  absPTS_;            // absolute presentation time of main stream
+    int64_t  pinTime_;           // pinned relative position (90Khz)
+    int64_t  curTime_;           // current relative position (90Khz)
+    int64_t  endTime_;           // last relative marked position (90Khz))
+    int64_t  packets_;           // processed TS packets
+    int64_t  position_;          // position when released
+    int32_t  result_;            // last AVCONTEXT_* code
+    uint32_t patVersions_;       // PAT versions the packet sink was told about
+    int32_t  inputBuffer_;       // read buffer charged while reading, 0 when not
+    bool     pendingPayload_;    // payload of the current packet is held until resumed
+    bool     done_;
+
+    std::vector<STREAM_PKG> batch_;
+    TsStats stats_;
+
+    struct AV_POSMAP_ITEM
+    {
+        int64_t avPts;
+        int64_t avPos;
+    };
+
+    std::map<int64_t, AV_POSMAP_ITEM, std::less<int64_t>,
+        TsArenaAllocator<std::pair<const int64_t, AV_POSMAP_ITEM>>> positionMap_;
+    std::atomic<bool> cancel_;
+};
+
+///////////////////////////////////////////////////////////
+// Single pass range of frame batches
+class TsFrameRange
+{
+public:
+    class iterator
+    {
+    public:
+        iterator() : demuxer_(nullptr) {}
+        explicit iterator(TsDemuxer* demuxer) : demuxer_(demuxer)
+        {
+            ++*this;
+        }
+
+        inline const TsFrameBatch& operator*() const { return batch_; }
+        inline const TsFrameBatch* operator->() const { return &batch_; }
+        inline bool operator==(const iterator& other) const { return demuxer_ == other.demuxer_; }
+        inline bool operator!=(const iterator& other) const { return demuxer_ != other.demuxer_; }
+
+        inline iterator& operator++()
+        {
+            if (demuxer_ && !demuxer_->next(batch_))
+                demuxer_ = nullptr;
+            return *this;
+        }
+
+    private:
+        TsDemuxer*   demuxer_;
+        TsFrameBatch batch_;
+    };
+
+    explicit TsFrameRange(TsDemuxer& demuxer) : demuxer_(demuxer) {}
+
+    inline iterator begin() { return iterator(&demuxer_); }
+    inline iterator end() { return iterator(); }
+
+private:
+    TsDemuxer& demuxer_;
+};
+
+inline TsFrameRange TsDemuxer::frames()
+{
+    return TsFrameRange(*this);
+}
+
+#endif // TSDEMUXER_H
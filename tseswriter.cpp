@@ -0,0 +1,293 @@
+#include "tseswriter.h"
+#include "tsbudget.h"
+#include "tsworkers.h"
+#include "tsstats.h"
+#include "tsprobes.h"
+#include "tstrace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#if defined (TSSPLIT_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+// compressed output of a PID, the workers fill done
+struct TsEsWriter::ZSTD_OUTPUT
+{
+    struct BLOCK
+    {
+        std::vector<uint8_t> data;
+        int64_t charged;            // capacities of the raw block and of data
+    };
+
+    int32_t level;
+    std::vector<uint8_t> block;     // frames of the next zstd frame
+    int64_t reserved;               // capacity of block charged to the account
+    int64_t submitted;              // blocks handed to the workers
+    int64_t written;                // blocks written, the next one to write
+    std::mutex lock;                // guards done and error
+    std::map<int64_t, BLOCK> done;
+    std::string error;
+};
+
+TsEsWriter::TsEsWriter(const std::string& outputDir, const std::string& baseName)
+    : outputDir_(outputDir),
+    baseName_(baseName),
+    threads_(0),
+    memory_(nullptr)
+{
+}
+
+TsEsWriter::~TsEsWriter()
+{
+    close();
+}
+
+void TsEsWriter::setPidFilter(const std::set<uint16_t>& pids)
+{
+    pidFilter_ = pids;
+}
+
+void TsEsWriter::setCompression(const std::map<STREAM_TYPE, int32_t>& levels, int32_t threads)
+{
+    levels_ = levels;
+    threads_ = threads;
+}
+
+void TsEsWriter::setMemoryAccount(TsMemoryAccount* account)
+{
+    memory_ = account;
+}
+
+void TsEsWriter::close()
+{
+    // the last blocks, then the compressed ones in order
+    for (auto& item : files_)
+    {
+        if (item.second.zstd && !item.second.zstd->block.empty())
+            submitBlock(item.second);
+    }
+    if (pool_)
+        pool_->wait();
+
+    for (auto& item : files_)
+    {
+        auto& zstd = item.second.zstd;
+        if (zstd)
+        {
+            writeBlocks(item.first, item.second);
+            // not written after an error
+            for (auto& block : zstd->done)
+            {
+                if (memory_ != nullptr)
+                    memory_->credit(block.second.charged);
+            }
+            if (memory_ != nullptr)
+                memory_->credit(zstd->reserved);
+        }
+        fclose(item.second.file);
+    }
+    files_.clear();
+
+    pool_.reset();
+#if defined (TSSPLIT_HAVE_ZSTD)
+    for (auto context : contexts_)
+        ZSTD_freeCCtx(context);
+#endif
+    contexts_.clear();
+}
+
+int32_t TsEsWriter::compressionLevel(STREAM_TYPE streamType) const
+{
+    auto It = levels_.find(streamType);
+    if (It == levels_.end())
+        It = levels_.find(STREAM_TYPE_UNKNOWN);
+    return It != levels_.end() ? It->second : 0;
+}
+
+bool TsEsWriter::openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType)
+{
+    if (files_.find(pid) != files_.end())
+        return true;
+
+    if (!pidFilter_.empty() && pidFilter_.find(pid) == pidFilter_.end())
+        return false;
+
+    auto level = compressionLevel(streamType);
+    auto name = outputDir_ + "/" + baseName_ + "_stream_" + std::to_string(channel) + "_" +
+        std::to_string(pid) + "_" + TsStream::getStreamCodecName(streamType) +
+        TsStream::getFileExtension(streamType) + (level != 0 ? ".zst" : "");
+
+#if !defined (TSSPLIT_HAVE_ZSTD)
+    if (level != 0)
+    {
+        error_ = "Unable to open\n " + name + " \n zstd compression is not built in";
+        return false;
+    }
+#else
+    if (level != 0 && !pool_)
+    {
+        auto threads = threads_ > 0 ? threads_ : TS_ES_ZSTD_THREADS;
+        for (int32_t i = 0; i < threads; i++)
+        {
+            auto context = ZSTD_createCCtx();
+            if (context == nullptr)
+            {
+                for (auto created : contexts_)
+                    ZSTD_freeCCtx(created);
+                contexts_.clear();
+                error_ = "Unable to open\n " + name + " \n zstd: " + strerror(ENOMEM);
+                return false;
+            }
+            contexts_.push_back(context);
+        }
+        pool_.reset(new TsWorkerPool(threads));
+    }
+#endif
+
+    auto file = fopen(name.c_str(), "wb");
+    if (file == nullptr)
+    {
+        error_ = "Unable to open\n " + name + " \n " + strerror(errno);
+        return false;
+    }
+
+    OUTPUT_FILE& output = files_[pid];
+    output.file = file;
+    output.name = name;
+#if defined (TSSPLIT_HAVE_ZSTD)
+    if (level != 0)
+    {
+        output.zstd = std::make_shared<ZSTD_OUTPUT>();
+        output.zstd->level = level;
+        output.zstd->submitted = 0;
+        output.zstd->written = 0;
+        output.zstd->reserved = 0;
+    }
+#endif
+    return true;
+}
+
+// hands the collected frames to a worker
+void TsEsWriter::submitBlock(OUTPUT_FILE& output)
+{
+#if defined (TSSPLIT_HAVE_ZSTD)
+    auto zstd = output.zstd;
+    auto index = zstd->submitted++;
+    auto raw = std::make_shared<std::vector<uint8_t>>();
+    // the charge of the collecting block goes with it, the next one is reserved by writeFrame
+    auto charged = zstd->reserved;
+    raw->swap(zstd->block);
+    zstd->reserved = 0;
+    // the output buffer of the worker, charged here as the account is charged on this thread only
+    auto bound = ZSTD_compressBound(raw->size());
+    charged += static_cast<int64_t>(bound);
+    if (memory_ != nullptr)
+        memory_->charge(static_cast<int64_t>(bound));
+
+    pool_->submit([this, zstd, raw, index, charged, bound](int32_t worker) {
+        TS_TRACE_SPAN("sink", "zstd");
+        ZSTD_OUTPUT::BLOCK block;
+        block.charged = charged;
+        block.data.resize(bound);
+        auto ret = ZSTD_compressCCtx(contexts_[static_cast<size_t>(worker)], block.data.data(), block.data.size(),
+            raw->data(), raw->size(), zstd->level);
+
+        std::lock_guard<std::mutex> lock(zstd->lock);
+        if (ZSTD_isError(ret))
+        {
+            zstd->error = ZSTD_getErrorName(ret);
+            block.data.clear();
+        }
+        else
+        {
+            block.data.resize(ret);
+        }
+        zstd->done[index] = std::move(block);
+    });
+#else
+    (void)output;
+#endif
+}
+
+// writes the compressed blocks that are next in order
+bool TsEsWriter::writeBlocks(uint16_t pid, OUTPUT_FILE& output)
+{
+    (void)pid;      // probes only
+    auto& zstd = *output.zstd;
+    for (;;)
+    {
+        ZSTD_OUTPUT::BLOCK block;
+        {
+            std::lock_guard<std::mutex> lock(zstd.lock);
+            if (!zstd.error.empty())
+            {
+                error_ = output.name + ": " + zstd.error;
+                return false;
+            }
+            auto It = zstd.done.find(zstd.written);
+            if (It == zstd.done.end())
+                return true;
+            block = std::move(It->second);
+            zstd.done.erase(It);
+        }
+        zstd.written++;
+        if (memory_ != nullptr)
+            memory_->credit(block.charged);
+
+        auto c = fwrite(block.data.data(), 1, block.data.size(), output.file);
+        fflush(output.file);
+        TS_STAT_ADD(TS_STAT_BYTES_WRITTEN, c);
+        if (c != block.data.size())
+        {
+            TS_PROBE3(short_write, pid, static_cast<int64_t>(c), static_cast<int64_t>(block.data.size()));
+            return false;
+        }
+    }
+}
+
+bool TsEsWriter::writeFrame(const STREAM_PKG& pkg)
+{
+    auto It = files_.find(pkg.pid);
+    if (It == files_.end())
+        return true;
+
+    auto& output = It->second;
+    if (output.zstd)
+    {
+        auto& zstd = *output.zstd;
+        auto& block = zstd.block;
+        if (block.capacity() == 0)
+            block.reserve(TS_ES_ZSTD_BLOCK);
+        block.insert(block.end(), pkg.data, pkg.data + pkg.size);
+        // reserved on the first frame, grown by a frame past the block size
+        auto capacity = static_cast<int64_t>(block.capacity());
+        if (capacity != zstd.reserved)
+        {
+            if (memory_ != nullptr)
+                memory_->charge(capacity - zstd.reserved);
+            zstd.reserved = capacity;
+        }
+        if (block.size() >= TS_ES_ZSTD_BLOCK)
+            submitBlock(output);
+        return writeBlocks(pkg.pid, output);
+    }
+
+    auto c = fwrite(pkg.data, 1, static_cast<size_t>(pkg.size), It->second.file);
+    fflush(It->second.file);
+    TS_STAT_ADD(TS_STAT_BYTES_WRITTEN, c);
+    if (c != static_cast<size_t>(pkg.size))
+    {
+        TS_PROBE3(short_write, pkg.pid, static_cast<int64_t>(c), pkg.size);
+        return false;
+    }
+    return true;
+}
+
+std::string TsEsWriter::fileName(uint16_t pid) const
+{
+    auto It = files_.find(pid);
+    return It == files_.end() ? std::string() : It->second.name;
+}
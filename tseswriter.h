@@ -0,0 +1,83 @@
+#ifndef TSESWRITER_H
+#define TSESWRITER_H
+
+#include "tsdemuxer.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// frames of a PID collected into one zstd frame
+#define TS_ES_ZSTD_BLOCK        (1024 * 1024)
+// compression threads of a writer
+#define TS_ES_ZSTD_THREADS      (2)
+
+class TsMemoryAccount;
+class TsWorkerPool;
+struct ZSTD_CCtx_s;
+
+///////////////////////////////////////////////////////////
+// Writes every streamed PID to its own raw elementary stream file named
+// <outputDir>/<baseName>_stream_<channel>_<pid>_<codec><extension>
+// Streams with a compression level are written as .zst files instead: the
+// frames of a PID are collected into blocks, compressed to independent zstd
+// frames on worker threads and written in order (needs TSSPLIT_HAVE_ZSTD).
+class TSSPLIT_EXPORT TsEsWriter : public TsFrameSink
+{
+public:
+    TsEsWriter(const std::string& outputDir, const std::string& baseName);
+    ~TsEsWriter() override;
+
+    // empty: all PIDs
+    void setPidFilter(const std::set<uint16_t>& pids);
+    // zstd level by stream type, STREAM_TYPE_UNKNOWN: all other types,
+    // 0 or none: raw. Set before the streams open.
+    void setCompression(const std::map<STREAM_TYPE, int32_t>& levels, int32_t threads = 0);
+    // the collecting blocks and the raw and compressed blocks in flight are
+    // charged to the account of the job
+    void setMemoryAccount(TsMemoryAccount* account);
+    void close();
+
+    // PIDs already open are streamed again after a program change
+    bool openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType) override;
+    bool writeFrame(const STREAM_PKG& pkg) override;
+
+    std::string fileName(uint16_t pid) const;
+    inline const std::string& errorString() const
+    {
+        return error_;
+    }
+
+private:
+    TsEsWriter(const TsEsWriter&);
+    TsEsWriter& operator=(const TsEsWriter&);
+
+    struct ZSTD_OUTPUT;
+    struct OUTPUT_FILE
+    {
+        FILE*       file;
+        std::string name;
+        std::shared_ptr<ZSTD_OUTPUT> zstd;     // null: raw
+    };
+
+    int32_t compressionLevel(STREAM_TYPE streamType) const;
+    void submitBlock(OUTPUT_FILE& output);
+    bool writeBlocks(uint16_t pid, OUTPUT_FILE& output);
+
+    std::string outputDir_;
+    std::string baseName_;
+    std::string error_;
+    std::set<uint16_t> pidFilter_;
+    std::map<uint16_t, OUTPUT_FILE> files_;
+
+    std::map<STREAM_TYPE, int32_t> levels_;
+    int32_t threads_;
+    std::unique_ptr<TsWorkerPool> pool_;
+    std::vector<ZSTD_CCtx_s*> contexts_;    // per worker
+    TsMemoryAccount* memory_;
+};
+
+#endif // TSESWRITER_H
@@ -0,0 +1,31 @@
+#ifndef TSFILEIO_H
+#define TSFILEIO_H
+
+// Raw file descriptor access of the file sources (internal)
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined (_WIN32)
+#include <io.h>
+#define TS_OPEN(path)               ::_open(path, _O_RDONLY | _O_BINARY)
+#define TS_READ(fd, data, len)      ::_read(fd, data, static_cast<unsigned int>(len))
+#define TS_SEEK(fd, pos)            ::_lseeki64(fd, pos, SEEK_SET)
+#define TS_CLOSE(fd)                ::_close(fd)
+#define TS_FSTAT(fd, st)            ::_fstat64(fd, st)
+#define TS_STDIN                    (0)
+#define TS_IS_SEEKABLE(mode)        (((mode) & _S_IFMT) == _S_IFREG)
+typedef struct _stat64 TS_STAT;
+#else
+#include <unistd.h>
+#define TS_OPEN(path)               ::open(path, O_RDONLY)
+#define TS_READ(fd, data, len)      ::read(fd, data, static_cast<size_t>(len))
+#define TS_SEEK(fd, pos)            ::lseek(fd, static_cast<off_t>(pos), SEEK_SET)
+#define TS_CLOSE(fd)                ::close(fd)
+#define TS_FSTAT(fd, st)            ::fstat(fd, st)
+#define TS_STDIN                    STDIN_FILENO
+#define TS_IS_SEEKABLE(mode)        (S_ISREG(mode) || S_ISBLK(mode))
+typedef struct stat TS_STAT;
+#endif
+
+#endif // TSFILEIO_H
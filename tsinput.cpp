@@ -0,0 +1,566 @@
+#include "tsinput.h"
+#include "tsudpinput.h"
+#include "tsdecompress.h"
+#include "tsfileio.h"
+#include "tstrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined (__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#endif
+
+////////////////////////////////////////////////////////////////////
+TsInput::TsInput(int32_t bufferSize)
+{
+    bufferSize_ = bufferSize;
+    lookback_ = 0;
+    avPos_ = 0;
+    avRbs_ = nullptr;
+    avRbe_ = nullptr;
+}
+
+TsInput::~TsInput()
+{
+}
+
+std::string TsInput::errorString() const
+{
+    return std::string();
+}
+
+TsInput* TsInput::create(const std::string& source)
+{
+    TS_UDP_OPTIONS options;
+    if (TsUdpInput::parseUrl(source, options))
+        return new TsUdpInput(options);
+    if (TsDecompressInput::isCompressed(source))
+        return new TsDecompressInput(source);
+    return new TsFileInput(source);
+}
+
+// Bytes before the read position kept on refills, 0 for seekable sources.
+// Sources with a lookback are read forward only.
+void TsInput::setLookback(int32_t size)
+{
+    lookback_ = size;
+}
+
+// reads from the source position up to the position into the buffer
+bool TsInput::skipData(int64_t from, const int64_t& position, bool& bEof)
+{
+    if (position < from)
+        return false;
+
+    while (from < position)
+    {
+        auto ret = readData(buffer_.data(), std::min<int64_t>(static_cast<int64_t>(buffer_.size()), position - from));
+        if (ret == 0)
+            bEof = true;
+        if (ret <= 0)
+            return false;
+        from += ret;
+    }
+    return true;
+}
+
+void TsInput::releaseBuffer()
+{
+    std::vector<uint8_t>().swap(buffer_);
+    avPos_ = 0;
+    avRbs_ = avRbe_ = nullptr;
+}
+
+const uint8_t* TsInput::read(const int64_t& position, int32_t sizeToRead, bool &bEof)
+{
+    if (buffer_.empty())
+    {
+        buffer_.resize(static_cast<size_t>(bufferSize_) + 1);
+        avPos_ = 0;
+        avRbs_ = avRbe_ = buffer_.data();
+    }
+
+    // out of range
+    if (sizeToRead > static_cast<int64_t>(buffer_.size()))
+        return nullptr;
+
+    // already read?
+    auto sz = avRbe_ - buffer_.data();
+    if (position < avPos_ || position > avPos_ + sz)
+    {
+        // seek and reset buffer, forward only sources are read through
+        if (!(lookback_ > 0 ? skipData(avPos_ + sz, position, bEof) : seekData(position)))
+            return nullptr;
+
+        avPos_ = position;
+        avRbs_ = avRbe_ = buffer_.data();
+    }
+    else
+    {
+        // move to the desired pos in buffer
+        avRbs_ = buffer_.data() + (position - avPos_);
+    }
+
+    auto dataread = avRbe_ - avRbs_;
+    if (dataread >= sizeToRead)
+        return avRbs_;
+
+    // forward only sources keep the bytes before the position for stepping back
+    auto keep = std::min<int64_t>(lookback_, avRbs_ - buffer_.data());
+    memmove(buffer_.data(), avRbs_ - keep, static_cast<size_t>(keep + dataread));
+    avRbs_ = buffer_.data() + keep;
+    avRbe_ = avRbs_ + dataread;
+    avPos_ = position - keep;
+
+    TS_TRACE_SPAN("io", "read");
+    auto len = (static_cast<int64_t>(buffer_.size()) - keep - dataread);
+    while (len > 0)
+    {
+        int64_t readResult = readData(avRbe_, len);
+
+        if (readResult == 0)
+            bEof = true;
+
+        if (readResult > 0)
+        {
+            avRbe_ += readResult;
+            dataread += readResult;
+            len -= readResult;
+        }
+
+        if (dataread >= sizeToRead || readResult <= 0)
+            break;
+    }
+
+    return dataread >= sizeToRead ? avRbs_ : nullptr;
+}
+
+////////////////////////////////////////////////////////////////////
+TsFileInput::TsFileInput(const std::string& path)
+    : path_(path),
+    fd_(-1),
+    error_(0),
+    size_(-1),
+    seekable_(true),
+    followTimeoutMs_(-1),
+    watch_(-1),
+    writerClosed_(false),
+    interrupted_(false)
+{
+}
+
+TsFileInput::~TsFileInput()
+{
+    close();
+}
+
+#if defined (__linux__)
+// Some process has the file open for writing: its descriptors in /proc point
+// to the same inode and their fdinfo flags are not read only. Unknown (no
+// /proc) counts as open.
+static bool openForWriting(int fd)
+{
+    struct stat file;
+    auto proc = ::opendir("/proc");
+    if (::fstat(fd, &file) != 0 || proc == nullptr)
+    {
+        if (proc != nullptr)
+            ::closedir(proc);
+        return true;
+    }
+
+    bool found = false;
+    while (!found)
+    {
+        auto process = ::readdir(proc);
+        if (process == nullptr)
+            break;
+        if (process->d_name[0] < '1' || process->d_name[0] > '9')
+            continue;
+
+        auto dir = std::string("/proc/") + process->d_name;
+        auto fds = ::opendir((dir + "/fd").c_str());
+        if (fds == nullptr)
+            continue;
+        while (!found)
+        {
+            auto entry = ::readdir(fds);
+            if (entry == nullptr)
+                break;
+            struct stat st;
+            if (entry->d_name[0] == '.' || ::stat((dir + "/fd/" + entry->d_name).c_str(), &st) != 0 ||
+                st.st_dev != file.st_dev || st.st_ino != file.st_ino)
+                continue;
+
+            // "flags:\t0100001", octal
+            auto info = fopen((dir + "/fdinfo/" + entry->d_name).c_str(), "r");
+            if (info == nullptr)
+                continue;
+            char line[64];
+            while (fgets(line, sizeof(line), info) != nullptr)
+            {
+                if (strncmp(line, "flags:", 6) == 0)
+                {
+                    found = (strtoul(line + 6, nullptr, 8) & O_ACCMODE) != O_RDONLY;
+                    break;
+                }
+            }
+            fclose(info);
+        }
+        ::closedir(fds);
+    }
+    ::closedir(proc);
+    return found;
+}
+#endif
+
+bool TsFileInput::open()
+{
+    close();
+
+    if (path_ == "-")
+    {
+#if defined (_WIN32)
+        ::_setmode(TS_STDIN, _O_BINARY);
+#endif
+        fd_ = TS_STDIN;
+    }
+    else if ((fd_ = TS_OPEN(path_.c_str())) < 0)
+    {
+        error_ = errno;
+        return false;
+    }
+
+    TS_STAT st;
+    seekable_ = TS_FSTAT(fd_, &st) == 0 && TS_IS_SEEKABLE(st.st_mode);
+    size_ = seekable_ ? static_cast<int64_t>(st.st_size) : -1;
+    setLookback(seekable_ ? 0 : TS_INPUT_LOOKBACK);
+
+    writerClosed_ = false;
+    interrupted_ = false;
+#if defined (__linux__)
+    // watched before the first read: a close by the writer is not missed,
+    // without the watch the size is polled
+    if (following())
+    {
+        watch_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_ >= 0 && ::inotify_add_watch(watch_, path_.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF) < 0)
+        {
+            ::close(watch_);
+            watch_ = -1;
+        }
+        // closed before the watch: IN_CLOSE_WRITE will not come
+        if (watch_ >= 0 && !openForWriting(fd_))
+            writerClosed_ = true;
+    }
+#endif
+    return true;
+}
+
+void TsFileInput::close()
+{
+    if (fd_ >= 0)
+    {
+        if (fd_ != TS_STDIN)
+            TS_CLOSE(fd_);
+        fd_ = -1;
+    }
+    if (watch_ >= 0)
+    {
+        TS_CLOSE(watch_);
+        watch_ = -1;
+    }
+    releaseBuffer();
+}
+
+int64_t TsFileInput::size() const
+{
+    return size_;
+}
+
+std::string TsFileInput::name() const
+{
+    return path_;
+}
+
+std::string TsFileInput::errorString() const
+{
+    return error_ ? std::string(strerror(error_)) : std::string();
+}
+
+void TsFileInput::interrupt()
+{
+    interrupted_ = true;
+}
+
+void TsFileInput::setFollow(int32_t idleTimeoutMs)
+{
+    followTimeoutMs_ = idleTimeoutMs < 0 ? -1 : idleTimeoutMs;
+}
+
+int64_t TsFileInput::readData(uint8_t* data, int64_t len)
+{
+    while (true)
+    {
+        auto ret = static_cast<int64_t>(TS_READ(fd_, data, len));
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0)
+            error_ = errno;
+        else if (ret == 0 && following() && waitForData())
+            continue;
+        return ret;
+    }
+}
+
+// At the end of a followed file: true when data may have been appended,
+// false at the real end (writer closed, idle timeout, interrupt)
+bool TsFileInput::waitForData()
+{
+    TS_TRACE_SPAN("io", "follow");
+    auto idleStart = std::chrono::steady_clock::now();
+    auto idleTimeoutMs = followTimeoutMs_ == 0 && watch_ < 0 ? TS_FOLLOW_FALLBACK_IDLE : followTimeoutMs_;
+    while (!interrupted_.load(std::memory_order_relaxed) && !writerClosed_)
+    {
+        bool appended = false;
+#if defined (__linux__)
+        if (watch_ >= 0)
+        {
+            pollfd pfd = { watch_, POLLIN, 0 };
+            if (::poll(&pfd, 1, TS_FOLLOW_POLL_INTERVAL) > 0)
+            {
+                alignas(inotify_event) char events[4096];
+                ssize_t n;
+                while ((n = ::read(watch_, events, sizeof(events))) > 0)
+                {
+                    for (char* p = events; p < events + n; )
+                    {
+                        auto event = reinterpret_cast<const inotify_event*>(p);
+                        // the rest written before the close is still read
+                        if (event->mask & (IN_CLOSE_WRITE | IN_DELETE_SELF))
+                            writerClosed_ = true;
+                        appended = true;
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+        }
+        else
+#endif
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(TS_FOLLOW_POLL_INTERVAL));
+            TS_STAT st;
+            appended = TS_FSTAT(fd_, &st) == 0 && static_cast<int64_t>(st.st_size) > size_;
+        }
+
+        if (appended)
+        {
+            TS_STAT st;
+            if (TS_FSTAT(fd_, &st) == 0)
+                size_ = static_cast<int64_t>(st.st_size);
+            return true;
+        }
+        if (idleTimeoutMs > 0 && std::chrono::steady_clock::now() - idleStart >=
+            std::chrono::milliseconds(idleTimeoutMs))
+            break;
+    }
+    return false;
+}
+
+bool TsFileInput::seekData(const int64_t& position)
+{
+    if (!seekable_)
+    {
+        error_ = ESPIPE;
+        return false;
+    }
+
+    if (TS_SEEK(fd_, position) < 0)
+    {
+        error_ = errno;
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+TsConcatInput::TsConcatInput(const std::vector<std::string>& paths)
+    : current_(0),
+    prefetched_(0),
+    position_(0),
+    error_(0)
+{
+    for (const auto& path : paths)
+        parts_.push_back(PART{ path, -1, 0, 0 });
+}
+
+TsConcatInput::~TsConcatInput()
+{
+    close();
+}
+
+std::vector<std::string> TsConcatInput::findParts(const std::string& path)
+{
+    std::vector<std::string> parts(1, path);
+
+    auto slash = path.find_last_of("/\\");
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = path.size();
+
+    for (int32_t i = 1; i <= 999; i++)
+    {
+        char number[8];
+        snprintf(number, sizeof(number), ".%03d", i);
+        auto part = path.substr(0, dot) + number + path.substr(dot);
+        int fd = TS_OPEN(part.c_str());
+        if (fd < 0)
+            break;
+        TS_CLOSE(fd);
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+bool TsConcatInput::open()
+{
+    close();
+    if (parts_.empty())
+    {
+        error_ = ENOENT;
+        return false;
+    }
+
+    int64_t offset = 0;
+    for (auto& part : parts_)
+    {
+        TS_STAT st;
+        int error = 0;
+        if ((part.fd = TS_OPEN(part.path.c_str())) < 0 || TS_FSTAT(part.fd, &st) != 0)
+            error = errno;
+        else if (!TS_IS_SEEKABLE(st.st_mode))
+            error = ESPIPE;
+
+        if (error != 0)
+        {
+            close();
+            error_ = error;
+            errorPath_ = part.path;
+            return false;
+        }
+        part.offset = offset;
+        part.size = static_cast<int64_t>(st.st_size);
+        offset += part.size;
+    }
+
+    current_ = 0;
+    prefetched_ = 1;
+    position_ = 0;
+    return true;
+}
+
+void TsConcatInput::close()
+{
+    for (auto& part : parts_)
+    {
+        if (part.fd >= 0)
+        {
+            TS_CLOSE(part.fd);
+            part.fd = -1;
+        }
+    }
+    releaseBuffer();
+}
+
+int64_t TsConcatInput::size() const
+{
+    return parts_.empty() ? -1 : parts_.back().offset + parts_.back().size;
+}
+
+std::string TsConcatInput::name() const
+{
+    return parts_.empty() ? std::string() : parts_.front().path;
+}
+
+std::string TsConcatInput::errorString() const
+{
+    if (error_ == 0)
+        return std::string();
+    return errorPath_.empty() ? std::string(strerror(error_)) : errorPath_ + ": " + strerror(error_);
+}
+
+// Reads stop at the end of a part, the caller reads on into the next one
+int64_t TsConcatInput::readData(uint8_t* data, int64_t len)
+{
+    while (current_ < parts_.size())
+    {
+        auto& part = parts_[current_];
+        auto remaining = part.offset + part.size - position_;
+        if (remaining <= 0)
+        {
+            // the next part from its start
+            if (++current_ < parts_.size() && TS_SEEK(parts_[current_].fd, 0) < 0)
+            {
+                error_ = errno;
+                errorPath_ = parts_[current_].path;
+                return -1;
+            }
+            continue;
+        }
+
+        if (remaining <= TS_CONCAT_PREFETCH && prefetched_ <= current_ + 1)
+            prefetch(current_ + 1);
+
+        auto ret = static_cast<int64_t>(TS_READ(part.fd, data, std::min(len, remaining)));
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0)
+        {
+            error_ = errno;
+            errorPath_ = part.path;
+        }
+        else
+            position_ += ret;
+        // 0: the part was truncated since open
+        return ret;
+    }
+    return 0;
+}
+
+bool TsConcatInput::seekData(const int64_t& position)
+{
+    size_t i = 0;
+    while (i + 1 < parts_.size() && position >= parts_[i].offset + parts_[i].size)
+        i++;
+
+    if (TS_SEEK(parts_[i].fd, position - parts_[i].offset) < 0)
+    {
+        error_ = errno;
+        errorPath_ = parts_[i].path;
+        return false;
+    }
+    current_ = i;
+    position_ = position;
+    return true;
+}
+
+// Asks the system to read the start of the part ahead
+void TsConcatInput::prefetch(size_t part)
+{
+    prefetched_ = part + 1;
+    if (part >= parts_.size())
+        return;
+    TS_TRACE_SPAN("io", "prefetch");
+#if defined (POSIX_FADV_WILLNEED)
+    ::posix_fadvise(parts_[part].fd, 0, TS_CONCAT_PREFETCH, POSIX_FADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,186 @@
+#ifndef TSINPUT_H
+#define TSINPUT_H
+
+#include "tssplit_global.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define AV_BUFFER_SIZE       (131072)
+// kept behind the read position of pipes: packet size detection and resync
+// look up to 11 packets ahead before they step back
+#define TS_INPUT_LOOKBACK    (4096)
+// a followed file at its end wakes up at this interval to check interrupt and idle (ms)
+#define TS_FOLLOW_POLL_INTERVAL  (100)
+// idle timeout of a followed file when the close of the writer cannot be seen
+// (no inotify) and none was given (ms)
+#define TS_FOLLOW_FALLBACK_IDLE  (10000)
+// the next part of a concatenated input is read ahead from this distance to the end
+#define TS_CONCAT_PREFETCH   (16 * 1024 * 1024)
+
+///////////////////////////////////////////////////////////
+// Source of transport stream bytes. The base class keeps a read buffer and
+// serves positional reads from it; sources implement the raw access only.
+// The buffer is allocated on the first read.
+class TSSPLIT_EXPORT TsInput
+{
+public:
+    TsInput(int32_t bufferSize = AV_BUFFER_SIZE);
+    virtual ~TsInput();
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    // total size in bytes, -1 when unknown
+    virtual int64_t size() const = 0;
+    virtual std::string name() const = 0;
+    virtual std::string errorString() const;
+    // makes a blocking live source return the end, callable from any thread
+    virtual void interrupt() {}
+
+    // Input for a path, "-" (stdin), a .gz/.zst file or an udp:// address.
+    // The caller owns it.
+    static TsInput* create(const std::string& source);
+
+    // Returns at least sizeToRead bytes at the absolute position or nullptr.
+    // bEof is set when the end of the source is reached.
+    const uint8_t* read(const int64_t& position, int32_t sizeToRead, bool &bEof);
+
+    inline int32_t bufferSize() const
+    {
+        return bufferSize_;
+    }
+
+protected:
+    // read up to len bytes at the source position: >0 read, 0 end, <0 error
+    virtual int64_t readData(uint8_t* data, int64_t len) = 0;
+    // move the source position, false when not possible
+    virtual bool seekData(const int64_t& position) = 0;
+    // frees the read buffer, sources call it when closed
+    void releaseBuffer();
+    void setLookback(int32_t size);
+
+private:
+    TsInput(const TsInput&);
+    TsInput& operator=(const TsInput&);
+
+    bool skipData(int64_t from, const int64_t& position, bool& bEof);
+
+    std::vector<uint8_t> buffer_;
+    int32_t  bufferSize_;
+    int32_t  lookback_;
+    int64_t  avPos_;             // absolute position of the buffer start
+    uint8_t* avRbs_;             // raw data start in buffer
+    uint8_t* avRbe_;             // raw data end in buffer
+};
+
+///////////////////////////////////////////////////////////
+// File, named pipe or "-" for stdin. Pipes and character devices are read
+// forward only: reads return as soon as the requested bytes arrived, steps
+// back are served from the lookback window, skips forward are read through.
+// A followed file is still being written (recording): at its current end the
+// read waits for appended data (inotify on Linux, polling elsewhere) and ends
+// once the writer closed the file or nothing arrived for the idle timeout. A
+// file no process has open for writing when it is opened is read to its end
+// only (Linux: processes of other users are not seen). Without inotify the
+// close cannot be seen: an idle timeout of 0 becomes TS_FOLLOW_FALLBACK_IDLE.
+class TSSPLIT_EXPORT TsFileInput : public TsInput
+{
+public:
+    TsFileInput(const std::string& path);
+    ~TsFileInput() override;
+
+    bool open() override;
+    void close() override;
+    int64_t size() const override;
+    std::string name() const override;
+    std::string errorString() const override;
+    void interrupt() override;
+
+    // must be set before open, -1: off (default), 0: until the writer closes
+    void setFollow(int32_t idleTimeoutMs);
+
+    inline bool isSeekable() const
+    {
+        return seekable_;
+    }
+    inline bool following() const
+    {
+        return followTimeoutMs_ >= 0 && seekable_;
+    }
+
+protected:
+    int64_t readData(uint8_t* data, int64_t len) override;
+    bool seekData(const int64_t& position) override;
+
+private:
+    bool waitForData();
+
+    std::string path_;
+    int     fd_;
+    int     error_;
+    int64_t size_;
+    bool    seekable_;
+
+    int32_t followTimeoutMs_;
+    int     watch_;              // inotify descriptor of a followed file
+    bool    writerClosed_;
+    std::atomic<bool> interrupted_;
+};
+
+///////////////////////////////////////////////////////////
+// Ordered list of files read as one contiguous stream, e.g. the parts of a
+// split recording; packets cut at a part boundary are read across it. The
+// parts must be regular files. While the end of a part is read the next one
+// is prefetched by the system (posix_fadvise).
+class TSSPLIT_EXPORT TsConcatInput : public TsInput
+{
+public:
+    TsConcatInput(const std::vector<std::string>& paths);
+    ~TsConcatInput() override;
+
+    // The path followed by the numbered parts of a recorder that exist:
+    // name.ts, name.001.ts, name.002.ts, ...
+    static std::vector<std::string> findParts(const std::string& path);
+
+    bool open() override;
+    void close() override;
+    int64_t size() const override;
+    std::string name() const override;
+    std::string errorString() const override;
+
+    inline size_t parts() const
+    {
+        return parts_.size();
+    }
+    // part being read
+    inline size_t currentPart() const
+    {
+        return current_;
+    }
+
+protected:
+    int64_t readData(uint8_t* data, int64_t len) override;
+    bool seekData(const int64_t& position) override;
+
+private:
+    void prefetch(size_t part);
+
+    struct PART
+    {
+        std::string path;
+        int     fd;
+        int64_t offset;          // of the part in the stream
+        int64_t size;
+    };
+
+    std::vector<PART> parts_;
+    size_t  current_;
+    size_t  prefetched_;         // parts before this one were prefetched
+    int64_t position_;
+    int     error_;
+    std::string errorPath_;
+};
+
+#endif // TSINPUT_H
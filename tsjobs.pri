@@ -0,0 +1,9 @@
+# Qt job layer on top of the core: parser job and scheduler. QtCore only.
+
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/tsparser.h \
+    $$PWD/tsscheduler.h
+
+SOURCES += $$PWD/tsparser.cpp \
+    $$PWD/tsscheduler.cpp
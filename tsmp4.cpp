@@ -0,0 +1,802 @@
+#include "tsmp4.h"
+#include "tsbudget.h"
+#include "bitstream.h"
+#include "tsstats.h"
+#include "tsprobes.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define TS_MP4_WRAP             (1LL << 33)
+// DTS steps beyond are discontinuities, not sample durations
+#define TS_MP4_MAX_DURATION     (10 * TS_MP4_TIMESCALE)
+
+#define SAMPLE_FLAGS_SYNC       (0x02000000)    // depends on no other sample
+#define SAMPLE_FLAGS_NON_SYNC   (0x01010000)    // depends on others, non sync
+
+static const int32_t mp4SampleRates[16] =
+{
+    96000, 88200, 64000, 48000, 44100, 32000,
+    24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+//////////////////////////////////////////////////////////
+// Big endian box writing
+
+static void put8(std::vector<uint8_t>& buf, uint32_t value)
+{
+    buf.push_back(static_cast<uint8_t>(value));
+}
+
+static void put16(std::vector<uint8_t>& buf, uint32_t value)
+{
+    buf.push_back(static_cast<uint8_t>(value >> 8));
+    buf.push_back(static_cast<uint8_t>(value));
+}
+
+static void put32(std::vector<uint8_t>& buf, uint32_t value)
+{
+    buf.push_back(static_cast<uint8_t>(value >> 24));
+    buf.push_back(static_cast<uint8_t>(value >> 16));
+    buf.push_back(static_cast<uint8_t>(value >> 8));
+    buf.push_back(static_cast<uint8_t>(value));
+}
+
+static void put64(std::vector<uint8_t>& buf, uint64_t value)
+{
+    put32(buf, static_cast<uint32_t>(value >> 32));
+    put32(buf, static_cast<uint32_t>(value));
+}
+
+static void putZeros(std::vector<uint8_t>& buf, size_t count)
+{
+    buf.insert(buf.end(), count, 0);
+}
+
+static void set32(std::vector<uint8_t>& buf, size_t pos, uint32_t value)
+{
+    buf[pos] = static_cast<uint8_t>(value >> 24);
+    buf[pos + 1] = static_cast<uint8_t>(value >> 16);
+    buf[pos + 2] = static_cast<uint8_t>(value >> 8);
+    buf[pos + 3] = static_cast<uint8_t>(value);
+}
+
+// size is patched by endBox()
+static size_t beginBox(std::vector<uint8_t>& buf, const char* type)
+{
+    auto pos = buf.size();
+    put32(buf, 0);
+    buf.insert(buf.end(), type, type + 4);
+    return pos;
+}
+
+static size_t beginFullBox(std::vector<uint8_t>& buf, const char* type, uint8_t version, uint32_t flags)
+{
+    auto pos = beginBox(buf, type);
+    put32(buf, static_cast<uint32_t>(version) << 24 | flags);
+    return pos;
+}
+
+static void endBox(std::vector<uint8_t>& buf, size_t pos)
+{
+    set32(buf, pos, static_cast<uint32_t>(buf.size() - pos));
+}
+
+static void putMatrix(std::vector<uint8_t>& buf)
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (auto value : unity)
+        put32(buf, value);
+}
+
+// ISO 639-2/T, three letters of 5 bits
+static uint16_t packLanguage(const char* language)
+{
+    for (int32_t i = 0; i < 3; i++)
+    {
+        if (language[i] < 'a' || language[i] > 'z')
+            return packLanguage("und");
+    }
+    return static_cast<uint16_t>((language[0] - 0x60) << 10 | (language[1] - 0x60) << 5 | (language[2] - 0x60));
+}
+
+// position of the next 00 00 01 or end
+static const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end)
+{
+    for (; p + 3 <= end; p++)
+    {
+        // no start code can begin at p, p + 1 or p + 2
+        if (p[2] > 1)
+            p += 2;
+        else if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+    return end;
+}
+
+//////////////////////////////////////////////////////////
+
+TsMp4Writer::TsMp4Writer(const std::string& outputDir, const std::string& baseName)
+    : outputDir_(outputDir),
+    baseName_(baseName),
+    dropped_(0),
+    memory_(nullptr)
+{
+}
+
+TsMp4Writer::~TsMp4Writer()
+{
+    close();
+}
+
+void TsMp4Writer::setMemoryAccount(TsMemoryAccount* account)
+{
+    memory_ = account;
+}
+
+void TsMp4Writer::close()
+{
+    for (auto& It : outputs_)
+    {
+        auto& output = It.second;
+        if (!output.failed && output.pending > 0)
+            writeFragment(output);
+        if (output.file != nullptr)
+            fclose(output.file);
+        if (memory_ != nullptr)
+            memory_->credit(static_cast<int64_t>(output.pending));
+    }
+    outputs_.clear();
+    channels_.clear();
+}
+
+bool TsMp4Writer::openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType)
+{
+    bool video = streamType == STREAM_TYPE_VIDEO_H264;
+    if (!video && streamType != STREAM_TYPE_AUDIO_AAC && streamType != STREAM_TYPE_AUDIO_AAC_ADTS)
+        return false;
+
+    auto It = channels_.find(pid);
+    if (It != channels_.end() && It->second != channel)
+        return false;
+
+    auto& output = outputs_[channel];
+    if (output.name.empty())
+    {
+        output.file = nullptr;
+        output.name = outputDir_ + "/" + baseName_ + "_program_" + std::to_string(channel) + ".mp4";
+        output.started = false;
+        output.failed = false;
+        output.sequence = 1;
+        output.origin = 0;
+        output.pending = 0;
+    }
+
+    for (const auto& track : output.tracks)
+    {
+        if (track.pid == pid)
+            return !track.refused && !output.failed;
+        // a single video track, its keyframes cut the fragments
+        if (video && track.video)
+            return false;
+    }
+    // the moov is written already
+    if (output.started)
+        return false;
+
+    MP4_TRACK track;
+    track.pid = pid;
+    track.trackId = 0;
+    track.video = video;
+    track.refused = false;
+    track.width = 0;
+    track.height = 0;
+    memcpy(track.language, "und", sizeof(track.language));
+    track.sampleRate = 0;
+    track.channels = 0;
+    track.lastDts = PTS_UNSET;
+    track.wrap = 0;
+    output.tracks.push_back(std::move(track));
+    channels_[pid] = channel;
+    return true;
+}
+
+void TsMp4Writer::streamInfo(const STREAM_INFO& info)
+{
+    auto It = channels_.find(info.pid);
+    if (It == channels_.end())
+        return;
+
+    for (auto& track : outputs_[It->second].tracks)
+    {
+        if (track.pid != info.pid)
+            continue;
+        if (track.video && !outputs_[It->second].started)
+        {
+            track.width = info.width;
+            track.height = info.height;
+        }
+        if (info.language[0] != 0)
+            memcpy(track.language, info.language, 3);
+    }
+}
+
+bool TsMp4Writer::writeFrame(const STREAM_PKG& pkg)
+{
+    auto It = channels_.find(pkg.pid);
+    if (It == channels_.end())
+        return false;
+
+    auto& output = outputs_[It->second];
+    auto trackIt = std::find_if(output.tracks.begin(), output.tracks.end(),
+        [&pkg](const MP4_TRACK& track) { return track.pid == pkg.pid; });
+    if (output.failed || trackIt == output.tracks.end() || trackIt->refused)
+        return false;
+    if (pkg.data == nullptr || pkg.size <= 0)
+        return true;
+
+    auto& track = *trackIt;
+    auto used = track.data.size();
+    bool sync = true;
+    if (track.video)
+    {
+        // decoding starts at a keyframe with its parameter sets
+        if (!addVideo(track, pkg, sync) || (track.lastDts == PTS_UNSET && (!sync || track.sps.empty() || track.pps.empty())))
+        {
+            track.data.resize(used);
+            dropped_++;
+            return true;
+        }
+    }
+    else if (!addAudio(track, pkg))
+    {
+        track.data.resize(used);
+        return false;
+    }
+
+    // 33 bit DTS unwrapped, frames without one follow the previous frame
+    int64_t dts, ctsOffset = 0;
+    if (pkg.dts == PTS_UNSET)
+    {
+        if (track.lastDts == PTS_UNSET)
+        {
+            track.data.resize(used);
+            dropped_++;
+            return true;
+        }
+        dts = track.lastDts + (track.samples.empty() ? 0 : track.samples.back().duration);
+    }
+    else
+    {
+        dts = pkg.dts + track.wrap;
+        if (track.lastDts != PTS_UNSET && dts < track.lastDts - TS_MP4_WRAP / 2)
+        {
+            track.wrap += TS_MP4_WRAP;
+            dts += TS_MP4_WRAP;
+        }
+        else if (track.lastDts != PTS_UNSET && dts > track.lastDts + TS_MP4_WRAP / 2)
+        {
+            track.wrap -= TS_MP4_WRAP;
+            dts -= TS_MP4_WRAP;
+        }
+        if (pkg.pts != PTS_UNSET)
+        {
+            ctsOffset = (pkg.pts - pkg.dts) & PTS_MASK;
+            if (ctsOffset >= TS_MP4_WRAP / 2)
+                ctsOffset -= TS_MP4_WRAP;
+        }
+    }
+
+    if (!track.samples.empty())
+    {
+        auto delta = dts - track.samples.back().dts;
+        if (delta > 0 && delta < TS_MP4_MAX_DURATION)
+            track.samples.back().duration = static_cast<uint32_t>(delta);
+    }
+
+    // fragments start at the video keyframes, every second without video
+    auto size = static_cast<uint32_t>(track.data.size() - used);
+    bool hasVideo = std::any_of(output.tracks.begin(), output.tracks.end(),
+        [](const MP4_TRACK& t) { return t.video && !t.refused; });
+    bool cut = output.pending >= TS_MP4_MAX_FRAGMENT;
+    if (track.video)
+        cut = cut || (sync && !track.samples.empty());
+    else if (!hasVideo && !track.samples.empty())
+    {
+        // the first audio track times the fragments
+        auto first = std::find_if(output.tracks.begin(), output.tracks.end(),
+            [](const MP4_TRACK& t) { return !t.refused; });
+        cut = cut || (&*first == &track && dts - track.samples.front().dts >= TS_MP4_AUDIO_FRAGMENT);
+    }
+    if (cut && !writeFragment(output))
+        return false;
+    // not ready when the moov was written
+    if (track.refused)
+        return false;
+
+    MP4_SAMPLE sample;
+    sample.size = size;
+    sample.duration = pkg.duration > 0 && pkg.duration < TS_MP4_MAX_DURATION ? static_cast<uint32_t>(pkg.duration)
+        : track.samples.empty() ? 0 : track.samples.back().duration;
+    sample.dts = dts;
+    sample.ctsOffset = static_cast<int32_t>(ctsOffset);
+    sample.sync = sync;
+    track.samples.push_back(sample);
+    track.lastDts = dts;
+    output.pending += sample.size;
+    if (memory_ != nullptr)
+        memory_->charge(sample.size);
+    return true;
+}
+
+std::string TsMp4Writer::fileName(uint16_t channel) const
+{
+    auto It = outputs_.find(channel);
+    return It == outputs_.end() ? std::string() : It->second.name;
+}
+
+// SEI messages of a NAL unit, the decoding can start at a recovery point
+static bool hasRecoveryPoint(const uint8_t* p, const uint8_t* end)
+{
+    // up to the rbsp_trailing_bits
+    while (p < end && *p != 0x80)
+    {
+        int32_t type = 0, size = 0;
+        while (p < end && *p == 0xff)
+            type += *p++;
+        if (p == end)
+            return false;
+        type += *p++;
+        while (p < end && *p == 0xff)
+            size += *p++;
+        if (p == end)
+            return false;
+        size += *p++;
+        if (type == 6)
+            return true;
+        // emulation prevention bytes are not removed, enough for the first messages
+        if (size > end - p)
+            return false;
+        p += size;
+    }
+    return false;
+}
+
+// chroma_format_idc and bit depths of a High profile SPS, 4:2:0 8 bit if unreadable
+static void readHighProfile(const std::vector<uint8_t>& sps, int32_t& chromaFormat,
+    int32_t& bitDepthLuma, int32_t& bitDepthChroma)
+{
+    // the fields follow the level in the first bytes, without emulation prevention
+    uint8_t rbsp[16];
+    int32_t len = 0, zeros = 0;
+    for (size_t i = 1; i < sps.size() && len < static_cast<int32_t>(sizeof(rbsp)); i++)
+    {
+        if (zeros >= 2 && sps[i] == 3)
+        {
+            zeros = 0;
+            continue;
+        }
+        zeros = sps[i] == 0 ? zeros + 1 : 0;
+        rbsp[len++] = sps[i];
+    }
+
+    chromaFormat = 1;
+    bitDepthLuma = bitDepthChroma = 8;
+    BitStream bs(rbsp, len * 8);
+    bs.skipBits(24);                    // profile_idc, constraint flags, level_idc
+    bs.readGolombUE(9);                 // seq_parameter_set_id
+    auto chroma = bs.readGolombUE(9);
+    if (chroma == 3)
+        bs.skipBits(1);                 // separate_colour_plane_flag
+    auto luma = bs.readGolombUE(9);
+    auto chromaDepth = bs.readGolombUE(9);
+    if (bs.isError() || chroma > 3 || luma > 6 || chromaDepth > 6)
+        return;
+    chromaFormat = chroma;
+    bitDepthLuma = luma + 8;
+    bitDepthChroma = chromaDepth + 8;
+}
+
+// Annex-B access unit as 4 byte length prefixed NAL units, AUDs and filler dropped
+bool TsMp4Writer::addVideo(MP4_TRACK& track, const STREAM_PKG& pkg, bool& sync)
+{
+    auto end = pkg.data + pkg.size;
+    auto nal = findStartCode(pkg.data, end);
+    bool found = false;
+    sync = false;
+    while (nal < end)
+    {
+        nal += 3;
+        auto next = findStartCode(nal, end);
+        // trailing zeros, e.g. the first byte of a 4 byte start code
+        auto last = next;
+        while (last > nal && last[-1] == 0)
+            last--;
+        auto size = last - nal;
+        if (size > 0)
+        {
+            auto type = nal[0] & 0x1f;
+            if (type == 7 && track.sps.empty())
+                track.sps.assign(nal, last);
+            else if (type == 8 && track.pps.empty())
+                track.pps.assign(nal, last);
+            else if (type == 5)
+                sync = true;
+            else if (type == 6 && !sync)
+                sync = hasRecoveryPoint(nal + 1, last);
+
+            if (type != 9 && type != 12)
+            {
+                auto pos = track.data.size();
+                track.data.resize(pos + 4 + size);
+                track.data[pos] = static_cast<uint8_t>(size >> 24);
+                track.data[pos + 1] = static_cast<uint8_t>(size >> 16);
+                track.data[pos + 2] = static_cast<uint8_t>(size >> 8);
+                track.data[pos + 3] = static_cast<uint8_t>(size);
+                memcpy(&track.data[pos + 4], nal, size);
+                found = true;
+            }
+        }
+        nal = next;
+    }
+    return found;
+}
+
+// raw AAC frame without its ADTS header
+bool TsMp4Writer::addAudio(MP4_TRACK& track, const STREAM_PKG& pkg)
+{
+    auto p = pkg.data;
+    if (pkg.size < 7 || p[0] != 0xff || (p[1] & 0xf6) != 0xf0)
+        return false;
+
+    auto header = (p[1] & 0x01) != 0 ? 7 : 9;
+    if (pkg.size <= header)
+        return false;
+
+    if (track.audioConfig.empty())
+    {
+        auto objectType = (p[2] >> 6) + 1;
+        auto sampleRateIndex = (p[2] >> 2) & 0x0f;
+        auto channels = (p[2] & 0x01) << 2 | p[3] >> 6;
+        track.audioConfig.push_back(static_cast<uint8_t>(objectType << 3 | sampleRateIndex >> 1));
+        track.audioConfig.push_back(static_cast<uint8_t>((sampleRateIndex & 1) << 7 | channels << 3));
+        track.sampleRate = mp4SampleRates[sampleRateIndex];
+        track.channels = channels;
+    }
+    track.data.insert(track.data.end(), p + header, p + pkg.size);
+    return true;
+}
+
+// ftyp and moov of the tracks ready by now, the others are refused
+bool TsMp4Writer::writeInit(MP4_OUTPUT& output)
+{
+    output.started = true;
+    uint32_t trackId = 0;
+    bool hasOrigin = false;
+    for (auto& track : output.tracks)
+    {
+        if (track.samples.empty() || (track.video ? track.sps.size() < 4 || track.pps.empty() : track.audioConfig.empty()))
+        {
+            size_t bytes = 0;
+            for (const auto& sample : track.samples)
+                bytes += sample.size;
+            output.pending -= bytes;
+            if (memory_ != nullptr)
+                memory_->credit(static_cast<int64_t>(bytes));
+            track.refused = true;
+            track.data.clear();
+            track.samples.clear();
+            continue;
+        }
+        track.trackId = ++trackId;
+        if (!hasOrigin || track.samples.front().dts < output.origin)
+            output.origin = track.samples.front().dts;
+        hasOrigin = true;
+    }
+    if (trackId == 0)
+        return true;
+
+    output.file = fopen(output.name.c_str(), "wb");
+    if (output.file == nullptr)
+    {
+        error_ = "Unable to open\n " + output.name + " \n " + strerror(errno);
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    auto box = beginBox(buf, "ftyp");
+    buf.insert(buf.end(), { 'i', 's', 'o', 'm' });
+    put32(buf, 0x200);
+    buf.insert(buf.end(), { 'i', 's', 'o', 'm', 'i', 's', 'o', '6', 'a', 'v', 'c', '1', 'm', 'p', '4', '1' });
+    endBox(buf, box);
+
+    auto moov = beginBox(buf, "moov");
+    box = beginFullBox(buf, "mvhd", 0, 0);
+    putZeros(buf, 8);                   // creation, modification time
+    put32(buf, TS_MP4_TIMESCALE);
+    put32(buf, 0);                      // duration: in the fragments
+    put32(buf, 0x00010000);             // rate 1.0
+    put16(buf, 0x0100);                 // volume 1.0
+    putZeros(buf, 10);
+    putMatrix(buf);
+    putZeros(buf, 24);
+    put32(buf, trackId + 1);            // next_track_ID
+    endBox(buf, box);
+
+    for (const auto& track : output.tracks)
+    {
+        if (track.refused)
+            continue;
+
+        auto trak = beginBox(buf, "trak");
+        box = beginFullBox(buf, "tkhd", 0, 0x000003);  // enabled, in movie
+        putZeros(buf, 8);
+        put32(buf, track.trackId);
+        putZeros(buf, 4);
+        put32(buf, 0);                  // duration
+        putZeros(buf, 8);
+        put16(buf, 0);                  // layer
+        put16(buf, 0);                  // alternate_group
+        put16(buf, track.video ? 0 : 0x0100);
+        putZeros(buf, 2);
+        putMatrix(buf);
+        put32(buf, static_cast<uint32_t>(track.width) << 16);
+        put32(buf, static_cast<uint32_t>(track.height) << 16);
+        endBox(buf, box);
+
+        auto mdia = beginBox(buf, "mdia");
+        box = beginFullBox(buf, "mdhd", 0, 0);
+        putZeros(buf, 8);
+        put32(buf, TS_MP4_TIMESCALE);
+        put32(buf, 0);
+        put16(buf, packLanguage(track.language));
+        put16(buf, 0);
+        endBox(buf, box);
+
+        box = beginFullBox(buf, "hdlr", 0, 0);
+        put32(buf, 0);
+        buf.insert(buf.end(), track.video ? "vide" : "soun", (track.video ? "vide" : "soun") + 4);
+        putZeros(buf, 12);
+        const char* name = track.video ? "VideoHandler" : "SoundHandler";
+        buf.insert(buf.end(), name, name + strlen(name) + 1);
+        endBox(buf, box);
+
+        auto minf = beginBox(buf, "minf");
+        if (track.video)
+        {
+            box = beginFullBox(buf, "vmhd", 0, 0x000001);
+            putZeros(buf, 8);           // graphicsmode, opcolor
+        }
+        else
+        {
+            box = beginFullBox(buf, "smhd", 0, 0);
+            putZeros(buf, 4);           // balance
+        }
+        endBox(buf, box);
+
+        auto dinf = beginBox(buf, "dinf");
+        box = beginFullBox(buf, "dref", 0, 0);
+        put32(buf, 1);
+        endBox(buf, beginFullBox(buf, "url ", 0, 0x000001));   // in this file
+        endBox(buf, box);
+        endBox(buf, dinf);
+
+        auto stbl = beginBox(buf, "stbl");
+        auto stsd = beginFullBox(buf, "stsd", 0, 0);
+        put32(buf, 1);
+        if (track.video)
+        {
+            auto entry = beginBox(buf, "avc1");
+            putZeros(buf, 6);
+            put16(buf, 1);              // data_reference_index
+            putZeros(buf, 16);
+            put16(buf, static_cast<uint32_t>(track.width));
+            put16(buf, static_cast<uint32_t>(track.height));
+            put32(buf, 0x00480000);     // 72 dpi
+            put32(buf, 0x00480000);
+            put32(buf, 0);
+            put16(buf, 1);              // frame_count
+            putZeros(buf, 32);          // compressorname
+            put16(buf, 0x0018);         // depth
+            put16(buf, 0xffff);
+
+            box = beginBox(buf, "avcC");
+            put8(buf, 1);               // configurationVersion
+            put8(buf, track.sps[1]);    // profile_idc
+            put8(buf, track.sps[2]);    // profile compatibility
+            put8(buf, track.sps[3]);    // level_idc
+            put8(buf, 0xff);            // 4 byte NAL unit lengths
+            put8(buf, 0xe1);            // one SPS
+            put16(buf, static_cast<uint32_t>(track.sps.size()));
+            buf.insert(buf.end(), track.sps.begin(), track.sps.end());
+            put8(buf, 1);               // one PPS
+            put16(buf, static_cast<uint32_t>(track.pps.size()));
+            buf.insert(buf.end(), track.pps.begin(), track.pps.end());
+            auto profile = track.sps[1];
+            if (profile == 100 || profile == 110 || profile == 122 || profile == 144)
+            {
+                int32_t chromaFormat, bitDepthLuma, bitDepthChroma;
+                readHighProfile(track.sps, chromaFormat, bitDepthLuma, bitDepthChroma);
+                put8(buf, 0xfc | static_cast<uint32_t>(chromaFormat));
+                put8(buf, 0xf8 | static_cast<uint32_t>(bitDepthLuma - 8));
+                put8(buf, 0xf8 | static_cast<uint32_t>(bitDepthChroma - 8));
+                put8(buf, 0);           // no SPS extensions
+            }
+            endBox(buf, box);
+            endBox(buf, entry);
+        }
+        else
+        {
+            auto entry = beginBox(buf, "mp4a");
+            putZeros(buf, 6);
+            put16(buf, 1);              // data_reference_index
+            putZeros(buf, 8);
+            put16(buf, static_cast<uint32_t>(track.channels));
+            put16(buf, 16);             // samplesize
+            putZeros(buf, 4);
+            put32(buf, track.sampleRate < 0x10000 ? static_cast<uint32_t>(track.sampleRate) << 16 : 0);
+
+            // ES_Descriptor with the DecoderConfigDescriptor of the AudioSpecificConfig
+            auto config = static_cast<uint32_t>(track.audioConfig.size());
+            box = beginFullBox(buf, "esds", 0, 0);
+            put8(buf, 0x03);
+            put8(buf, 3 + 2 + 13 + 2 + config + 3);
+            put16(buf, 0);              // ES_ID
+            put8(buf, 0);
+            put8(buf, 0x04);
+            put8(buf, 13 + 2 + config);
+            put8(buf, 0x40);            // MPEG-4 audio
+            put8(buf, 0x15);            // audio stream
+            putZeros(buf, 11);          // buffer size, bitrates
+            put8(buf, 0x05);
+            put8(buf, config);
+            buf.insert(buf.end(), track.audioConfig.begin(), track.audioConfig.end());
+            put8(buf, 0x06);            // SLConfigDescriptor
+            put8(buf, 1);
+            put8(buf, 0x02);
+            endBox(buf, box);
+            endBox(buf, entry);
+        }
+        endBox(buf, stsd);
+
+        // samples are in the fragments only
+        box = beginFullBox(buf, "stts", 0, 0);
+        put32(buf, 0);
+        endBox(buf, box);
+        box = beginFullBox(buf, "stsc", 0, 0);
+        put32(buf, 0);
+        endBox(buf, box);
+        box = beginFullBox(buf, "stsz", 0, 0);
+        put32(buf, 0);
+        put32(buf, 0);
+        endBox(buf, box);
+        box = beginFullBox(buf, "stco", 0, 0);
+        put32(buf, 0);
+        endBox(buf, box);
+        endBox(buf, stbl);
+        endBox(buf, minf);
+        endBox(buf, mdia);
+        endBox(buf, trak);
+    }
+
+    auto mvex = beginBox(buf, "mvex");
+    for (const auto& track : output.tracks)
+    {
+        if (track.refused)
+            continue;
+        box = beginFullBox(buf, "trex", 0, 0);
+        put32(buf, track.trackId);
+        put32(buf, 1);                  // default_sample_description_index
+        put32(buf, 0);
+        put32(buf, 0);
+        put32(buf, track.video ? SAMPLE_FLAGS_NON_SYNC : SAMPLE_FLAGS_SYNC);
+        endBox(buf, box);
+    }
+    endBox(buf, mvex);
+    endBox(buf, moov);
+
+    return write(output, buf.data(), buf.size());
+}
+
+// moof with a traf per track of the pending samples, then their mdat
+bool TsMp4Writer::writeFragment(MP4_OUTPUT& output)
+{
+    if (!output.started && !writeInit(output))
+    {
+        output.failed = true;
+        return false;
+    }
+    if (output.file == nullptr || output.pending == 0)
+        return true;
+
+    std::vector<uint8_t> buf;
+    std::vector<size_t> dataOffsets;
+    auto moof = beginBox(buf, "moof");
+    auto box = beginFullBox(buf, "mfhd", 0, 0);
+    put32(buf, output.sequence++);
+    endBox(buf, box);
+
+    for (const auto& track : output.tracks)
+    {
+        if (track.refused || track.samples.empty())
+            continue;
+
+        auto traf = beginBox(buf, "traf");
+        box = beginFullBox(buf, "tfhd", 0, 0x020000);      // default-base-is-moof
+        put32(buf, track.trackId);
+        endBox(buf, box);
+
+        box = beginFullBox(buf, "tfdt", 1, 0);
+        put64(buf, static_cast<uint64_t>(std::max<int64_t>(0, track.samples.front().dts - output.origin)));
+        endBox(buf, box);
+
+        // data offset, duration, size (and flags, composition offset of video)
+        box = beginFullBox(buf, "trun", 1, track.video ? 0x000f01 : 0x000301);
+        put32(buf, static_cast<uint32_t>(track.samples.size()));
+        dataOffsets.push_back(buf.size());
+        put32(buf, 0);
+        for (const auto& sample : track.samples)
+        {
+            put32(buf, sample.duration);
+            put32(buf, sample.size);
+            if (track.video)
+            {
+                put32(buf, sample.sync ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+                put32(buf, static_cast<uint32_t>(sample.ctsOffset));
+            }
+        }
+        endBox(buf, box);
+        endBox(buf, traf);
+    }
+    endBox(buf, moof);
+
+    // sample data follows the mdat header in traf order
+    size_t offset = buf.size() + 8, size = 0, i = 0;
+    for (const auto& track : output.tracks)
+    {
+        if (track.refused || track.samples.empty())
+            continue;
+        set32(buf, dataOffsets[i++], static_cast<uint32_t>(offset + size));
+        for (const auto& sample : track.samples)
+            size += sample.size;
+    }
+    put32(buf, static_cast<uint32_t>(8 + size));
+    buf.insert(buf.end(), { 'm', 'd', 'a', 't' });
+    if (!write(output, buf.data(), buf.size()))
+        return false;
+
+    // the frame that cut the fragment stays pending
+    for (auto& track : output.tracks)
+    {
+        if (track.refused || track.samples.empty())
+            continue;
+        size_t bytes = 0;
+        for (const auto& sample : track.samples)
+            bytes += sample.size;
+        if (!write(output, track.data.data(), bytes))
+            return false;
+        track.data.erase(track.data.begin(), track.data.begin() + bytes);
+        track.samples.clear();
+        output.pending -= bytes;
+        if (memory_ != nullptr)
+            memory_->credit(static_cast<int64_t>(bytes));
+    }
+    return true;
+}
+
+bool TsMp4Writer::write(MP4_OUTPUT& output, const uint8_t* data, size_t size)
+{
+    auto c = fwrite(data, 1, size, output.file);
+    TS_STAT_ADD(TS_STAT_BYTES_WRITTEN, c);
+    if (c != size)
+    {
+        TS_PROBE3(short_write, output.tracks.front().pid, static_cast<int64_t>(c), static_cast<int64_t>(size));
+        error_ = "Unable to write\n " + output.name + " \n " + strerror(errno);
+        fclose(output.file);
+        output.file = nullptr;
+        output.failed = true;
+        return false;
+    }
+    return true;
+}
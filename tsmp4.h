@@ -0,0 +1,119 @@
+#ifndef TSMP4_H
+#define TSMP4_H
+
+#include "tsdemuxer.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+// media time scale of every track, the one of PTS/DTS
+#define TS_MP4_TIMESCALE        (90000)
+// fragment length of a program without video
+#define TS_MP4_AUDIO_FRAGMENT   (90000)
+// pending bytes of a program written as a fragment without a keyframe
+#define TS_MP4_MAX_FRAGMENT     (32 * 1024 * 1024)
+
+class TsMemoryAccount;
+
+///////////////////////////////////////////////////////////
+// Streams the H.264 and AAC (ADTS) streams of every program into a fragmented
+// MP4 named <outputDir>/<baseName>_program_<channel>.mp4, in the same pass as
+// the demuxer. Access units are converted from Annex-B to 4 byte length
+// prefixed NAL units (AUDs dropped) and ADTS headers are stripped while the
+// frames are copied into the pending fragment. A fragment (moof/mdat) is
+// written at every video keyframe, ftyp/moov with avcC (first SPS/PPS of the
+// stream) and the AudioSpecificConfig before the first one: streams opened
+// later or without a frame by then are refused. Keyframes are IDR pictures
+// and pictures with a recovery point SEI; video starts at the first one, the
+// frames before it are dropped. Parameter set changes are not followed.
+class TSSPLIT_EXPORT TsMp4Writer : public TsFrameSink
+{
+public:
+    TsMp4Writer(const std::string& outputDir, const std::string& baseName);
+    ~TsMp4Writer() override;
+
+    // pending fragments are charged to the account of the job
+    void setMemoryAccount(TsMemoryAccount* account);
+    // writes the pending fragments
+    void close();
+
+    // H.264 and AAC only
+    bool openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType) override;
+    void streamInfo(const STREAM_INFO& info) override;
+    // false: the frame cannot be muxed (e.g. LATM audio, write error)
+    bool writeFrame(const STREAM_PKG& pkg) override;
+
+    std::string fileName(uint16_t channel) const;
+    // frames accepted by writeFrame() but not written, video before its first keyframe
+    inline int64_t dropped() const
+    {
+        return dropped_;
+    }
+    inline const std::string& errorString() const
+    {
+        return error_;
+    }
+
+private:
+    TsMp4Writer(const TsMp4Writer&);
+    TsMp4Writer& operator=(const TsMp4Writer&);
+
+    struct MP4_SAMPLE
+    {
+        uint32_t size;
+        uint32_t duration;
+        int64_t  dts;               // unwrapped
+        int32_t  ctsOffset;         // pts - dts
+        bool     sync;
+    };
+
+    struct MP4_TRACK
+    {
+        uint16_t pid;
+        uint32_t trackId;
+        bool     video;
+        bool     refused;           // not in the moov
+        int32_t  width;
+        int32_t  height;
+        char     language[4];
+        std::vector<uint8_t> sps;
+        std::vector<uint8_t> pps;
+        std::vector<uint8_t> audioConfig;   // AudioSpecificConfig
+        int32_t  sampleRate;
+        int32_t  channels;
+        int64_t  lastDts;           // unwrapped, PTS_UNSET: none yet
+        int64_t  wrap;              // added to the 33 bit DTS
+        std::vector<MP4_SAMPLE> samples;    // of the pending fragment
+        std::vector<uint8_t> data;
+    };
+
+    struct MP4_OUTPUT
+    {
+        FILE*       file;
+        std::string name;
+        bool        started;        // ftyp/moov written
+        bool        failed;
+        uint32_t    sequence;       // of the next moof
+        int64_t     origin;         // DTS at media time 0
+        size_t      pending;        // sample bytes of all tracks
+        std::vector<MP4_TRACK> tracks;
+    };
+
+    bool addVideo(MP4_TRACK& track, const STREAM_PKG& pkg, bool& sync);
+    bool addAudio(MP4_TRACK& track, const STREAM_PKG& pkg);
+    bool writeInit(MP4_OUTPUT& output);
+    bool writeFragment(MP4_OUTPUT& output);
+    bool write(MP4_OUTPUT& output, const uint8_t* data, size_t size);
+
+    std::string outputDir_;
+    std::string baseName_;
+    std::string error_;
+    std::map<uint16_t, MP4_OUTPUT> outputs_;    // by channel
+    std::map<uint16_t, uint16_t> channels_;     // PID: channel
+    int64_t dropped_;
+    TsMemoryAccount* memory_;
+};
+
+#endif // TSMP4_H
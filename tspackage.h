@@ -4,6 +4,8 @@
 #include "tstable.h"
 #include "tsstream.h"
 
+#include <vector>
+
 enum PACKAGE_TYPE
 {
     PACKAGE_TYPE_UNKNOWN = 0,
@@ -21,6 +23,11 @@ struct TsPackage
     bool         hasStreamData;
     bool         streaming;
     TsStream*    pStream;
+    STREAM_TYPE  pmtStreamType;  // stream type announced by the PMT
+    int32_t      pesLength;      // PES_packet_length of the current PES, 0: unbounded
+    int32_t      pesBytes;       // bytes of the current PES received
+    uint16_t     pcrPid;         // PMT: PCR_PID of the program
+    std::vector<uint16_t> esPids;   // PMT: elementary PIDs, also of unknown types
     TsTable      packageTable;
 
     TsPackage()
@@ -32,6 +39,10 @@ struct TsPackage
         hasStreamData(false),
         streaming(false),
         pStream(nullptr),
+        pmtStreamType(STREAM_TYPE_UNKNOWN),
+        pesLength(0),
+        pesBytes(0),
+        pcrPid(0x1fff),
         packageTable()
     {
     }
@@ -45,6 +56,7 @@ struct TsPackage
     {
         continuity = 0xff;
         waitUnitStart = true;
+        pesLength = pesBytes = 0;
         packageTable.reset();
         if (pStream != nullptr)
             pStream->reset();
@@ -1,49 +1,229 @@
 #include "tsparser.h"
 #include "tscontext.h"
+#include "tsdecompress.h"
+#include "tstrace.h"
 
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QRegularExpression>
 #include <QDebug>
 
+#include <chrono>
+#include <time.h>
+
+static int64_t threadCpuTimeNs()
+{
+#if defined (Q_OS_UNIX)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+#endif
+    return 0;
+}
+
+static int64_t monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 ////////////////////////////////////////////////////////////////////
 TsParser::TsParser(const QString& filePath, QObject* parent)
-    : QThread(parent),
-    mainStreamPID_(0xffff),
-    absDTS_(PTS_UNSET),
-    absPTS_(PTS_UNSET),
-    pinTime_(0),
-    curTime_(0),
-    endTime_(0),
-    m_file(filePath)
+    : TsParser(QStringList(filePath), parent)
 {
-    m_buffer.resize((static_cast<size_t>(AV_BUFFER_SIZE) + 1));
-    avPos_ = 0;
-    avRbs_ = m_buffer.data();
-    avRbe_ = m_buffer.data();
-    AVContext_.reset(new AVContext(*this, 0, 0));
+}
+
+TsParser::TsParser(const QStringList& filePaths, QObject* parent)
+    : QObject(parent),
+    m_filePath(filePaths.value(0)),
+    m_state(TS_JOB_STATE_QUEUED),
+    m_bytesDone(0),
+    m_bytesTotal(-1),
+    m_startNs(0),
+    m_endNs(0),
+    m_cancelled(false),
+    m_input(createInput(filePaths))
+{
+    m_demuxer.reset(new TsDemuxer(*m_input, *this));
+
+    m_stats.result = AVCONTEXT_CONTINUE;
+    m_stats.bytes = 0;
+    m_stats.packets = 0;
+    m_stats.wallTimeNs = 0;
+    m_stats.cpuTimeNs = 0;
+    m_stats.memoryPeak = 0;
+    m_stats.stages = TS_STATS_SNAPSHOT();
 }
 
 TsParser::~TsParser()
 {
-    exit();
-    wait();
 }
 
-bool TsParser::start()
+// several files are read as one stream
+TsInput* TsParser::createInput(const QStringList& filePaths)
 {
-    if (m_file.open(QFile::ReadOnly))
-    {
-        QThread::start();
-        return true;
-    }
-    emit notifyError(tr("Cannot open source file: ") + m_file.errorString());
-    return false;
+    if (filePaths.size() <= 1)
+        return TsInput::create(QFile::encodeName(filePaths.value(0)).toStdString());
+
+    std::vector<std::string> paths;
+    for (const auto& path : filePaths)
+        paths.push_back(QFile::encodeName(path).toStdString());
+    return new TsConcatInput(paths);
+}
+
+void TsParser::cancel()
+{
+    m_cancelled = true;
+    m_demuxer->cancel();
+    // live sources block in the read
+    m_input->interrupt();
+}
+
+TS_JOB_PROGRESS TsParser::progressInfo() const
+{
+    TS_JOB_PROGRESS info;
+    info.state = static_cast<TS_JOB_STATE>(m_state.load(std::memory_order_acquire));
+    info.bytesDone = m_bytesDone.load(std::memory_order_relaxed);
+    info.bytesTotal = m_bytesTotal.load(std::memory_order_relaxed);
+    info.bytesPerSecond = 0;
+    info.etaMs = -1;
+    info.memoryBytes = m_demuxer->memory().current();
+    info.memoryPeak = m_demuxer->memory().peak();
+
+    auto start = m_startNs.load(std::memory_order_relaxed);
+    if (start == 0)
+        return info;
+
+    auto end = m_endNs.load(std::memory_order_relaxed);
+    auto elapsed = (end != 0 ? end : monotonicNs()) - start;
+    if (elapsed > 0)
+        info.bytesPerSecond = info.bytesDone * 1e9 / elapsed;
+    if (info.state == TS_JOB_STATE_RUNNING && info.bytesTotal > 0 && info.bytesPerSecond > 0)
+        info.etaMs = static_cast<int64_t>(qMax<int64_t>(0, info.bytesTotal - info.bytesDone) * 1000 / info.bytesPerSecond);
+    else if (info.state != TS_JOB_STATE_RUNNING)
+        info.etaMs = 0;
+    return info;
+}
+
+// empty: next to the source file
+void TsParser::setOutputDir(const QString& outputDir)
+{
+    m_outputDir = outputDir;
+}
+
+// 0: all programs
+void TsParser::setProgram(uint16_t channel)
+{
+    m_demuxer.reset(new TsDemuxer(*m_input, *this, channel));
+}
+
+// ms without new data that end a followed recording, -1: not followed,
+// 0: until the writer closes it; ignored for pipes and live sources
+void TsParser::setFollow(int32_t idleTimeoutMs)
+{
+    auto file = dynamic_cast<TsFileInput*>(m_input.data());
+    if (file != nullptr)
+        file->setFollow(idleTimeoutMs);
+}
+
+// frames are written as soon as their PES is complete
+void TsParser::setLowLatency(bool enabled)
+{
+    m_lowLatency = enabled;
+}
+
+// STREAM_TYPE_UNKNOWN: all other types, 0: raw
+void TsParser::setCompression(const std::map<STREAM_TYPE, int32_t>& levels)
+{
+    m_compression = levels;
 }
 
-void TsParser::run()
+// next to the elementary streams, <base>_program_<channel>.ts
+void TsParser::setRemux(bool enabled)
 {
-    emit notifyStart(currentThreadId(), this);
+    m_remux = enabled;
+}
+
+// <base>_program_<channel>.mp4, the other streams stay elementary streams
+void TsParser::setMp4(bool enabled)
+{
+    m_mp4 = enabled;
+}
+
+// empty: all PIDs
+void TsParser::setPidFilter(const QSet<uint16_t>& pids)
+{
+    m_pidFilter = pids;
+}
+
+// Runs the whole job on the calling (worker) thread
+void TsParser::execute()
+{
+    TS_TRACE_SPAN("job", TsTrace::enabled() ? TsTrace::intern(QFile::encodeName(m_filePath).toStdString()) : "");
+    // decoded chunks count like the read buffer
+    auto decompress = dynamic_cast<TsDecompressInput*>(m_input.data());
+    if (decompress != nullptr)
+        decompress->setMemoryAccount(&m_demuxer->memory());
+    if (!m_input->open())
+    {
+        emit notifyError(tr("Cannot open source file: ") + QString::fromStdString(m_input->errorString()));
+        m_state.store(TS_JOB_STATE_FAILED, std::memory_order_release);
+        emit notifyDone(this);
+        return;
+    }
+
+    m_fileSize = m_input->size();
+    m_bytesTotal.store(m_fileSize, std::memory_order_relaxed);
+    m_startNs.store(monotonicNs(), std::memory_order_relaxed);
+    m_state.store(TS_JOB_STATE_RUNNING, std::memory_order_release);
+    emit notifyStart(this);
+
+    // streams (stdin, udp://) are written to the working directory
+    QFileInfo fileInfo(m_filePath);
+    auto isStream = m_filePath == QLatin1String("-") || m_filePath.contains(QLatin1String("://"));
+    auto outputDir = !m_outputDir.isEmpty() ? m_outputDir : isStream ? QString(".") : fileInfo.path();
+    auto baseName = !isStream ? fileInfo.baseName() : m_filePath == QLatin1String("-") ? QString("stdin")
+        : m_filePath.section('?', 0, 0).replace(QRegularExpression("[^0-9A-Za-z]+"), "_");
+    m_writer.reset(new TsEsWriter(QFile::encodeName(outputDir).toStdString(),
+        QFile::encodeName(baseName).toStdString()));
+
+    std::set<uint16_t> pids(m_pidFilter.begin(), m_pidFilter.end());
+    m_writer->setPidFilter(pids);
+    m_writer->setCompression(m_compression);
+    m_writer->setMemoryAccount(&m_demuxer->memory());
+    m_demuxer->setLowLatency(m_lowLatency);
+    if (m_remux)
+    {
+        m_remuxer.reset(new TsSptsWriter(QFile::encodeName(outputDir).toStdString(),
+            QFile::encodeName(baseName).toStdString()));
+        m_demuxer->setPacketSink(m_remuxer.data());
+    }
+    if (m_mp4)
+    {
+        m_muxer.reset(new TsMp4Writer(QFile::encodeName(outputDir).toStdString(),
+            QFile::encodeName(baseName).toStdString()));
+        m_muxer->setMemoryAccount(&m_demuxer->memory());
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    auto cpuStart = threadCpuTimeNs();
+
+    int32_t code = m_demuxer->process();
+
+    m_stats.result = code;
+    m_stats.bytes = m_fileSize < 0 ? m_demuxer->getPosition() : qMin(m_demuxer->getPosition(), m_fileSize);
+    m_stats.packets = m_demuxer->getPackets();
+    m_stats.wallTimeNs = timer.nsecsElapsed();
+    m_stats.cpuTimeNs = threadCpuTimeNs() - cpuStart;
+    m_stats.stages = m_demuxer->stats().snapshot();
+    // parse state back to the cache of this worker
+    m_demuxer->release();
+    m_stats.memoryPeak = m_demuxer->memory().peak();
+
+    m_bytesDone.store(m_stats.bytes, std::memory_order_relaxed);
+    m_endNs.store(monotonicNs(), std::memory_order_relaxed);
 
-    int32_t code = process();
     switch (code)
     {
     case AVCONTEXT_TS_ERROR:
@@ -71,235 +251,115 @@ void TsParser::run()
         emit notifyError(tr("*** SUCCESS ***"));
         break;
     }
-    emit notifyDone(101, currentThreadId());
-    QThread::exec();
-}
-
-const uint8_t* TsParser::read(const int64_t& position, int32_t sizeToRead, bool &bEof)
-{
-    // out of range
-    if (sizeToRead > static_cast<int64_t>(m_buffer.size()))
-        return nullptr;
 
-    // already read?
-    auto sz = avRbe_ - m_buffer.data();
-    if (position < avPos_ || position > avPos_ + sz)
+    m_writer.reset();
+    if (m_muxer)
     {
-
-        // seek and reset buffer
-        int64_t ret = -1;
-        if (m_file.seek(position))
-            ret = m_file.pos();
-
-        if (ret != 0)
-            return nullptr;
-
-        avPos_ = position;
-        avRbs_ = avRbe_ = m_buffer.data();
-
+        m_muxer->close();
+        if (!m_muxer->errorString().empty())
+            emit notifyError(QString::fromStdString(m_muxer->errorString()));
+        m_muxer.reset();
+        m_muxed.clear();
     }
-    else
+    if (m_remuxer)
     {
-        // move to the desired pos in buffer
-        avRbs_ = m_buffer.data() + (position - avPos_);
+        m_remuxer->close();
+        if (!m_remuxer->errorString().empty())
+            emit notifyError(QString::fromStdString(m_remuxer->errorString()));
+        m_demuxer->setPacketSink(nullptr);
+        m_remuxer.reset();
     }
+    m_input->close();
 
-    m_progress = qRound(qreal(avPos_) * 100.0 / m_file.size());
-
-    emit notifyDone(m_progress, currentThreadId());
-
-    auto dataread = avRbe_ - avRbs_;
-    if (dataread >= sizeToRead)
-        return avRbs_;
-
-    memmove(m_buffer.data(), avRbs_, static_cast<uint64_t>(dataread));
-    avRbs_ = m_buffer.data();
-    avRbe_ = avRbs_ + dataread;
-    avPos_ = position;
-
-    auto len = (static_cast<int64_t>(m_buffer.size()) - dataread);
-    while (len > 0)
-    {
-        int64_t readResult = m_file.read(reinterpret_cast<char*>(avRbe_), len);
-
-        if(readResult == 0)
-            bEof = true;
-
-        if (readResult > 0)
-        {
-            avRbe_ += readResult;
-            dataread += readResult;
-            len -= readResult;
-        }
-
-        if (dataread >= sizeToRead || readResult <= 0)
-            break;
-    }
-
-    return dataread >= sizeToRead ? avRbs_ : nullptr;
-
-}
-
-int32_t TsParser::process()
-{
-    int32_t ret = 0;
-    while (true)
-    {
-        ret = AVContext_->TSResync();
-        if (ret != AVCONTEXT_CONTINUE)
-            break;
-
-        ret = AVContext_->processTSPackage();
-        if (AVContext_->hasPIDStreamData())
-        {
-            STREAM_PKG pkg;
-            while (getStreamData(&pkg))
-            {
-                if (pkg.streamChange)
-                    showStreamInfo(pkg.pid);
-                writeStreamData(&pkg);
-            }
-        }
-
-        if (AVContext_->hasPIDPayload())
-        {
-            ret = AVContext_->processTSPayload();
-            if (ret == AVCONTEXT_PROGRAM_CHANGE)
-            {
-                registerPmt();
-                QVector<TsStream*> streams = AVContext_->getStreams();
-                QVector<TsStream*>::const_iterator It = streams.begin();
-                for (; It != streams.end(); ++It)
-                {
-                    if ((*It)->hasStreamInfo_)
-                        showStreamInfo((*It)->pid_);
-                }
-            }
-        }
-
-        if (ret == AVCONTEXT_TS_ERROR)
-            AVContext_->shift();
-        else
-            AVContext_->goNext();
-    }
-    return ret;
+    if (code == AVCONTEXT_EOF_3)
+        m_state.store(TS_JOB_STATE_FINISHED, std::memory_order_release);
+    else if (m_cancelled.load())
+        m_state.store(TS_JOB_STATE_CANCELLED, std::memory_order_release);
+    else
+        m_state.store(TS_JOB_STATE_FAILED, std::memory_order_release);
+    emit notifyDone(this);
 }
 
-bool TsParser::getStreamData(STREAM_PKG* pkg)
+bool TsParser::openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType)
 {
-    TsStream* es = AVContext_->getPIDStream();
-    if (es == nullptr)
-        return false;
-
-    if (!es->getStreamPackage(pkg))
-        return false;
-
-    if (pkg->duration > 180000)
+    std::string fileName;
+    if (m_muxer && (m_pidFilter.isEmpty() || m_pidFilter.contains(pid)) && m_muxer->openStream(pid, channel, streamType))
     {
-        pkg->duration = 0;
+        m_muxed.insert(pid, channel);
+        fileName = m_muxer->fileName(channel);
     }
-    else if (pkg->pid == mainStreamPID_)
+    else
     {
-        // Fill duration map for main stream
-        curTime_ += pkg->duration;
-        if (curTime_ >= pinTime_)
+        m_muxed.remove(pid);
+        if (!m_writer->openStream(pid, channel, streamType))
         {
-            pinTime_ += POSMAP_PTS_INTERVAL;
-            if (curTime_ > endTime_)
-            {
-                AV_POSMAP_ITEM item;
-                item.avPts = pkg->pts;
-                item.avPos = AVContext_->getPosition();
-                m_positionMap.insert(curTime_, item);
-                endTime_ = curTime_;
-                emit notifyDone(m_progress, currentThreadId());
-            }
+            if (!m_writer->errorString().empty())
+                emit notifyError(QString::fromStdString(m_writer->errorString()));
+            return false;
         }
+        fileName = m_writer->fileName(pid);
+    }
 
-        // Sync main DTS & PTS
-        absDTS_ = pkg->dts;
-        absPTS_ = pkg->pts;
+    if (m_stats.pids.find(pid) == m_stats.pids.end())
+    {
+        qDebug() << "Stream channel" << channel << "PID" << pid << "codec" << TsStream::getStreamCodecName(streamType)
+                 << "to file" << QString::fromStdString(fileName);
+
+        auto& pidStats = m_stats.pids[pid];
+        pidStats.streamType = streamType;
+        pidStats.frames = 0;
+        pidStats.bytes = 0;
+        pidStats.dropped = 0;
     }
     return true;
 }
 
-void TsParser::resetPosmap()
+void TsParser::streamInfo(const STREAM_INFO& info)
 {
-    if (!m_positionMap.empty())
-    {
-        m_positionMap.clear();
-        pinTime_ = curTime_ = endTime_ = 0;
-    }
+    if (m_muxed.contains(info.pid))
+        m_muxer->streamInfo(info);
+    emit streamFound(info, this);
 }
 
-void TsParser::registerPmt()
+bool TsParser::writeFrame(const STREAM_PKG& pkg)
 {
-    auto esStreams = AVContext_->getStreams();
-
-    if (esStreams.empty())
-        return;
-
-    mainStreamPID_ = esStreams[0]->pid_;
-
-    for (auto &stream : esStreams)
+    auto It = m_muxed.find(pkg.pid);
+    if (It != m_muxed.end())
     {
-
-        auto channel = AVContext_->getChannel(stream->pid_);
-        auto codecName = stream->getStreamCodec();
-        auto extension = stream->getFileExtension(stream->streamType_);
-        auto fIt = outfiles_.find(stream->pid_);
-        if (fIt != outfiles_.end())
-            continue;
-
-        QFileInfo fileInfo(m_file.fileName());
-        auto filename = QString("%1/%2_stream_%3_%4_%5%6")
-            .arg(fileInfo.path())
-            .arg(fileInfo.baseName())
-            .arg(channel)
-            .arg(stream->pid_)
-            .arg(codecName)
-            .arg(extension);
-
-        qDebug() << "Stream channel" << channel << "PID" << stream->pid_ << "codec" << codecName << "to file" << filename;
-
-        auto &outFile = outfiles_[stream->pid_];
-        outFile.setFileName(filename);
-        if (!outFile.open(QIODevice::WriteOnly | QFile::Truncate))
+        auto dropped = m_muxer->dropped();
+        if (!m_muxer->writeFrame(pkg))
         {
-            emit notifyError(tr("Unable to open\n %1 \n %2").arg(outFile.fileName()).arg(outFile.errorString()));
-            return;
+            // not muxable after all (LATM, no frame before the moov): written raw
+            auto channel = It.value();
+            m_muxed.erase(It);
+            if (!m_writer->openStream(pkg.pid, channel, m_stats.pids[pkg.pid].streamType) || !m_writer->writeFrame(pkg))
+                return false;
+        }
+        else if (m_muxer->dropped() != dropped)
+        {
+            // video before its first keyframe
+            m_stats.pids[pkg.pid].dropped++;
+            return true;
         }
-
-        AVContext_->startStreaming(stream->pid_);
     }
-}
-
-void TsParser::showStreamInfo(uint16_t pid)
-{
-    auto es = AVContext_->getStream(pid);
-    if (es == nullptr)
-        return;
+    else if (!m_writer->writeFrame(pkg))
+        return false;
 
-    es->streamInfo_.pid = pid;
-    es->streamInfo_.channel = AVContext_->getChannel(pid);
-    strcpy(es->streamInfo_.codecName, es->getStreamCodec().toStdString().c_str());
-    emit streamFound(es->streamInfo_, this);
+    auto& pidStats = m_stats.pids[pkg.pid];
+    pidStats.frames++;
+    pidStats.bytes += pkg.size;
+    return true;
 }
 
-void TsParser::writeStreamData(STREAM_PKG* pkg)
+// published only, the UI polls progressInfo()
+void TsParser::progress(int64_t position)
 {
-    if (pkg == nullptr)
-        return;
-
-    if (pkg->size > 0 && pkg->data)
+    // a followed recording grows while it is read
+    auto size = m_input->size();
+    if (size > m_fileSize)
     {
-        auto It = outfiles_.find(pkg->pid);
-        if (It != outfiles_.end())
-        {
-            auto c = It->second.write(reinterpret_cast<const char*>(pkg->data), pkg->size);
-            It->second.flush();
-            if (c != pkg->size)
-                AVContext_->stopStreaming(pkg->pid);
-        }
+        m_fileSize = size;
+        m_bytesTotal.store(size, std::memory_order_relaxed);
     }
+    m_bytesDone.store(m_fileSize > 0 ? qMin(position, m_fileSize) : position, std::memory_order_relaxed);
 }
@@ -1,81 +1,154 @@
 #ifndef TSPARSER_H
 #define TSPARSER_H
 
-#include "tsstream.h"
+#include "tsdemuxer.h"
+#include "tseswriter.h"
+#include "tsmp4.h"
+#include "tsremux.h"
+#include "tsscheduler.h"
 
 #include <QThread>
 #include <QMap>
+#include <QSet>
 #include <QFile>
+#include <QStringList>
 
-#define AV_BUFFER_SIZE       (131072)
-#define POSMAP_PTS_INTERVAL  (270000LL)
+#include <atomic>
 
-///////////////////////////////////////////////////////////
-class AVContext;
+struct TS_PID_STATS
+{
+    STREAM_TYPE streamType;
+    int64_t     frames;     // frames written
+    int64_t     bytes;      // bytes written
+    int64_t     dropped;    // frames not written, MP4 video before its first keyframe
+};
+
+struct TS_PARSER_STATS
+{
+    int32_t  result;        // AVCONTEXT_* code that ended the job
+    int64_t  bytes;         // source bytes consumed
+    int64_t  packets;       // TS packets processed
+    int64_t  wallTimeNs;
+    int64_t  cpuTimeNs;     // CPU time of the worker thread
+    int64_t  memoryPeak;    // peak bytes charged to the memory budget
+    std::map<uint16_t, TS_PID_STATS> pids;
+    TS_STATS_SNAPSHOT stages;   // zero unless TsStats::enabled()
+};
+
+enum TS_JOB_STATE
+{
+    TS_JOB_STATE_QUEUED = 0,
+    TS_JOB_STATE_RUNNING,
+    TS_JOB_STATE_FINISHED,
+    TS_JOB_STATE_FAILED,
+    TS_JOB_STATE_CANCELLED
+};
 
-class TsParser : public QThread
+struct TS_JOB_PROGRESS
+{
+    TS_JOB_STATE state;
+    int64_t  bytesDone;
+    int64_t  bytesTotal;     // -1: unknown
+    double   bytesPerSecond;
+    int64_t  etaMs;          // -1: unknown
+    int64_t  memoryBytes;    // bytes charged to the memory budget
+    int64_t  memoryPeak;
+};
+
+///////////////////////////////////////////////////////////
+// Qt job around the demuxer core: splits one file into elementary stream
+// files. State transitions are signalled; progress is published through
+// atomics for the UI to poll (progressInfo()) at its own rate.
+class TsParser : public QObject, public TsJob, private TsFrameSink
 {
     Q_OBJECT
 
 public:
-    TsParser(const QString& filePath, QObject* parent);
+    TsParser(const QString& filePath, QObject* parent = nullptr);
+    // the files are split as one contiguous stream into one set of outputs
+    TsParser(const QStringList& filePaths, QObject* parent = nullptr);
     ~TsParser();
 
-    bool start();
-    const uint8_t* read(const int64_t& position, int32_t sizeToRead, bool &bEof);
+    void execute() override;
+    void cancel() override;
+    QString sourcePath() const override
+    {
+        return m_filePath;
+    }
+
+    // must be set before the job is executed
+    void setOutputDir(const QString& outputDir);
+    void setProgram(uint16_t channel);
+    void setPidFilter(const QSet<uint16_t>& pids);
+    // read a recording that is still being written, -1: off
+    void setFollow(int32_t idleTimeoutMs);
+    void setLowLatency(bool enabled);
+    // zstd levels of the outputs by stream type, see TsEsWriter
+    void setCompression(const std::map<STREAM_TYPE, int32_t>& levels);
+    // every program is also written as a single program transport stream
+    void setRemux(bool enabled);
+    // H.264 and AAC of every program are written as fragmented MP4 instead
+    void setMp4(bool enabled);
+
     inline const QString getSourceName()
     {
-        return m_file.fileName();
+        return m_filePath;
+    }
+
+    // valid once the job is finished
+    inline const TS_PARSER_STATS& stats() const
+    {
+        return m_stats;
+    }
+    // thread safe, may be polled while the job runs
+    TS_JOB_PROGRESS progressInfo() const;
+
+    // per stage counters, may be polled while the job runs
+    inline TS_STATS_SNAPSHOT statsSnapshot() const
+    {
+        return m_demuxer->stats().snapshot();
     }
 
 Q_SIGNALS:
     void streamFound(const STREAM_INFO& streamInfo, TsParser* self);
     void notifyError(const QString& info);
-    void notifyStart(Qt::HANDLE threadId, TsParser* self);
-    void notifyDone(int32_t percent, Qt::HANDLE threadId);
-
-protected:
-    int32_t process();
-    void run();
-
-private:
-    bool getStreamData(STREAM_PKG* pkg);
-    void resetPosmap();
-    void registerPmt();
-    void writeStreamData(STREAM_PKG* pkg);
-    void showStreamInfo(uint16_t pid);
+    void notifyStart(TsParser* self);
+    void notifyDone(TsParser* self);
 
 private:
-    uint8_t channels_;
-
-    std::map<uint16_t, QFile> outfiles_;
-
-    // AV raw buffer
-    std::vector<uint8_t> m_buffer;// buffer
-    int64_t  avPos_;             // absolute position in av
-    uint8_t* avRbs_;             // raw data start in buffer
-    uint8_t* avRbe_;             // raw data end in buffer
-
-    // playback context
-    QScopedPointer<AVContext> AVContext_;
+    static TsInput* createInput(const QStringList& filePaths);
 
-    uint16_t mainStreamPID_;     // PID of main stream
-    int64_t  absDTS_;            // absolute decode time of main stream
-    int64_t  absPTS_;            // absolute presentation time of main stream
-    int64_t  pinTime_;           // pinned relative position (90Khz)
-    int64_t  curTime_;           // current relative position (90Khz)
-    int64_t  endTime_;           // last relative marked position (90Khz))
+    // TsFrameSink
+    bool openStream(uint16_t pid, uint16_t channel, STREAM_TYPE streamType) override;
+    void streamInfo(const STREAM_INFO& info) override;
+    bool writeFrame(const STREAM_PKG& pkg) override;
+    void progress(int64_t position) override;
 
-    struct AV_POSMAP_ITEM
-    {
-        int64_t avPts;
-        int64_t avPos;
-    };
-
-    QMap<int64_t, AV_POSMAP_ITEM> m_positionMap;
-
-    int32_t m_progress = 0;
-    QFile   m_file;
+private:
+    QString     m_filePath;
+    QString     m_outputDir;
+    QSet<uint16_t> m_pidFilter;
+    int64_t     m_fileSize = 0;
+    bool        m_lowLatency = false;
+    bool        m_remux = false;
+    bool        m_mp4 = false;
+    std::map<STREAM_TYPE, int32_t> m_compression;
+
+    // published to the polling thread
+    std::atomic<int32_t> m_state;
+    std::atomic<int64_t> m_bytesDone;
+    std::atomic<int64_t> m_bytesTotal;
+    std::atomic<int64_t> m_startNs;
+    std::atomic<int64_t> m_endNs;
+    std::atomic<bool>    m_cancelled;
+
+    QScopedPointer<TsInput>    m_input;
+    QScopedPointer<TsEsWriter> m_writer;
+    QScopedPointer<TsSptsWriter> m_remuxer;
+    QScopedPointer<TsMp4Writer> m_muxer;
+    QMap<uint16_t, uint16_t> m_muxed;       // PID: channel of the streams in the MP4
+    QScopedPointer<TsDemuxer>  m_demuxer;
+    TS_PARSER_STATS m_stats;
 };
 
 #endif // TSPARSER_H
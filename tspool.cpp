@@ -0,0 +1,48 @@
+#include "tspool.h"
+
+////////////////////////////////////////////////////////////////////
+TsBufferPool::TsBufferPool(int32_t blockSize, int32_t blocksPerSlab, TsArena* arena)
+    : blockSize_((blockSize + static_cast<int32_t>(alignof(FREE_BLOCK)) - 1) & ~(static_cast<int32_t>(alignof(FREE_BLOCK)) - 1)),
+    blocksPerSlab_(blocksPerSlab > 0 ? blocksPerSlab : 1),
+    arena_(arena),
+    free_(nullptr)
+{
+}
+
+TsBufferPool::~TsBufferPool()
+{
+    for (auto slab : slabs_)
+    {
+        if (arena_ != nullptr)
+            arena_->deallocate(slab, static_cast<size_t>(blockSize_) * blocksPerSlab_);
+        else
+            delete[] slab;
+    }
+}
+
+uint8_t* TsBufferPool::acquire()
+{
+    if (free_ == nullptr)
+    {
+        // default-initialized: no zero fill
+        auto size = static_cast<size_t>(blockSize_) * blocksPerSlab_;
+        auto slab = static_cast<uint8_t*>(arena_ != nullptr ? arena_->allocate(size) : new uint8_t[size]);
+        slabs_.push_back(slab);
+        for (int32_t i = blocksPerSlab_ - 1; i >= 0; i--)
+            release(slab + static_cast<size_t>(i) * blockSize_);
+    }
+
+    auto block = free_;
+    free_ = block->next;
+    return reinterpret_cast<uint8_t*>(block);
+}
+
+void TsBufferPool::release(uint8_t* block)
+{
+    if (block == nullptr)
+        return;
+
+    auto item = reinterpret_cast<FREE_BLOCK*>(block);
+    item->next = free_;
+    free_ = item;
+}
@@ -0,0 +1,44 @@
+#ifndef TSPOOL_H
+#define TSPOOL_H
+
+#include "tsarena.h"
+
+#include <cstdint>
+#include <vector>
+
+///////////////////////////////////////////////////////////
+// Fixed size blocks carved from slabs and recycled through a free list.
+// Blocks are not zero-filled. Not thread safe: one pool per demuxer context.
+// Slabs come from the arena when there is one.
+class TSSPLIT_EXPORT TsBufferPool
+{
+public:
+    // blocks still handed out become invalid with the pool
+    TsBufferPool(int32_t blockSize, int32_t blocksPerSlab, TsArena* arena = nullptr);
+    ~TsBufferPool();
+
+    uint8_t* acquire();
+    void release(uint8_t* block);
+
+    inline int32_t blockSize() const
+    {
+        return blockSize_;
+    }
+
+private:
+    TsBufferPool(const TsBufferPool&);
+    TsBufferPool& operator=(const TsBufferPool&);
+
+    struct FREE_BLOCK
+    {
+        FREE_BLOCK* next;
+    };
+
+    int32_t blockSize_;
+    int32_t blocksPerSlab_;
+    TsArena* arena_;
+    FREE_BLOCK* free_;
+    std::vector<uint8_t*> slabs_;
+};
+
+#endif // TSPOOL_H
@@ -0,0 +1,36 @@
+#ifndef TSPROBES_H
+#define TSPROBES_H
+
+// USDT (SystemTap SDT) tracepoints of the "tssplit" provider for bpftrace,
+// perf and SystemTap. Each probe is a single nop in the code plus an ELF note
+// unless a tracer is attached. Without <sys/sdt.h> (systemtap-sdt-dev) or
+// with TSSPLIT_NO_PROBES they compile to nothing. See tools/bpftrace.
+//
+//     sync_loss   (int64 position, int32 skipped)
+//     cc_error    (uint16 pid, uint8 expected, uint8 counter)
+//     pat_version (uint16 transport_stream_id, uint8 version)
+//     pmt_version (uint16 program, uint8 version)
+//     crc_error   (uint16 pid, uint8 table_id)
+//     frame       (uint16 pid, int32 size, int64 pts, int64 duration)
+//     es_overflow (uint16 pid, int32 length, int32 allocated)
+//     short_write (uint16 pid, int64 written, int32 size)
+//     udp_drops   (int32 dropped, uint64 total)
+
+#if !defined (TSSPLIT_NO_PROBES) && defined (__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TSSPLIT_HAVE_PROBES
+#endif
+#endif
+
+#if defined (TSSPLIT_HAVE_PROBES)
+#define TS_PROBE2(name, a1, a2)             DTRACE_PROBE2(tssplit, name, a1, a2)
+#define TS_PROBE3(name, a1, a2, a3)         DTRACE_PROBE3(tssplit, name, a1, a2, a3)
+#define TS_PROBE4(name, a1, a2, a3, a4)     DTRACE_PROBE4(tssplit, name, a1, a2, a3, a4)
+#else
+#define TS_PROBE2(name, a1, a2)             do {} while (0)
+#define TS_PROBE3(name, a1, a2, a3)         do {} while (0)
+#define TS_PROBE4(name, a1, a2, a3, a4)     do {} while (0)
+#endif
+
+#endif // TSPROBES_H
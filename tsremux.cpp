@@ -0,0 +1,204 @@
+#include "tsremux.h"
+#include "tscrc.h"
+#include "tsstats.h"
+#include "tsprobes.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define TS_PID_COUNT    (0x2000)
+#define TS_NULL_PID     (0x1fff)
+
+TsSptsWriter::TsSptsWriter(const std::string& outputDir, const std::string& baseName)
+    : outputDir_(outputDir),
+    baseName_(baseName),
+    pidMask_(TS_PID_COUNT, 0)
+{
+}
+
+TsSptsWriter::~TsSptsWriter()
+{
+    close();
+}
+
+void TsSptsWriter::close()
+{
+    for (auto& output : outputs_)
+    {
+        if (output.file != nullptr)
+        {
+            flush(output);
+            fclose(output.file);
+        }
+    }
+    outputs_.clear();
+    channels_.clear();
+    std::fill(pidMask_.begin(), pidMask_.end(), 0);
+}
+
+void TsSptsWriter::programs(const std::vector<TS_PROGRAM>& programs)
+{
+    std::vector<bool> wasListed;
+    for (auto& output : outputs_)
+    {
+        wasListed.push_back(output.listed);
+        output.listed = false;
+    }
+
+    for (const auto& program : programs)
+    {
+        auto It = channels_.find(program.channel);
+        if (It == channels_.end())
+        {
+            if (outputs_.size() >= TS_REMUX_MAX_PROGRAMS)
+                continue;
+
+            auto name = outputDir_ + "/" + baseName_ + "_program_" + std::to_string(program.channel) + ".ts";
+            auto file = fopen(name.c_str(), "wb");
+            if (file == nullptr)
+                error_ = "Unable to open\n " + name + " \n " + strerror(errno);
+            else
+                // written in batches of whole packets already
+                setvbuf(file, nullptr, _IONBF, 0);
+
+            OUTPUT_PROGRAM output;
+            output.file = file;
+            output.name = name;
+            output.program = program;
+            output.listed = false;
+            output.patVersion = 0;
+            output.patContinuity = 0;
+            output.buffer.resize(TS_REMUX_BATCH * TS_REMUX_PACKET_SIZE);
+            output.used = 0;
+            It = channels_.emplace(program.channel, outputs_.size()).first;
+            outputs_.push_back(std::move(output));
+        }
+
+        // the output starts with its PAT, a changed one is sent right away
+        auto& output = outputs_[It->second];
+        bool sendPat = It->second >= wasListed.size() || !wasListed[It->second];
+        if (!sendPat && (output.program.pmtPid != program.pmtPid ||
+            output.program.transportStreamId != program.transportStreamId))
+        {
+            output.patVersion = (output.patVersion + 1) & 0x1f;
+            sendPat = true;
+        }
+        output.program = program;
+        output.listed = true;
+        if (sendPat)
+            writePat(output);
+    }
+
+    std::fill(pidMask_.begin(), pidMask_.end(), 0);
+    for (size_t i = 0; i < outputs_.size(); i++)
+    {
+        const auto& program = outputs_[i].program;
+        if (!outputs_[i].listed)
+            continue;
+
+        auto bit = 1ULL << i;
+        pidMask_[program.pmtPid] |= bit;
+        if (program.pcrPid != TS_NULL_PID)
+            pidMask_[program.pcrPid] |= bit;
+        for (auto pid : program.pids)
+            pidMask_[pid] |= bit;
+    }
+}
+
+void TsSptsWriter::writePacket(const uint8_t* packet, uint16_t pid)
+{
+    if (pid >= TS_PID_COUNT)
+        return;
+
+    // the PAT is replaced by one per output where it starts
+    if (pid == 0)
+    {
+        if ((packet[1] & 0x40) == 0)
+            return;
+        for (auto& output : outputs_)
+        {
+            if (output.listed)
+                writePat(output);
+        }
+        return;
+    }
+
+    auto mask = pidMask_[pid];
+    for (size_t i = 0; mask != 0; mask >>= 1, i++)
+    {
+        if (mask & 1)
+            append(outputs_[i], packet);
+    }
+}
+
+std::string TsSptsWriter::fileName(uint16_t channel) const
+{
+    auto It = channels_.find(channel);
+    return It == channels_.end() ? std::string() : outputs_[It->second].name;
+}
+
+// PAT section with the program of the output only
+void TsSptsWriter::writePat(OUTPUT_PROGRAM& output)
+{
+    const auto& program = output.program;
+    uint8_t packet[TS_REMUX_PACKET_SIZE];
+    memset(packet, 0xff, sizeof(packet));
+
+    packet[0] = 0x47;
+    packet[1] = 0x40;                   // payload unit start, PID 0
+    packet[2] = 0x00;
+    packet[3] = 0x10 | output.patContinuity;
+    packet[4] = 0x00;                   // pointer field
+    output.patContinuity = (output.patContinuity + 1) & 0x0f;
+
+    uint8_t* section = packet + 5;
+    section[0] = 0x00;                  // table_id
+    section[1] = 0xb0;                  // section_syntax_indicator, length 13
+    section[2] = 13;
+    section[3] = static_cast<uint8_t>(program.transportStreamId >> 8);
+    section[4] = static_cast<uint8_t>(program.transportStreamId);
+    section[5] = static_cast<uint8_t>(0xc1 | (output.patVersion << 1));    // current_next_indicator
+    section[6] = 0x00;                  // section_number
+    section[7] = 0x00;                  // last_section_number
+    section[8] = static_cast<uint8_t>(program.channel >> 8);
+    section[9] = static_cast<uint8_t>(program.channel);
+    section[10] = static_cast<uint8_t>(0xe0 | (program.pmtPid >> 8));
+    section[11] = static_cast<uint8_t>(program.pmtPid);
+
+    auto crc = tsCrc32(section, 12);
+    section[12] = static_cast<uint8_t>(crc >> 24);
+    section[13] = static_cast<uint8_t>(crc >> 16);
+    section[14] = static_cast<uint8_t>(crc >> 8);
+    section[15] = static_cast<uint8_t>(crc);
+
+    append(output, packet);
+}
+
+void TsSptsWriter::append(OUTPUT_PROGRAM& output, const uint8_t* packet)
+{
+    memcpy(output.buffer.data() + output.used, packet, TS_REMUX_PACKET_SIZE);
+    output.used += TS_REMUX_PACKET_SIZE;
+    if (output.used == output.buffer.size())
+        flush(output);
+}
+
+bool TsSptsWriter::flush(OUTPUT_PROGRAM& output)
+{
+    auto used = output.used;
+    output.used = 0;
+    if (output.file == nullptr || used == 0)
+        return output.file != nullptr;
+
+    auto c = fwrite(output.buffer.data(), 1, used, output.file);
+    TS_STAT_ADD(TS_STAT_BYTES_WRITTEN, c);
+    if (c != used)
+    {
+        TS_PROBE3(short_write, output.program.pmtPid, static_cast<int64_t>(c), static_cast<int64_t>(used));
+        error_ = "Unable to write\n " + output.name + " \n " + strerror(errno);
+        fclose(output.file);
+        output.file = nullptr;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef TSREMUX_H
+#define TSREMUX_H
+
+#include "tsdemuxer.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#define TS_REMUX_PACKET_SIZE    (188)
+// packets collected per program before they are written at once
+#define TS_REMUX_BATCH          (348)
+// programs of a stream written at most, PIDs are mapped by bit
+#define TS_REMUX_MAX_PROGRAMS   (64)
+
+///////////////////////////////////////////////////////////
+// Writes every program to its own single program transport stream named
+// <outputDir>/<baseName>_program_<channel>.ts: a rewritten PAT listing only
+// the program, its original PMT and the packets of its PIDs (elementary
+// streams and PCR). Null packets and the other tables are dropped. Packets
+// are copied whole, 188 bytes (timecodes of 192 byte packets are dropped),
+// and written in batches.
+class TSSPLIT_EXPORT TsSptsWriter : public TsPacketSink
+{
+public:
+    TsSptsWriter(const std::string& outputDir, const std::string& baseName);
+    ~TsSptsWriter() override;
+
+    void close();
+
+    // TsPacketSink
+    void programs(const std::vector<TS_PROGRAM>& programs) override;
+    void writePacket(const uint8_t* packet, uint16_t pid) override;
+
+    std::string fileName(uint16_t channel) const;
+    inline const std::string& errorString() const
+    {
+        return error_;
+    }
+
+private:
+    TsSptsWriter(const TsSptsWriter&);
+    TsSptsWriter& operator=(const TsSptsWriter&);
+
+    struct OUTPUT_PROGRAM
+    {
+        FILE*       file;
+        std::string name;
+        TS_PROGRAM  program;
+        bool        listed;          // in the current PAT
+        uint8_t     patVersion;
+        uint8_t     patContinuity;
+        std::vector<uint8_t> buffer;
+        size_t      used;            // bytes in buffer
+    };
+
+    void writePat(OUTPUT_PROGRAM& output);
+    void append(OUTPUT_PROGRAM& output, const uint8_t* packet);
+    bool flush(OUTPUT_PROGRAM& output);
+
+    std::string outputDir_;
+    std::string baseName_;
+    std::string error_;
+    std::vector<OUTPUT_PROGRAM> outputs_;
+    std::map<uint16_t, size_t> channels_;   // channel: index in outputs_
+    std::vector<uint64_t> pidMask_;         // PID: bit per output
+};
+
+#endif // TSREMUX_H
@@ -0,0 +1,343 @@
+#include "tsscheduler.h"
+#include "tstrace.h"
+#include "tsbudget.h"
+
+#include <QThread>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+
+// concurrent jobs per device when the kind of storage is unknown
+#define TS_DEVICE_DEFAULT_SLOTS 2
+// pseudo device of network sources, not limited
+#define TS_NETWORK_DEVICE       "network"
+
+///////////////////////////////////////////////////////////
+class TsScheduler::Worker : public QThread
+{
+public:
+    Worker(TsScheduler& scheduler, int32_t index)
+        : scheduler_(scheduler),
+        index_(index)
+    {
+    }
+
+protected:
+    void run() override
+    {
+        TsTrace::setThreadName("worker " + std::to_string(index_));
+        scheduler_.workerLoop(index_);
+    }
+
+private:
+    TsScheduler& scheduler_;
+    int32_t      index_;
+};
+
+////////////////////////////////////////////////////////////////////
+TsScheduler::TsScheduler(int32_t workers, QObject* parent)
+    : QObject(parent),
+    deviceLimit_(0),
+    pending_(0),
+    active_(0),
+    next_(0),
+    generation_(0),
+    stop_(false)
+{
+    qRegisterMetaType<TsJob*>("TsJob*");
+
+    if (workers <= 0)
+        workers = QThread::idealThreadCount();
+    if (workers <= 0)
+        workers = 1;
+
+    for (int32_t i = 0; i < workers; i++)
+        queues_.emplace_back(new JOB_QUEUE());
+
+    for (int32_t i = 0; i < workers; i++)
+        workers_.push_back(new Worker(*this, i));
+    for (auto worker : workers_)
+        worker->start();
+}
+
+TsScheduler::~TsScheduler()
+{
+    shutdown();
+}
+
+bool TsScheduler::submit(TsJob* job, TS_JOB_PRIORITY priority)
+{
+    if (job == nullptr)
+        return false;
+
+    JOB_ENTRY entry;
+    entry.job = job;
+    entry.device = deviceOf(job->sourcePath());
+
+    int32_t index;
+    {
+        QMutexLocker g(&lock_);
+        if (stop_)
+            return false;
+        index = next_;
+        next_ = (next_ + 1) % workerCount();
+        pending_++;
+    }
+
+    {
+        auto& queue = *queues_[index];
+        QMutexLocker g(&queue.lock);
+        queue.jobs[priority].push_back(entry);
+    }
+
+    QMutexLocker g(&lock_);
+    generation_++;
+    wake_.wakeAll();
+    return true;
+}
+
+// 0: limit from the kind of storage
+void TsScheduler::setDeviceLimit(int32_t limit)
+{
+    QMutexLocker g(&lock_);
+    deviceLimit_ = limit;
+    deviceSlots_.clear();
+}
+
+void TsScheduler::waitForDone()
+{
+    QMutexLocker g(&lock_);
+    while (pending_ > 0 || active_ > 0)
+        idle_.wait(&lock_);
+}
+
+// Stop the workers. Running jobs are cancelled and waited for, queued jobs are
+// dropped and returned to the caller
+QVector<TsJob*> TsScheduler::shutdown()
+{
+    QVector<TsJob*> dropped;
+
+    {
+        QMutexLocker g(&lock_);
+        if (stop_)
+            return dropped;
+        stop_ = true;
+        for (auto job : running_)
+            job->cancel();
+        generation_++;
+        wake_.wakeAll();
+    }
+
+    for (auto worker : workers_)
+    {
+        worker->wait();
+        delete worker;
+    }
+    workers_.clear();
+
+    for (auto& queue : queues_)
+    {
+        QMutexLocker g(&queue->lock);
+        for (auto& jobs : queue->jobs)
+        {
+            for (auto& entry : jobs)
+                dropped.push_back(entry.job);
+            jobs.clear();
+        }
+    }
+
+    QMutexLocker g(&lock_);
+    pending_ = 0;
+    idle_.wakeAll();
+    return dropped;
+}
+
+void TsScheduler::workerLoop(int32_t index)
+{
+    while (true)
+    {
+        uint64_t generation;
+        {
+            QMutexLocker g(&lock_);
+            if (stop_)
+                return;
+            generation = generation_;
+        }
+
+        JOB_ENTRY entry;
+        if (!takeJob(index, entry))
+        {
+            // nothing eligible: sleep until a job is submitted or a device is released
+            QMutexLocker g(&lock_);
+            if (!stop_ && generation == generation_)
+                wake_.wait(&lock_);
+            continue;
+        }
+
+        {
+            QMutexLocker g(&lock_);
+            pending_--;
+            active_++;
+            running_.push_back(entry.job);
+            if (stop_)
+                entry.job->cancel();
+        }
+
+        emit jobStarted(entry.job);
+        entry.job->execute();
+
+        {
+            QMutexLocker g(&lock_);
+            running_.removeOne(entry.job);
+            releaseDevice(entry.device);
+            generation_++;
+            wake_.wakeAll();
+        }
+
+        // receivers may delete the job: it is no longer referenced
+        emit jobFinished(entry.job);
+
+        QMutexLocker g(&lock_);
+        active_--;
+        idle_.wakeAll();
+    }
+}
+
+// Priorities are honored across all queues: a high priority job anywhere is
+// preferred over a normal one in the own queue.
+bool TsScheduler::takeJob(int32_t index, JOB_ENTRY& entry)
+{
+    if (!admitJob())
+        return false;
+
+    auto count = workerCount();
+    for (int32_t priority = 0; priority < TS_JOB_PRIORITY_COUNT; priority++)
+    {
+        if (takeFrom(index, priority, false, entry))
+            return true;
+
+        for (int32_t i = 1; i < count; i++)
+        {
+            if (takeFrom((index + i) % count, priority, true, entry))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Owner takes from the front, thieves from the back. Jobs whose device is busy
+// are skipped and stay in place.
+bool TsScheduler::takeFrom(int32_t index, int32_t priority, bool steal, JOB_ENTRY& entry)
+{
+    auto& queue = *queues_[index];
+    QMutexLocker g(&queue.lock);
+
+    auto& jobs = queue.jobs[priority];
+    if (jobs.empty())
+        return false;
+
+    auto count = static_cast<int32_t>(jobs.size());
+    for (int32_t i = 0; i < count; i++)
+    {
+        auto It = steal ? jobs.begin() + (count - 1 - i) : jobs.begin() + i;
+        if (acquireDevice(It->device))
+        {
+            entry = *It;
+            jobs.erase(It);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Memory is returned when jobs finish, which wakes the workers again
+bool TsScheduler::admitJob()
+{
+    QMutexLocker g(&lock_);
+    return active_ == 0 || TsMemoryBudget::global().fits(TS_BUDGET_JOB_RESERVE);
+}
+
+bool TsScheduler::acquireDevice(const QString& device)
+{
+    QMutexLocker g(&lock_);
+    auto& busy = deviceBusy_[device];
+    if (busy >= deviceLimit(device))
+        return false;
+    busy++;
+    return true;
+}
+
+// lock_ must be held
+void TsScheduler::releaseDevice(const QString& device)
+{
+    auto It = deviceBusy_.find(device);
+    if (It != deviceBusy_.end() && --It.value() <= 0)
+        deviceBusy_.erase(It);
+}
+
+// lock_ must be held
+int32_t TsScheduler::deviceLimit(const QString& device)
+{
+    if (device == QLatin1String(TS_NETWORK_DEVICE))
+        return workerCount();
+    if (deviceLimit_ > 0)
+        return deviceLimit_;
+
+    auto It = deviceSlots_.find(device);
+    if (It != deviceSlots_.end())
+        return It.value();
+
+    int32_t limit;
+    switch (isRotational(device))
+    {
+    case 1:
+        limit = 1;
+        break;
+    case 0:
+        limit = workerCount();
+        break;
+    default:
+        limit = TS_DEVICE_DEFAULT_SLOTS;
+        break;
+    }
+    deviceSlots_.insert(device, limit);
+    return limit;
+}
+
+QString TsScheduler::deviceOf(const QString& path)
+{
+    // network sources do not occupy a storage device
+    if (path.contains(QLatin1String("://")))
+        return QString(TS_NETWORK_DEVICE);
+
+    QStorageInfo storage(QFileInfo(path).absolutePath());
+    if (!storage.isValid())
+        return QString();
+    return QString::fromLocal8Bit(storage.device());
+}
+
+// returns 1 for spinning disks, 0 for solid state, -1 when unknown
+int32_t TsScheduler::isRotational(const QString& device)
+{
+#if defined (Q_OS_LINUX)
+    if (!device.startsWith(QLatin1String("/dev/")))
+        return -1;
+
+    // partitions keep the queue attributes on the parent disk
+    auto name = device.mid(5);
+    const QString candidates[] = {
+        QString("/sys/class/block/%1/queue/rotational").arg(name),
+        QString("/sys/class/block/%1/../queue/rotational").arg(name)
+    };
+
+    for (auto& candidate : candidates)
+    {
+        QFile file(candidate);
+        if (file.open(QFile::ReadOnly))
+            return file.readAll().trimmed() == "1" ? 1 : 0;
+    }
+#else
+    Q_UNUSED(device);
+#endif
+    return -1;
+}
@@ -0,0 +1,115 @@
+#ifndef TSSCHEDULER_H
+#define TSSCHEDULER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QMap>
+#include <QVector>
+
+#include <deque>
+#include <memory>
+
+enum TS_JOB_PRIORITY
+{
+    TS_JOB_PRIORITY_HIGH = 0,
+    TS_JOB_PRIORITY_NORMAL,
+    TS_JOB_PRIORITY_LOW,
+    TS_JOB_PRIORITY_COUNT
+};
+
+///////////////////////////////////////////////////////////
+// Unit of work executed by the scheduler on one of its workers.
+// The job is executed synchronously on the worker thread and must not
+// enter an event loop.
+class TsJob
+{
+public:
+    virtual ~TsJob() {}
+
+    virtual void execute() = 0;
+    virtual void cancel() = 0;
+    // path used to find the storage device the job reads from
+    virtual QString sourcePath() const = 0;
+};
+
+Q_DECLARE_METATYPE(TsJob*)
+
+///////////////////////////////////////////////////////////
+// Fixed pool of workers. Every worker owns a queue per priority; submitted
+// jobs are spread round-robin over the queues. A worker takes from the front
+// of its own queue and steals from the back of the others when it runs dry.
+// Jobs reading from the same storage device are limited to a number of
+// concurrent workers (1 for rotational disks) so a big batch does not thrash
+// the disk and the page cache. No job is started while TsMemoryBudget::global()
+// cannot fit another one, unless nothing runs.
+class TsScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    TsScheduler(int32_t workers = 0, QObject* parent = nullptr);
+    ~TsScheduler();
+
+    // false after shutdown(): the job stays with the caller
+    bool submit(TsJob* job, TS_JOB_PRIORITY priority = TS_JOB_PRIORITY_NORMAL);
+    void setDeviceLimit(int32_t limit);
+    void waitForDone();
+    QVector<TsJob*> shutdown();
+
+    // the queues are complete before the workers start and outlive them
+    inline int32_t workerCount() const
+    {
+        return static_cast<int32_t>(queues_.size());
+    }
+
+Q_SIGNALS:
+    void jobStarted(TsJob* job);
+    void jobFinished(TsJob* job);
+
+private:
+    struct JOB_ENTRY
+    {
+        TsJob*  job;
+        QString device;
+    };
+
+    struct JOB_QUEUE
+    {
+        QMutex lock;
+        std::deque<JOB_ENTRY> jobs[TS_JOB_PRIORITY_COUNT];
+    };
+
+    class Worker;
+
+    void workerLoop(int32_t index);
+    bool takeJob(int32_t index, JOB_ENTRY& entry);
+    bool takeFrom(int32_t index, int32_t priority, bool steal, JOB_ENTRY& entry);
+    bool admitJob();
+    bool acquireDevice(const QString& device);
+    void releaseDevice(const QString& device);
+    int32_t deviceLimit(const QString& device);
+
+    static QString deviceOf(const QString& path);
+    static int32_t isRotational(const QString& device);
+
+private:
+    std::vector<std::unique_ptr<JOB_QUEUE>> queues_;
+    QVector<Worker*> workers_;
+
+    // guards everything below
+    QMutex lock_;
+    QWaitCondition wake_;
+    QWaitCondition idle_;
+    QMap<QString, int32_t> deviceBusy_;
+    QMap<QString, int32_t> deviceSlots_;
+    QVector<TsJob*> running_;
+    int32_t  deviceLimit_;
+    int32_t  pending_;
+    int32_t  active_;
+    int32_t  next_;
+    uint64_t generation_;
+    bool     stop_;
+};
+
+#endif // TSSCHEDULER_H
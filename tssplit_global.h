@@ -0,0 +1,17 @@
+#ifndef TSSPLIT_GLOBAL_H
+#define TSSPLIT_GLOBAL_H
+
+// Symbol visibility of the libtssplit core library
+#if defined (_WIN32) && defined (TSSPLIT_SHARED)
+#  if defined (TSSPLIT_BUILD)
+#    define TSSPLIT_EXPORT __declspec(dllexport)
+#  else
+#    define TSSPLIT_EXPORT __declspec(dllimport)
+#  endif
+#elif defined (__GNUC__) && defined (TSSPLIT_SHARED)
+#  define TSSPLIT_EXPORT __attribute__((visibility("default")))
+#else
+#  define TSSPLIT_EXPORT
+#endif
+
+#endif // TSSPLIT_GLOBAL_H
@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = tssplitter-cli
+QT = core
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(./tscore.pri)
+include(./tsjobs.pri)
+
+HEADERS += ./tsbatch.h
+
+SOURCES += ./climain.cpp \
+    ./tsbatch.cpp
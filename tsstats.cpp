@@ -0,0 +1,172 @@
+#include "tsstats.h"
+
+#include <chrono>
+
+#if defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86)
+#if defined (_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TS_HAVE_TSC
+#endif
+
+std::atomic<bool> TsStats::enabled_(false);
+
+static thread_local TsStats* boundStats = nullptr;
+
+////////////////////////////////////////////////////////////////////
+TsStats::TsStats()
+    : pids_(nullptr)
+{
+    reset();
+}
+
+TsStats::~TsStats()
+{
+    delete[] pids_.load(std::memory_order_relaxed);
+}
+
+void TsStats::setEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+TsStats* TsStats::bound()
+{
+    return boundStats;
+}
+
+// returns the previous block
+TsStats* TsStats::bind(TsStats* stats)
+{
+    auto previous = boundStats;
+    boundStats = stats;
+    return previous;
+}
+
+uint64_t TsStats::ticks()
+{
+#if defined (TS_HAVE_TSC)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+const char* TsStats::tickUnit()
+{
+#if defined (TS_HAVE_TSC)
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+const char* TsStats::counterName(TS_STAT_COUNTER counter)
+{
+    switch (counter)
+    {
+    case TS_STAT_PACKETS:
+        return "packets";
+    case TS_STAT_RESYNC_BYTES:
+        return "resync_bytes";
+    case TS_STAT_CC_ERRORS:
+        return "cc_errors";
+    case TS_STAT_PSI_SECTIONS:
+        return "psi_sections";
+    case TS_STAT_CRC_ERRORS:
+        return "crc_errors";
+    case TS_STAT_PES_UNITS:
+        return "pes_units";
+    case TS_STAT_FRAMES:
+        return "frames";
+    case TS_STAT_BYTES_WRITTEN:
+        return "bytes_written";
+    case TS_STAT_MEMMOVE_BYTES:
+        return "memmove_bytes";
+    case TS_STAT_REALLOCS:
+        return "reallocs";
+    default:
+        return "unknown";
+    }
+}
+
+const char* TsStats::timerName(TS_STAT_TIMER timer)
+{
+    switch (timer)
+    {
+    case TS_STAT_TIMER_PACKAGE:
+        return "process_package";
+    case TS_STAT_TIMER_PAYLOAD:
+        return "process_payload";
+    case TS_STAT_TIMER_STREAM_DATA:
+        return "get_stream_data";
+    case TS_STAT_TIMER_WRITE:
+        return "write_frame";
+    default:
+        return "unknown";
+    }
+}
+
+void TsStats::addFrame(uint16_t pid, uint64_t bytes)
+{
+    add(TS_STAT_FRAMES, 1);
+
+    // written by this thread only
+    auto pids = pids_.load(std::memory_order_relaxed);
+    if (pids == nullptr)
+    {
+        pids = new PID_SLOT[TS_STAT_PID_COUNT]();
+        pids_.store(pids, std::memory_order_release);
+    }
+    auto& slot = pids[pid & (TS_STAT_PID_COUNT - 1)];
+    slot.frames.store(slot.frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot.bytes.store(slot.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+void TsStats::reset()
+{
+    for (auto& counter : counters_)
+        counter.store(0, std::memory_order_relaxed);
+    for (int32_t i = 0; i < TS_STAT_TIMER_COUNT; i++)
+    {
+        timerTicks_[i].store(0, std::memory_order_relaxed);
+        timerCalls_[i].store(0, std::memory_order_relaxed);
+    }
+
+    auto pids = pids_.load(std::memory_order_relaxed);
+    if (pids != nullptr)
+    {
+        for (int32_t i = 0; i < TS_STAT_PID_COUNT; i++)
+        {
+            pids[i].frames.store(0, std::memory_order_relaxed);
+            pids[i].bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+TS_STATS_SNAPSHOT TsStats::snapshot() const
+{
+    TS_STATS_SNAPSHOT snapshot;
+    for (int32_t i = 0; i < TS_STAT_COUNTER_COUNT; i++)
+        snapshot.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    for (int32_t i = 0; i < TS_STAT_TIMER_COUNT; i++)
+    {
+        snapshot.timerTicks[i] = timerTicks_[i].load(std::memory_order_relaxed);
+        snapshot.timerCalls[i] = timerCalls_[i].load(std::memory_order_relaxed);
+    }
+
+    auto pids = pids_.load(std::memory_order_acquire);
+    if (pids != nullptr)
+    {
+        for (int32_t i = 0; i < TS_STAT_PID_COUNT; i++)
+        {
+            auto frames = pids[i].frames.load(std::memory_order_relaxed);
+            if (frames > 0)
+                snapshot.pids[static_cast<uint16_t>(i)] = { frames, pids[i].bytes.load(std::memory_order_relaxed) };
+        }
+    }
+    return snapshot;
+}
@@ -0,0 +1,165 @@
+#ifndef TSSTATS_H
+#define TSSTATS_H
+
+#include "tssplit_global.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+
+// per PID counters, one slot per PID
+#define TS_STAT_PID_COUNT   (8192)
+
+enum TS_STAT_COUNTER
+{
+    TS_STAT_PACKETS = 0,         // TS packets processed
+    TS_STAT_RESYNC_BYTES,        // bytes skipped looking for sync
+    TS_STAT_CC_ERRORS,           // continuity counter discontinuities
+    TS_STAT_PSI_SECTIONS,        // complete PSI sections
+    TS_STAT_CRC_ERRORS,          // PSI sections failing the CRC32
+    TS_STAT_PES_UNITS,           // PES unit starts
+    TS_STAT_FRAMES,              // frames emitted
+    TS_STAT_BYTES_WRITTEN,       // bytes written by the output
+    TS_STAT_MEMMOVE_BYTES,       // bytes moved by TsStream::append()
+    TS_STAT_REALLOCS,            // elementary stream buffer growths
+    TS_STAT_COUNTER_COUNT
+};
+
+enum TS_STAT_TIMER
+{
+    TS_STAT_TIMER_PACKAGE = 0,   // AVContext::processTSPackage()
+    TS_STAT_TIMER_PAYLOAD,       // AVContext::processTSPayload()
+    TS_STAT_TIMER_STREAM_DATA,   // TsDemuxer::getStreamData()
+    TS_STAT_TIMER_WRITE,         // TsFrameSink::writeFrame()
+    TS_STAT_TIMER_COUNT
+};
+
+struct TS_PID_COUNTERS
+{
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+struct TS_STATS_SNAPSHOT
+{
+    uint64_t counters[TS_STAT_COUNTER_COUNT];
+    uint64_t timerTicks[TS_STAT_TIMER_COUNT];   // see TsStats::tickUnit()
+    uint64_t timerCalls[TS_STAT_TIMER_COUNT];
+    std::map<uint16_t, TS_PID_COUNTERS> pids;
+};
+
+///////////////////////////////////////////////////////////
+// Hot path counters and timers of one demuxer. The demuxer binds its block
+// to the thread it runs on (TsStatsScope); the only writer is that thread,
+// so updates are plain relaxed stores and any thread may poll snapshot().
+// Everything is skipped unless enabled at runtime; define TSSPLIT_NO_STATS
+// to compile the hooks out.
+class TSSPLIT_EXPORT TsStats
+{
+public:
+    TsStats();
+    ~TsStats();
+
+    static void setEnabled(bool enabled);
+    static inline bool enabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    // block of the calling thread, null when disabled or unbound
+    static inline TsStats* current()
+    {
+        return enabled() ? bound() : nullptr;
+    }
+
+    static uint64_t ticks();
+    // "cycles" (time stamp counter) or "ns"
+    static const char* tickUnit();
+    static const char* counterName(TS_STAT_COUNTER counter);
+    static const char* timerName(TS_STAT_TIMER timer);
+
+    inline void add(TS_STAT_COUNTER counter, uint64_t value)
+    {
+        counters_[counter].store(counters_[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    inline void addTime(TS_STAT_TIMER timer, uint64_t ticks)
+    {
+        timerTicks_[timer].store(timerTicks_[timer].load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+        timerCalls_[timer].store(timerCalls_[timer].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    void addFrame(uint16_t pid, uint64_t bytes);
+
+    void reset();
+    TS_STATS_SNAPSHOT snapshot() const;
+
+private:
+    friend class TsStatsScope;
+
+    TsStats(const TsStats&);
+    TsStats& operator=(const TsStats&);
+
+    static TsStats* bound();
+    static TsStats* bind(TsStats* stats);
+
+    static std::atomic<bool> enabled_;
+
+    std::atomic<uint64_t> counters_[TS_STAT_COUNTER_COUNT];
+    std::atomic<uint64_t> timerTicks_[TS_STAT_TIMER_COUNT];
+    std::atomic<uint64_t> timerCalls_[TS_STAT_TIMER_COUNT];
+
+    struct PID_SLOT
+    {
+        std::atomic<uint64_t> frames;
+        std::atomic<uint64_t> bytes;
+    };
+    // TS_STAT_PID_COUNT slots, allocated on the first frame
+    std::atomic<PID_SLOT*> pids_;
+};
+
+///////////////////////////////////////////////////////////
+// Binds a stats block to the calling thread for the scope
+class TsStatsScope
+{
+public:
+    explicit TsStatsScope(TsStats& stats) : previous_(TsStats::bind(&stats)) {}
+    ~TsStatsScope()
+    {
+        TsStats::bind(previous_);
+    }
+
+private:
+    TsStats* previous_;
+};
+
+///////////////////////////////////////////////////////////
+class TsStatsTimer
+{
+public:
+    explicit TsStatsTimer(TS_STAT_TIMER timer)
+        : stats_(TsStats::current()),
+        timer_(timer),
+        start_(stats_ != nullptr ? TsStats::ticks() : 0)
+    {
+    }
+    ~TsStatsTimer()
+    {
+        if (stats_ != nullptr)
+            stats_->addTime(timer_, TsStats::ticks() - start_);
+    }
+
+private:
+    TsStats*      stats_;
+    TS_STAT_TIMER timer_;
+    uint64_t      start_;
+};
+
+#if defined (TSSPLIT_NO_STATS)
+#define TS_STAT_ADD(counter, value)     do {} while (0)
+#define TS_STAT_FRAME(pid, bytes)       do {} while (0)
+#define TS_STAT_TIMER(timer)            do {} while (0)
+#else
+#define TS_STAT_ADD(counter, value)     do { if (TsStats* s_ = TsStats::current()) s_->add(counter, value); } while (0)
+#define TS_STAT_FRAME(pid, bytes)       do { if (TsStats* s_ = TsStats::current()) s_->addFrame(pid, bytes); } while (0)
+#define TS_STAT_TIMER(timer)            TsStatsTimer tsStatsTimer_(timer)
+#endif
+
+#endif // TSSTATS_H
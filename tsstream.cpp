@@ -1,4 +1,19 @@
 #include "tsstream.h"
+#include "tsstats.h"
+#include "tsprobes.h"
+
+#include <cerrno>
+#include <limits>
+#include <new>
+
+// in front of every stream: the arena and the allocated size, padded so the
+// object behind it stays 16 byte aligned
+struct alignas(16) STREAM_HEADER
+{
+    TsArena* arena;
+    size_t   size;
+};
+static_assert(sizeof(STREAM_HEADER) % 16 == 0, "the stream behind the header must stay 16 byte aligned");
 
 TsStream::TsStream(uint16_t pes_pid)
     : streamType_(STREAM_TYPE_UNKNOWN),
@@ -8,6 +23,7 @@ TsStream::TsStream(uint16_t pes_pid)
     curPts_(PTS_UNSET),
     prevDts_(PTS_UNSET),
     prevPts_(PTS_UNSET),
+    arena_(nullptr),
     esAllocInit_(ES_INIT_BUFFER_SIZE),
     esBuf_(nullptr),
     esAlloc_(0),
@@ -15,18 +31,82 @@ TsStream::TsStream(uint16_t pes_pid)
     esConsumed_(0),
     esPtsPointer_(0),
     esParsed_(0),
-    esFoundFrame_(false)
+    esFoundFrame_(false),
+    esUnitEnd_(false)
 {
     memset(&streamInfo_, 0, sizeof(STREAM_INFO));
 }
 
 TsStream::~TsStream()
 {
-    if (esBuf_)
+    resizeBuffer(0);
+}
+
+void* TsStream::operator new(size_t size, TsArena* arena)
+{
+    size += sizeof(STREAM_HEADER);
+    auto header = static_cast<STREAM_HEADER*>(arena != nullptr ? arena->allocate(size) : ::operator new(size));
+    header->arena = arena;
+    header->size = size;
+    return header + 1;
+}
+
+void TsStream::operator delete(void* p)
+{
+    if (p == nullptr)
+        return;
+
+    auto header = static_cast<STREAM_HEADER*>(p) - 1;
+    if (header->arena != nullptr)
+        header->arena->deallocate(header, header->size);
+    else
+        ::operator delete(header);
+}
+
+// constructor failed
+void TsStream::operator delete(void* p, TsArena*)
+{
+    TsStream::operator delete(p);
+}
+
+// Moves the buffer content (esLen_ bytes) to a buffer of the size, 0 frees it
+bool TsStream::resizeBuffer(int32_t size)
+{
+    if (arena_ == nullptr)
+    {
+        if (size == 0)
+        {
+            free(esBuf_);
+            esBuf_ = nullptr;
+            esAlloc_ = 0;
+            return true;
+        }
+        auto p = static_cast<uint8_t*>(realloc(esBuf_, static_cast<size_t>(size)));
+        if (p == nullptr)
+            return false;
+        esBuf_ = p;
+        esAlloc_ = size;
+        return true;
+    }
+
+    uint8_t* p = nullptr;
+    if (size > 0)
     {
-        free(esBuf_);
-        esBuf_ = nullptr;
+        try
+        {
+            p = static_cast<uint8_t*>(arena_->allocate(static_cast<size_t>(size)));
+        }
+        catch (const std::bad_alloc&)
+        {
+            return false;
+        }
+        if (esBuf_ != nullptr && esLen_ > 0)
+            memcpy(p, esBuf_, static_cast<size_t>(esLen_ < size ? esLen_ : size));
     }
+    arena_->deallocate(esBuf_, static_cast<size_t>(esAlloc_));
+    esBuf_ = p;
+    esAlloc_ = size;
+    return true;
 }
 
 void TsStream::reset()
@@ -38,10 +118,12 @@ void TsStream::reset()
 void TsStream::clearBuffer()
 {
     esLen_ = esConsumed_ = esPtsPointer_ = esParsed_ = 0;
+    esUnitEnd_ = false;
 }
 
 int TsStream::append(const uint8_t* buf, int32_t len, bool newPts)
 {
+    esUnitEnd_ = false;
     // mark position where current pts become applicable
     if (newPts)
         esPtsPointer_ = esLen_;
@@ -51,6 +133,7 @@ int TsStream::append(const uint8_t* buf, int32_t len, bool newPts)
         if (esConsumed_ < esLen_)
         {
             memmove(esBuf_, esBuf_ + esConsumed_, esLen_ - esConsumed_);
+            TS_STAT_ADD(TS_STAT_MEMMOVE_BYTES, static_cast<uint64_t>(esLen_ - esConsumed_));
             esLen_ -= esConsumed_;
             esParsed_ -= esConsumed_;
             if (esPtsPointer_ > esConsumed_)
@@ -66,21 +149,23 @@ int TsStream::append(const uint8_t* buf, int32_t len, bool newPts)
     if (esLen_ + len > esAlloc_)
     {
         if (esAlloc_ >= ES_MAX_BUFFER_SIZE)
+        {
+            TS_PROBE3(es_overflow, pid_, esLen_ + len, esAlloc_);
             return -ENOMEM;
+        }
 
         int32_t n = (esAlloc_ ? (esAlloc_ + len) * 2 : esAllocInit_);
         if (n > ES_MAX_BUFFER_SIZE)
             n = ES_MAX_BUFFER_SIZE;
 
         // realloc buffer size to n for stream with pid
-        uint8_t* storeptr = esBuf_;
-        if (nullptr == (esBuf_ = (uint8_t*)realloc(esBuf_, n * sizeof(*esBuf_))))
+        TS_STAT_ADD(TS_STAT_REALLOCS, 1);
+        if (!resizeBuffer(n))
         {
-            free(storeptr);
-            esAlloc_ = esLen_ = 0;
+            resizeBuffer(0);
+            esLen_ = 0;
             return -ENOMEM;
         }
-        esAlloc_ = n;
     }
 
     if (esBuf_ == nullptr)
@@ -91,7 +176,7 @@ int TsStream::append(const uint8_t* buf, int32_t len, bool newPts)
     return 0;
 }
 
-QString TsStream::getStreamCodecName(STREAM_TYPE streamType)
+const char* TsStream::getStreamCodecName(STREAM_TYPE streamType)
 {
     switch (streamType)
     {
@@ -127,13 +212,13 @@ QString TsStream::getStreamCodecName(STREAM_TYPE streamType)
         return "lpcm";
     case STREAM_TYPE_AUDIO_DTS:
         return "dts";
-    case STREAM_TYPE_PRIVATE_DATA:
+    default:
         break;
     }
     return "data";
 }
 
-QString TsStream::getFileExtension(STREAM_TYPE streamType)
+const char* TsStream::getFileExtension(STREAM_TYPE streamType)
 {
     switch (streamType)
     {
@@ -167,6 +252,8 @@ QString TsStream::getFileExtension(STREAM_TYPE streamType)
         return ".lpcm";
     case STREAM_TYPE_AUDIO_DTS:
         return ".dts";
+    default:
+        break;
     }
     return "";
 }
@@ -200,18 +287,18 @@ void TsStream::resetStreamPackage(STREAM_PKG* pkg)
 
 int64_t TsStream::rescale(const int64_t& a, const int64_t& b, const int64_t& c)
 {
-    quint64 r = c / 2;
-    quint64 res = (a <= std::numeric_limits<int32_t>::max() ? ((a*b + r) / c) : (a / c * b + ((a%c)*b + r) / c));
+    uint64_t r = c / 2;
+    uint64_t res = (a <= std::numeric_limits<int32_t>::max() ? ((a*b + r) / c) : (a / c * b + ((a%c)*b + r) / c));
 
     if (b > std::numeric_limits<int32_t>::max() || c > std::numeric_limits<int32_t>::max())
     {
-        quint64 a0 = a & 0xFFFFFFFF;
-        quint64 a1 = a >> 32;
-        quint64 b0 = b & 0xFFFFFFFF;
-        quint64 b1 = b >> 32;
+        uint64_t a0 = a & 0xFFFFFFFF;
+        uint64_t a1 = a >> 32;
+        uint64_t b0 = b & 0xFFFFFFFF;
+        uint64_t b1 = b >> 32;
 
         res = a0 * b1 + a1 * b0;
-        quint64 t1 = res << 32;
+        uint64_t t1 = res << 32;
 
         a0 = a0 * b0 + t1;
         a1 = a1 * b1 + (res >> 32) + (a0 < t1);
@@ -222,7 +309,7 @@ int64_t TsStream::rescale(const int64_t& a, const int64_t& b, const int64_t& c)
         {
             a1 += a1 + ((a0 >> i) & 1);
             res += res;
-            if ((quint64)c <= a1)
+            if ((uint64_t)c <= a1)
             {
                 a1 -= c;
                 res++;
@@ -1,7 +1,12 @@
 #ifndef TSSTREAM_H
 #define TSSTREAM_H
 
-#include <QString>
+#include "tsarena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
 
 #define ES_INIT_BUFFER_SIZE     64000
 #define ES_MAX_BUFFER_SIZE      1048576
@@ -64,9 +69,21 @@ struct STREAM_PKG
     bool            streamChange;
 };
 
+// Program of the PAT with the PIDs its PMT lists
+struct TS_PROGRAM
+{
+    uint16_t channel;               // program_number
+    uint16_t pmtPid;
+    uint16_t pcrPid;                // 0x1fff: none or PMT not parsed yet
+    uint16_t transportStreamId;     // of the PAT
+    std::vector<uint16_t> pids;     // elementary PIDs of every stream type
+};
+
 /////////////////////////////////////////////////////////////////////
 class TsStream
 {
+    friend class TsKernelBench;   // bench/tskernels.cpp
+
 public:
     STREAM_TYPE streamType_;
     STREAM_INFO streamInfo_;
@@ -82,18 +99,40 @@ public:
     TsStream(uint16_t pes_pid);
     virtual ~TsStream();
 
+    // Streams and their buffers may live in the arena of the demuxer
+    static void* operator new(size_t size, TsArena* arena = nullptr);
+    static void operator delete(void* p);
+    static void operator delete(void* p, TsArena* arena);
+    inline void setArena(TsArena* arena)
+    {
+        arena_ = arena;
+    }
+
     virtual void reset();
     void clearBuffer();
     int append(const uint8_t* buf, int32_t len, bool newPts = false);
     virtual void parse(STREAM_PKG* pkg);
-    static QString getStreamCodecName(STREAM_TYPE streamType);
-    static QString getFileExtension(STREAM_TYPE streamType);
+    static const char* getStreamCodecName(STREAM_TYPE streamType);
+    static const char* getFileExtension(STREAM_TYPE streamType);
 
-    inline QString getStreamCodec() const
+    inline const char* getStreamCodec() const
     {
         return getStreamCodecName(streamType_);
     }
 
+    // Low latency: the buffer ends with a complete access unit, the parser may
+    // hand it out without waiting for the start of the next one. Cleared by
+    // the next append.
+    inline void setUnitEnd()
+    {
+        esUnitEnd_ = true;
+    }
+    // true when the elementary stream data starts a new access unit
+    virtual bool isUnitStart(const uint8_t* /*data*/, int32_t /*len*/) const
+    {
+        return false;
+    }
+
     inline bool getStreamPackage(STREAM_PKG* pkg)
     {
         resetStreamPackage(pkg);
@@ -107,7 +146,11 @@ protected:
     bool setVideoInformation(int32_t fpsScale, int32_t fpsRate, int32_t height, int32_t width, float aspect, bool Interlaced);
     bool setAudioInformation(int32_t channels, int32_t sampleRate, int32_t bitRate, int32_t bitsPerSample, int blockAlign);
 
+private:
+    bool resizeBuffer(int32_t size);
+
 protected:
+    TsArena* arena_;         // owner of esBuf_, null: heap
     int32_t  esAllocInit_;   // initial allocation of memory for buffer
     uint8_t* esBuf_;         // pointer to buffer
     int32_t  esAlloc_;       // allocated size of memory for buffer
@@ -116,6 +159,7 @@ protected:
     int32_t esPtsPointer_;  // position in buffer where current PTS becomes applicable
     int32_t  esParsed_;      // parser: last processed position in buffer
     bool    esFoundFrame_;  // parser: found frame
+    bool    esUnitEnd_;     // low latency: buffer ends with a complete access unit
 
 };
 
@@ -1,11 +1,17 @@
 #ifndef TSTABLE_H
 #define TSTABLE_H
 
-#include <QString>
+#include "tspool.h"
+
+#include <cstdint>
 
 // PSI section size (EN 300 468)
 #define TABLE_BUFFER_SIZE       4096
+// PES header up to the end of PES_header_data (9 + 255 bytes)
+#define PES_HEADER_BUFFER_SIZE  264
 
+// Section or PES header being assembled. The buffer comes from the pool of
+// the package type (PSI sections or PES headers) and is not zero-filled.
 struct TsTable
 {
     uint8_t  tableId;
@@ -13,16 +19,45 @@ struct TsTable
     uint16_t id;
     uint16_t len;
     uint16_t offset;
-    uint8_t  buf[TABLE_BUFFER_SIZE];
+    bool     hasCrc;            // section_syntax_indicator: ends with a CRC32
+    uint32_t crc;               // CRC32 of table_id and section_length
+    uint8_t* buf;
+    TsBufferPool* pool;
 
     TsTable()
         : tableId(0xff),
         version(0xff),
         id(0xffff),
         len(0),
-        offset(0)
+        offset(0),
+        hasCrc(false),
+        crc(0),
+        buf(nullptr),
+        pool(nullptr)
+    {
+    }
+
+    ~TsTable()
+    {
+        if (pool != nullptr)
+            pool->release(buf);
+    }
+
+    // buffer from the pool, the previous one is given back
+    void attach(TsBufferPool& bufferPool)
+    {
+        if (pool == &bufferPool)
+            return;
+        if (pool != nullptr)
+            pool->release(buf);
+        pool = &bufferPool;
+        buf = pool->acquire();
+        reset();
+    }
+
+    inline int32_t size() const
     {
-        memset(buf, 0, TABLE_BUFFER_SIZE);
+        return pool != nullptr ? pool->blockSize() : 0;
     }
 
     void reset(void)
@@ -30,7 +65,10 @@ struct TsTable
         len = 0;
         offset = 0;
     }
+
+private:
+    TsTable(const TsTable&);
+    TsTable& operator=(const TsTable&);
 };
 
 #endif // TSTABLE_H
-
@@ -0,0 +1,161 @@
+#include "tstrace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+struct TRACE_SPAN
+{
+    const char* category;
+    const char* name;
+    int64_t  start;              // ns since TsTrace::start()
+    int64_t  duration;           // ns
+    int32_t  tid;
+    int32_t  pid;                // TS PID, -1: none
+};
+
+std::atomic<bool> TsTrace::enabled_(false);
+
+static std::unique_ptr<TRACE_SPAN[]> traceRing;
+static uint64_t traceMask = 0;
+static std::atomic<uint64_t> traceNext(0);
+static std::atomic<int32_t>  traceThreads(0);
+static std::chrono::steady_clock::time_point traceEpoch;
+
+// guards the names below
+static std::mutex traceLock;
+static std::map<int32_t, std::string> traceThreadNames;
+static std::deque<std::string> traceStrings;
+
+static int32_t traceThreadId()
+{
+    static thread_local int32_t tid = ++traceThreads;
+    return tid;
+}
+
+static void writeJsonString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for (; *s; s++)
+    {
+        auto c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+////////////////////////////////////////////////////////////////////
+// capacity is rounded up to a power of two
+void TsTrace::start(uint32_t capacity)
+{
+    stop();
+
+    uint64_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    traceRing.reset(new TRACE_SPAN[size]());
+    traceMask = size - 1;
+    traceNext = 0;
+    traceEpoch = std::chrono::steady_clock::now();
+    enabled_.store(true, std::memory_order_release);
+}
+
+// Spans still being recorded by other threads may be lost; stop once the
+// jobs are done.
+void TsTrace::stop()
+{
+    enabled_.store(false, std::memory_order_release);
+}
+
+int64_t TsTrace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void TsTrace::record(const char* category, const char* name, int64_t startNs, int32_t pid)
+{
+    if (!enabled())
+        return;
+
+    auto end = now();
+    auto& span = traceRing[traceNext.fetch_add(1, std::memory_order_relaxed) & traceMask];
+    span.category = category;
+    span.name = name;
+    span.start = startNs;
+    span.duration = end - startNs;
+    span.tid = traceThreadId();
+    span.pid = pid;
+}
+
+void TsTrace::setThreadName(const std::string& name)
+{
+    auto tid = traceThreadId();
+    std::lock_guard<std::mutex> lock(traceLock);
+    traceThreadNames[tid] = name;
+}
+
+const char* TsTrace::intern(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(traceLock);
+    traceStrings.push_back(name);
+    return traceStrings.back().c_str();
+}
+
+bool TsTrace::writeChromeJson(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> lock(traceLock);
+        for (auto& item : traceThreadNames)
+        {
+            fprintf(file, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",", item.first);
+            writeJsonString(file, item.second.c_str());
+            fprintf(file, "}}");
+            first = false;
+        }
+    }
+
+    if (traceRing)
+    {
+        // oldest first
+        uint64_t end = traceNext.load(std::memory_order_acquire);
+        uint64_t begin = end > traceMask + 1 ? end - (traceMask + 1) : 0;
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const auto& span = traceRing[i & traceMask];
+            if (span.name == nullptr)
+                continue;
+
+            fprintf(file, "%s\n{\"ph\":\"X\",\"cat\":", first ? "" : ",");
+            writeJsonString(file, span.category);
+            fprintf(file, ",\"name\":");
+            writeJsonString(file, span.name);
+            fprintf(file, ",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", span.tid,
+                span.start / 1000.0, span.duration / 1000.0);
+            if (span.pid >= 0)
+                fprintf(file, ",\"args\":{\"pid\":%d}", span.pid);
+            fputc('}', file);
+            first = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
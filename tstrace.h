@@ -0,0 +1,81 @@
+#ifndef TSTRACE_H
+#define TSTRACE_H
+
+#include "tssplit_global.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// spans kept by default, older ones are overwritten
+#define TS_TRACE_DEFAULT_CAPACITY   (1 << 20)
+
+///////////////////////////////////////////////////////////
+// Timeline of pipeline spans (read, sync, demux, parse, write) recorded into
+// an in-memory ring and dumped as Chrome trace JSON, viewable in Perfetto or
+// chrome://tracing. Names and categories must be string literals or
+// intern()ed. Off until start(); define TSSPLIT_NO_TRACE to compile the
+// hooks out.
+class TSSPLIT_EXPORT TsTrace
+{
+public:
+    static void start(uint32_t capacity = TS_TRACE_DEFAULT_CAPACITY);
+    static void stop();
+    static inline bool enabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // nanoseconds since start()
+    static int64_t now();
+    static void record(const char* category, const char* name, int64_t startNs, int32_t pid = -1);
+    // names the calling thread in the timeline
+    static void setThreadName(const std::string& name);
+    // stable copy of a dynamic name
+    static const char* intern(const std::string& name);
+
+    // false when the file cannot be written
+    static bool writeChromeJson(const std::string& path);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+///////////////////////////////////////////////////////////
+class TsTraceSpan
+{
+public:
+    TsTraceSpan(const char* category, const char* name, int32_t pid = -1)
+        : category_(category),
+        name_(name),
+        pid_(pid),
+        start_(TsTrace::enabled() ? TsTrace::now() : -1)
+    {
+    }
+    ~TsTraceSpan()
+    {
+        if (start_ >= 0)
+            TsTrace::record(category_, name_, start_, pid_);
+    }
+
+private:
+    const char* category_;
+    const char* name_;
+    int32_t     pid_;
+    int64_t     start_;
+};
+
+#if defined (TSSPLIT_NO_TRACE)
+#define TS_TRACE_SPAN(category, name)               do {} while (0)
+#define TS_TRACE_SPAN_PID(category, name, pid)      do {} while (0)
+#define TS_TRACE_NOW()                              (int64_t(-1))
+#define TS_TRACE_RECORD(category, name, start, pid) do {} while (0)
+#else
+#define TS_TRACE_SPAN(category, name)               TsTraceSpan tsTraceSpan_(category, name)
+#define TS_TRACE_SPAN_PID(category, name, pid)      TsTraceSpan tsTraceSpan_(category, name, pid)
+// -1 when disabled
+#define TS_TRACE_NOW()                              (TsTrace::enabled() ? TsTrace::now() : int64_t(-1))
+#define TS_TRACE_RECORD(category, name, start, pid) do { if ((start) >= 0) TsTrace::record(category, name, start, pid); } while (0)
+#endif
+
+#endif // TSTRACE_H
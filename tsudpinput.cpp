@@ -0,0 +1,628 @@
+#include "tsudpinput.h"
+#include "tstrace.h"
+#include "tsprobes.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if !defined (_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// received datagrams carry the drop counter of the socket (Linux)
+#if defined (SO_RXQ_OVFL)
+#define TS_UDP_CONTROL_SIZE     CMSG_SPACE(sizeof(uint32_t))
+#else
+#define TS_UDP_CONTROL_SIZE     (0)
+#endif
+
+#if !defined (_WIN32)
+///////////////////////////////////////////////////////////
+// recvmmsg headers of the ring slots, set up once
+struct TsUdpInput::UDP_MESSAGES
+{
+#if defined (__linux__)
+    std::vector<mmsghdr> headers;
+#else
+    std::vector<msghdr> headers;
+#endif
+    std::vector<iovec>   vectors;
+    std::vector<uint8_t> control;
+};
+#else
+struct TsUdpInput::UDP_MESSAGES
+{
+};
+#endif
+
+////////////////////////////////////////////////////////////////////
+TsUdpInput::TsUdpInput(const TS_UDP_OPTIONS& options)
+    : options_(options),
+    fd_(-1),
+    error_(0),
+    receiveBufferSize_(0),
+    count_(0),
+    index_(0),
+    offset_(0),
+    expected_(0),
+    held_(0),
+    synced_(false),
+    started_(false),
+    ended_(false),
+    dropCounter_(0),
+    datagrams_(0),
+    drops_(0),
+    lost_(0),
+    duplicates_(0),
+    late_(0),
+    rejected_(0),
+    interrupted_(false)
+{
+    if (options_.batch <= 0)
+        options_.batch = TS_UDP_DEFAULT_BATCH;
+    if (options_.reorderWindow <= 0)
+        options_.reorderWindow = TS_RTP_DEFAULT_WINDOW;
+    // power of two: slots stay distinct across the sequence number wrap
+    int32_t window = 1;
+    while (window < options_.reorderWindow && window < TS_RTP_MAX_GAP / 2)
+        window <<= 1;
+    options_.reorderWindow = window;
+}
+
+TsUdpInput::~TsUdpInput()
+{
+    close();
+}
+
+TS_UDP_OPTIONS TsUdpInput::defaultOptions()
+{
+    TS_UDP_OPTIONS options;
+    options.port = 0;
+    options.receiveBuffer = 0;
+    options.busyPollUs = 0;
+    options.batch = TS_UDP_DEFAULT_BATCH;
+    options.idleTimeoutMs = 0;
+    options.rtp = false;
+    options.reorderWindow = TS_RTP_DEFAULT_WINDOW;
+    options.payloadType = TS_RTP_PAYLOAD_MP2T;
+    return options;
+}
+
+bool TsUdpInput::parseUrl(const std::string& url, TS_UDP_OPTIONS& options)
+{
+    // same length
+    static const char udp[] = "udp://";
+    static const char rtp[] = "rtp://";
+    bool isRtp = url.compare(0, sizeof(rtp) - 1, rtp) == 0;
+    if (!isRtp && url.compare(0, sizeof(udp) - 1, udp) != 0)
+        return false;
+
+    options = defaultOptions();
+    options.rtp = isRtp;
+
+    auto rest = url.substr(sizeof(udp) - 1);
+    auto query = rest.find('?');
+    auto host = rest.substr(0, query);
+    // udp://@group:port as written by VLC
+    if (!host.empty() && host[0] == '@')
+        host.erase(0, 1);
+
+    auto colon = host.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    auto port = atoi(host.c_str() + colon + 1);
+    if (port <= 0 || port > 0xffff)
+        return false;
+    options.address = host.substr(0, colon);
+    options.port = static_cast<uint16_t>(port);
+
+    while (query != std::string::npos)
+    {
+        auto next = rest.find('&', query + 1);
+        auto item = rest.substr(query + 1, next == std::string::npos ? std::string::npos : next - query - 1);
+        query = next;
+
+        auto eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+        auto key = item.substr(0, eq);
+        auto value = item.substr(eq + 1);
+
+        if (key == "rcvbuf")
+            options.receiveBuffer = atoi(value.c_str());
+        else if (key == "busypoll")
+            options.busyPollUs = atoi(value.c_str());
+        else if (key == "batch")
+            options.batch = std::max(1, atoi(value.c_str()));
+        else if (key == "timeout")
+            options.idleTimeoutMs = atoi(value.c_str());
+        else if (key == "ifaddr")
+            options.interfaceAddress = value;
+        else if (key == "window")
+            options.reorderWindow = std::max(1, atoi(value.c_str()));
+        else if (key == "pt")
+            options.payloadType = std::max(-1, std::min(127, atoi(value.c_str())));
+        else
+            return false;
+    }
+    return true;
+}
+
+#if !defined (_WIN32)
+
+bool TsUdpInput::open()
+{
+    close();
+    interrupted_ = false;
+
+    in_addr address;
+    address.s_addr = htonl(INADDR_ANY);
+    if (!options_.address.empty() && inet_pton(AF_INET, options_.address.c_str(), &address) != 1)
+    {
+        error_ = EINVAL;
+        return false;
+    }
+    bool multicast = IN_MULTICAST(ntohl(address.s_addr));
+
+    fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd_ < 0)
+    {
+        error_ = errno;
+        return false;
+    }
+
+    // several receivers of the same group
+    int32_t on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (options_.receiveBuffer > 0)
+    {
+        int32_t size = options_.receiveBuffer;
+#if defined (SO_RCVBUFFORCE)
+        // above net.core.rmem_max when privileged
+        if (setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+#endif
+            setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    socklen_t optionLength = sizeof(receiveBufferSize_);
+    getsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize_, &optionLength);
+
+#if defined (SO_BUSY_POLL)
+    if (options_.busyPollUs > 0)
+        setsockopt(fd_, SOL_SOCKET, SO_BUSY_POLL, &options_.busyPollUs, sizeof(options_.busyPollUs));
+#endif
+#if defined (SO_RXQ_OVFL)
+    setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+
+    timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = TS_UDP_POLL_INTERVAL * 1000;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // bound to the group only its datagrams are received
+    sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(options_.port);
+    local.sin_addr = address;
+    if (::bind(fd_, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0)
+    {
+        error_ = errno;
+        close();
+        return false;
+    }
+
+    if (multicast)
+    {
+        ip_mreq request;
+        request.imr_multiaddr = address;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (!options_.interfaceAddress.empty() &&
+            inet_pton(AF_INET, options_.interfaceAddress.c_str(), &request.imr_interface) != 1)
+        {
+            error_ = EINVAL;
+            close();
+            return false;
+        }
+        if (setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0)
+        {
+            error_ = errno;
+            close();
+            return false;
+        }
+    }
+
+    auto batch = static_cast<size_t>(options_.batch);
+    ring_.resize(batch * TS_UDP_DATAGRAM_SIZE);
+    lengths_.assign(batch, 0);
+    messages_.reset(new UDP_MESSAGES());
+    messages_->headers.resize(batch);
+    messages_->vectors.resize(batch);
+    messages_->control.resize(batch * TS_UDP_CONTROL_SIZE);
+    for (size_t i = 0; i < batch; i++)
+    {
+        messages_->vectors[i].iov_base = ring_.data() + i * TS_UDP_DATAGRAM_SIZE;
+        messages_->vectors[i].iov_len = TS_UDP_DATAGRAM_SIZE;
+    }
+
+    if (options_.rtp)
+    {
+        auto window = static_cast<size_t>(options_.reorderWindow);
+        reorder_.resize(window * TS_UDP_DATAGRAM_SIZE);
+        slots_.assign(window, RTP_SLOT());
+        delivered_.assign(65536 / 64, 0);
+    }
+
+    count_ = index_ = offset_ = 0;
+    expected_ = 0;
+    held_ = 0;
+    synced_ = false;
+    started_ = false;
+    ended_ = false;
+    dropCounter_ = 0;
+    datagrams_ = 0;
+    drops_ = 0;
+    lost_ = 0;
+    duplicates_ = 0;
+    late_ = 0;
+    rejected_ = 0;
+    setLookback(TS_INPUT_LOOKBACK);
+    return true;
+}
+
+void TsUdpInput::close()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    messages_.reset();
+    std::vector<uint8_t>().swap(ring_);
+    std::vector<uint8_t>().swap(reorder_);
+    releaseBuffer();
+}
+
+// Fills the ring: waits for the first datagram, takes what else is queued.
+// >0 datagrams, 0 end of stream, <0 error
+int32_t TsUdpInput::receive()
+{
+    TS_TRACE_SPAN("io", "recv");
+    auto& m = *messages_;
+    auto idleStart = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        if (interrupted_.load(std::memory_order_relaxed))
+            return 0;
+
+        // the kernel shrinks the lengths
+        for (int32_t i = 0; i < options_.batch; i++)
+        {
+#if defined (__linux__)
+            auto& header = m.headers[i].msg_hdr;
+#else
+            auto& header = m.headers[i];
+#endif
+            memset(&header, 0, sizeof(header));
+            header.msg_iov = &m.vectors[i];
+            header.msg_iovlen = 1;
+            if (TS_UDP_CONTROL_SIZE > 0)
+            {
+                header.msg_control = m.control.data() + i * TS_UDP_CONTROL_SIZE;
+                header.msg_controllen = TS_UDP_CONTROL_SIZE;
+            }
+        }
+
+#if defined (__linux__)
+        auto ret = ::recvmmsg(fd_, m.headers.data(), static_cast<unsigned int>(options_.batch), MSG_WAITFORONE, nullptr);
+#else
+        auto ret = static_cast<int>(::recvmsg(fd_, &m.headers[0], 0));
+        if (ret >= 0)
+        {
+            lengths_[0] = ret;
+            ret = 1;
+        }
+#endif
+        if (ret > 0)
+        {
+            for (int32_t i = 0; i < ret; i++)
+            {
+#if defined (__linux__)
+                auto& header = m.headers[i].msg_hdr;
+                lengths_[i] = static_cast<int32_t>(m.headers[i].msg_len);
+#else
+                auto& header = m.headers[i];
+#endif
+#if defined (SO_RXQ_OVFL)
+                for (auto cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+                {
+                    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+                    {
+                        uint32_t counter;
+                        memcpy(&counter, CMSG_DATA(cmsg), sizeof(counter));
+                        countDrops(counter);
+                    }
+                }
+#else
+                (void)header;
+#endif
+            }
+            datagrams_.fetch_add(static_cast<uint64_t>(ret), std::memory_order_relaxed);
+            return ret;
+        }
+
+        if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            error_ = errno;
+            return -1;
+        }
+
+        if (options_.idleTimeoutMs > 0 && std::chrono::steady_clock::now() - idleStart >=
+            std::chrono::milliseconds(options_.idleTimeoutMs))
+            return 0;
+    }
+}
+
+#else
+
+bool TsUdpInput::open()
+{
+    error_ = ENOSYS;
+    return false;
+}
+
+void TsUdpInput::close()
+{
+    releaseBuffer();
+}
+
+int32_t TsUdpInput::receive()
+{
+    return -1;
+}
+
+#endif
+
+// The counter of the socket wraps at 32 bits
+void TsUdpInput::countDrops(uint32_t counter)
+{
+    if (counter == dropCounter_)
+        return;
+
+    auto dropped = counter - dropCounter_;
+    dropCounter_ = counter;
+    drops_.fetch_add(dropped, std::memory_order_relaxed);
+    TS_PROBE2(udp_drops, static_cast<int32_t>(dropped), drops_.load(std::memory_order_relaxed));
+}
+
+int64_t TsUdpInput::size() const
+{
+    return -1;
+}
+
+std::string TsUdpInput::name() const
+{
+    return (options_.rtp ? "rtp://" : "udp://") + options_.address + ":" + std::to_string(options_.port);
+}
+
+std::string TsUdpInput::errorString() const
+{
+    return error_ ? std::string(strerror(error_)) : std::string();
+}
+
+void TsUdpInput::interrupt()
+{
+    interrupted_ = true;
+}
+
+// Copies whole datagrams in order, a datagram larger than the space left is
+// continued on the next call
+int64_t TsUdpInput::readData(uint8_t* data, int64_t len)
+{
+    if (options_.rtp)
+        return readRtp(data, len);
+
+    if (index_ >= count_)
+    {
+        auto ret = receive();
+        if (ret <= 0)
+            return ret;
+        count_ = ret;
+        index_ = offset_ = 0;
+    }
+
+    int64_t copied = 0;
+    while (index_ < count_ && copied < len)
+    {
+        auto size = std::min<int64_t>(lengths_[index_] - offset_, len - copied);
+        memcpy(data + copied, ring_.data() + static_cast<size_t>(index_) * TS_UDP_DATAGRAM_SIZE + offset_, static_cast<size_t>(size));
+        copied += size;
+        offset_ += static_cast<int32_t>(size);
+        if (offset_ >= lengths_[index_])
+        {
+            index_++;
+            offset_ = 0;
+        }
+    }
+    return copied;
+}
+
+// Payload of an RTP datagram (RFC 3550): CSRCs, extension and padding skipped
+static bool parseRtp(const uint8_t* data, int32_t len, int32_t& offset, int32_t& size, uint16_t& seq, int32_t& type)
+{
+    if (len < 12 || (data[0] >> 6) != 2)
+        return false;
+
+    offset = 12 + 4 * (data[0] & 0x0f);
+    if (data[0] & 0x10)
+    {
+        if (offset + 4 > len)
+            return false;
+        offset += 4 + 4 * ((data[offset + 2] << 8) | data[offset + 3]);
+    }
+    auto padding = (data[0] & 0x20) ? data[len - 1] : 0;
+
+    size = len - offset - padding;
+    seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    type = data[1] & 0x7f;
+    return size > 0;
+}
+
+void TsUdpInput::markDelivered(uint16_t seq, bool delivered)
+{
+    auto& word = delivered_[seq >> 6];
+    auto bit = static_cast<uint64_t>(1) << (seq & 63);
+    word = delivered ? (word | bit) : (word & ~bit);
+}
+
+// The head of the window is given up
+void TsUdpInput::skipRtp()
+{
+    markDelivered(expected_, false);
+    // the half window in front of the first datagram is not lost
+    if (started_)
+        lost_.fetch_add(1, std::memory_order_relaxed);
+    expected_++;
+    offset_ = 0;
+}
+
+// Delivers the head slot while it is there, otherwise takes the next received
+// datagram into the ring. A datagram beyond the window makes the head give up.
+int64_t TsUdpInput::readRtp(uint8_t* data, int64_t len)
+{
+    auto window = options_.reorderWindow;
+    int64_t copied = 0;
+
+    while (copied < len)
+    {
+        auto index = expected_ % window;
+        auto& head = slots_[index];
+        if (head.filled && head.seq == expected_)
+        {
+            auto size = std::min<int64_t>(head.length - offset_, len - copied);
+            memcpy(data + copied, reorder_.data() + static_cast<size_t>(index) * TS_UDP_DATAGRAM_SIZE + offset_, static_cast<size_t>(size));
+            copied += size;
+            offset_ += static_cast<int32_t>(size);
+            if (offset_ >= head.length)
+            {
+                head.filled = false;
+                held_--;
+                started_ = true;
+                markDelivered(expected_, true);
+                expected_++;
+                offset_ = 0;
+            }
+            continue;
+        }
+
+        if (index_ >= count_)
+        {
+            if (copied > 0)
+                break;
+
+            // end of stream: the rest of the window, without waiting again
+            if (ended_)
+            {
+                if (held_ == 0)
+                    return 0;
+                skipRtp();
+                continue;
+            }
+            auto ret = receive();
+            if (ret < 0)
+                return ret;
+            if (ret == 0)
+            {
+                ended_ = true;
+                continue;
+            }
+            count_ = ret;
+            index_ = 0;
+        }
+
+        int32_t offset, size, type;
+        uint16_t seq;
+        auto datagram = ring_.data() + static_cast<size_t>(index_) * TS_UDP_DATAGRAM_SIZE;
+        if (!parseRtp(datagram, lengths_[index_], offset, size, seq, type))
+        {
+            index_++;
+            continue;
+        }
+        // other traffic on the port: not transport stream, not in the sequence
+        if (options_.payloadType >= 0 && type != options_.payloadType)
+        {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            index_++;
+            continue;
+        }
+
+        // datagrams sent before the first one may still arrive
+        if (!synced_)
+        {
+            expected_ = static_cast<uint16_t>(seq - window / 2);
+            synced_ = true;
+        }
+
+        auto distance = static_cast<int16_t>(seq - expected_);
+        if (distance >= TS_RTP_MAX_GAP || distance < -TS_RTP_MAX_GAP)
+        {
+            // restarted sequence: drain the window, then follow it
+            if (held_ > 0)
+            {
+                skipRtp();
+                continue;
+            }
+            synced_ = false;
+            started_ = false;
+            continue;
+        }
+
+        if (distance < 0)
+        {
+            if (delivered_[seq >> 6] & (static_cast<uint64_t>(1) << (seq & 63)))
+                duplicates_.fetch_add(1, std::memory_order_relaxed);
+            else
+                late_.fetch_add(1, std::memory_order_relaxed);
+            index_++;
+            continue;
+        }
+
+        if (distance >= window)
+        {
+            skipRtp();
+            continue;
+        }
+
+        // in the window a filled slot holds the same sequence number
+        auto& slot = slots_[seq % window];
+        if (slot.filled)
+        {
+            duplicates_.fetch_add(1, std::memory_order_relaxed);
+            index_++;
+            continue;
+        }
+
+        memcpy(reorder_.data() + static_cast<size_t>(seq % window) * TS_UDP_DATAGRAM_SIZE, datagram + offset, static_cast<size_t>(size));
+        slot.length = size;
+        slot.seq = seq;
+        slot.filled = true;
+        held_++;
+        index_++;
+    }
+    return copied;
+}
+
+bool TsUdpInput::seekData(const int64_t&)
+{
+    error_ = ESPIPE;
+    return false;
+}
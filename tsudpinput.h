@@ -0,0 +1,153 @@
+#ifndef TSUDPINPUT_H
+#define TSUDPINPUT_H
+
+#include "tsinput.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// datagrams taken per receive call
+#define TS_UDP_DEFAULT_BATCH    (64)
+// slot of the receive ring, 7 TS packets plus an RTP header fit easily
+#define TS_UDP_DATAGRAM_SIZE    (2048)
+// blocking receives wake up at this interval to check interrupt and idle (ms)
+#define TS_UDP_POLL_INTERVAL    (100)
+// RTP datagrams held to wait for a missing one
+#define TS_RTP_DEFAULT_WINDOW   (32)
+// sequence jumps larger than this restart the sequence (sender restart)
+#define TS_RTP_MAX_GAP          (3000)
+// RTP payload type of MPEG-2 transport streams (RFC 3551)
+#define TS_RTP_PAYLOAD_MP2T     (33)
+
+struct TS_UDP_OPTIONS
+{
+    std::string address;            // multicast group or local address, empty: any
+    uint16_t    port;
+    std::string interfaceAddress;   // interface joining the group, empty: default
+    int32_t     receiveBuffer;      // SO_RCVBUF in bytes, 0: system default
+    int32_t     busyPollUs;         // SO_BUSY_POLL, 0: off
+    int32_t     batch;              // datagrams per receive call
+    int32_t     idleTimeoutMs;      // end of stream after no data for this long, 0: never
+    bool        rtp;                // strip RTP headers and reorder by sequence number
+    int32_t     reorderWindow;      // RTP datagrams held for reordering, rounded to a power of two
+    int32_t     payloadType;        // RTP payload type accepted, -1: any
+};
+
+///////////////////////////////////////////////////////////
+// Live IPv4 UDP (unicast or multicast) source. Datagrams are received in
+// batches (recvmmsg on Linux) into a ring of slots and copied in order into
+// the read buffer of the demuxer. The stream is read forward only and ends
+// on interrupt() or the idle timeout. Datagrams dropped by the kernel for a
+// full socket buffer are counted (SO_RXQ_OVFL).
+// With RTP (payload type 33) the headers are stripped and the payloads pass
+// a fixed reorder ring: the demuxer only sees them in sequence order. A gap
+// is given up as lost once the window is full or the stream ends. Datagrams
+// of other payload types are dropped and counted.
+//
+//     udp://[address]:port[?rcvbuf=bytes&busypoll=us&batch=n&timeout=ms&ifaddr=address]
+//     rtp://[address]:port[?...&window=n&pt=type]
+class TSSPLIT_EXPORT TsUdpInput : public TsInput
+{
+public:
+    TsUdpInput(const TS_UDP_OPTIONS& options);
+    ~TsUdpInput() override;
+
+    static TS_UDP_OPTIONS defaultOptions();
+    // false when the url is not an udp:// address
+    static bool parseUrl(const std::string& url, TS_UDP_OPTIONS& options);
+
+    bool open() override;
+    void close() override;
+    int64_t size() const override;
+    std::string name() const override;
+    std::string errorString() const override;
+    void interrupt() override;
+
+    // SO_RCVBUF granted by the kernel, valid once open
+    inline int32_t receiveBufferSize() const
+    {
+        return receiveBufferSize_;
+    }
+    inline uint64_t datagrams() const
+    {
+        return datagrams_.load(std::memory_order_relaxed);
+    }
+    // datagrams the kernel dropped since open
+    inline uint64_t drops() const
+    {
+        return drops_.load(std::memory_order_relaxed);
+    }
+    // RTP sequence numbers never delivered
+    inline uint64_t lost() const
+    {
+        return lost_.load(std::memory_order_relaxed);
+    }
+    inline uint64_t duplicates() const
+    {
+        return duplicates_.load(std::memory_order_relaxed);
+    }
+    // RTP datagrams arriving after their gap was given up
+    inline uint64_t late() const
+    {
+        return late_.load(std::memory_order_relaxed);
+    }
+    // RTP datagrams of another payload type
+    inline uint64_t rejected() const
+    {
+        return rejected_.load(std::memory_order_relaxed);
+    }
+
+protected:
+    int64_t readData(uint8_t* data, int64_t len) override;
+    bool seekData(const int64_t& position) override;
+
+private:
+    int32_t receive();
+    void    countDrops(uint32_t counter);
+    int64_t readRtp(uint8_t* data, int64_t len);
+    void    skipRtp();
+    void    markDelivered(uint16_t seq, bool delivered);
+
+    TS_UDP_OPTIONS options_;
+    int      fd_;
+    int      error_;
+    int32_t  receiveBufferSize_;
+
+    // receive ring: slots of TS_UDP_DATAGRAM_SIZE
+    struct UDP_MESSAGES;
+    std::unique_ptr<UDP_MESSAGES> messages_;
+    std::vector<uint8_t> ring_;
+    std::vector<int32_t> lengths_;
+    int32_t  count_;             // datagrams in the ring
+    int32_t  index_;             // next datagram to copy
+    int32_t  offset_;            // bytes of it (RTP: of the head slot) already copied
+
+    // RTP reorder ring: payloads at seq % window, slots of TS_UDP_DATAGRAM_SIZE
+    struct RTP_SLOT
+    {
+        int32_t  length;
+        uint16_t seq;
+        bool     filled;
+    };
+    std::vector<uint8_t>  reorder_;
+    std::vector<RTP_SLOT> slots_;
+    std::vector<uint64_t> delivered_;   // bit per sequence number: delivered or lost
+    uint16_t expected_;          // next sequence number to deliver
+    int32_t  held_;              // filled slots
+    bool     synced_;
+    bool     started_;           // a payload was delivered
+    bool     ended_;             // receive() returned the end, the window drains
+
+    uint32_t dropCounter_;       // last SO_RXQ_OVFL value
+    std::atomic<uint64_t> datagrams_;
+    std::atomic<uint64_t> drops_;
+    std::atomic<uint64_t> lost_;
+    std::atomic<uint64_t> duplicates_;
+    std::atomic<uint64_t> late_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<bool> interrupted_;
+};
+
+#endif // TSUDPINPUT_H
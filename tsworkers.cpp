@@ -0,0 +1,58 @@
+#include "tsworkers.h"
+
+#include <algorithm>
+
+TsWorkerPool::TsWorkerPool(int32_t threads, int32_t maxPending)
+    : maxPending_(maxPending > 0 ? maxPending : 2 * std::max(1, threads)),
+    pending_(0),
+    stop_(false)
+{
+    for (int32_t i = 0; i < std::max(1, threads); i++)
+        threads_.emplace_back(&TsWorkerPool::run, this, i);
+}
+
+TsWorkerPool::~TsWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stop_ = true;
+    }
+    queued_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+void TsWorkerPool::submit(TASK task)
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    done_.wait(lock, [this] { return pending_ < maxPending_; });
+    tasks_.push_back(std::move(task));
+    pending_++;
+    lock.unlock();
+    queued_.notify_one();
+}
+
+void TsWorkerPool::wait()
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void TsWorkerPool::run(int32_t worker)
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    for (;;)
+    {
+        queued_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty())
+            break;
+
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+        task(worker);
+        lock.lock();
+        pending_--;
+        done_.notify_all();
+    }
+}
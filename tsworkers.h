@@ -0,0 +1,53 @@
+#ifndef TSWORKERS_H
+#define TSWORKERS_H
+
+#include "tssplit_global.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///////////////////////////////////////////////////////////
+// Fixed set of threads taking tasks in submission order. A task gets the
+// index of the worker running it for per thread state. submit() holds the
+// caller while maxPending tasks are queued or running.
+class TSSPLIT_EXPORT TsWorkerPool
+{
+public:
+    typedef std::function<void(int32_t worker)> TASK;
+
+    // maxPending 0: twice the threads
+    TsWorkerPool(int32_t threads, int32_t maxPending = 0);
+    // runs the queued tasks first
+    ~TsWorkerPool();
+
+    void submit(TASK task);
+    // until every submitted task has run
+    void wait();
+
+    inline int32_t threads() const
+    {
+        return static_cast<int32_t>(threads_.size());
+    }
+
+private:
+    TsWorkerPool(const TsWorkerPool&);
+    TsWorkerPool& operator=(const TsWorkerPool&);
+
+    void run(int32_t worker);
+
+    std::vector<std::thread> threads_;
+    std::mutex lock_;
+    std::condition_variable queued_;
+    std::condition_variable done_;
+    std::deque<TASK> tasks_;
+    int32_t maxPending_;
+    int32_t pending_;            // queued or running
+    bool    stop_;
+};
+
+#endif // TSWORKERS_H